@@ -0,0 +1,137 @@
+#include "AssetArchive.hpp"
+
+#include "lz4_block.hpp"
+#include "data_path.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <cassert>
+
+constexpr uint32_t AssetArchive::Version;
+constexpr size_t AssetArchive::Alignment;
+
+uint64_t asset_hash(void const *data_, size_t size) {
+	uint8_t const *data = reinterpret_cast< uint8_t const * >(data_);
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+AssetArchive::AssetArchive(std::string const &filename) : file(filename, MappedFile::Random) {
+	if (file.size < sizeof(Header)) {
+		throw std::runtime_error("Archive '" + filename + "' is too small to have a header.");
+	}
+	std::memcpy(&header, file.bytes, sizeof(Header));
+	if (std::string(header.magic, 4) != "pack") {
+		throw std::runtime_error("Archive '" + filename + "' has the wrong magic number.");
+	}
+	if (header.version != Version) {
+		throw std::runtime_error("Archive '" + filename + "' is version " + std::to_string(header.version) + ", expected " + std::to_string(Version) + ".");
+	}
+
+	size_t index_size = size_t(header.entry_count) * sizeof(Entry);
+	if (file.size - sizeof(Header) < index_size || file.size - sizeof(Header) - index_size < header.names_size) {
+		throw std::runtime_error("Archive '" + filename + "' has a truncated index.");
+	}
+	static_assert(sizeof(Header) % alignof(Entry) == 0, "entries follow header without padding");
+	entries = reinterpret_cast< Entry const * >(file.bytes + sizeof(Header));
+	names = reinterpret_cast< char const * >(file.bytes + sizeof(Header) + index_size);
+
+	for (uint32_t i = 0; i < header.entry_count; ++i) {
+		Entry const &entry = entries[i];
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= header.names_size)) {
+			throw std::runtime_error("Archive '" + filename + "' has an entry with a bad name.");
+		}
+		if (entry.offset > file.size || file.size - entry.offset < entry.stored_size) {
+			throw std::runtime_error("Archive '" + filename + "' has an entry that runs past the end of the file.");
+		}
+		if (!(entry.flags & FlagLZ4) && entry.stored_size != entry.size) {
+			throw std::runtime_error("Archive '" + filename + "' has a stored entry with mismatched sizes.");
+		}
+	}
+
+	verified.reset(new std::atomic< bool >[header.entry_count]);
+	for (uint32_t i = 0; i < header.entry_count; ++i) {
+		verified[i] = false;
+	}
+}
+
+bool AssetArchive::find(std::string const &name, Contents *contents) const {
+	assert(contents);
+
+	//binary search the (sorted) index:
+	auto name_less = [this](Entry const &entry, std::string const &key) -> bool {
+		size_t length = entry.name_end - entry.name_begin;
+		int c = std::memcmp(names + entry.name_begin, key.data(), std::min(length, key.size()));
+		return c < 0 || (c == 0 && length < key.size());
+	};
+	Entry const *end = entries + header.entry_count;
+	Entry const *entry = std::lower_bound(entries, end, name, name_less);
+	if (entry == end || std::string(names + entry->name_begin, names + entry->name_end) != name) {
+		return false;
+	}
+
+	uint8_t const *stored = file.bytes + entry->offset;
+	if (entry->flags & FlagLZ4) {
+		auto decompressed = std::make_shared< std::vector< uint8_t > >(size_t(entry->size));
+		try {
+			lz4_decompress(stored, size_t(entry->stored_size), decompressed->data(), decompressed->size());
+		} catch (std::exception &e) {
+			throw std::runtime_error("Archive '" + file.filename + "' entry '" + name + "' is corrupt: " + e.what());
+		}
+		contents->data = decompressed->data();
+		contents->size = decompressed->size();
+		contents->decompressed = decompressed;
+	} else {
+		contents->data = stored;
+		contents->size = size_t(entry->size);
+		contents->decompressed.reset();
+	}
+
+	//check the hash the first time each entry is used:
+	std::atomic< bool > &checked = verified[entry - entries];
+	if (!checked) {
+		if (asset_hash(contents->data, contents->size) != entry->hash) {
+			throw std::runtime_error("Archive '" + file.filename + "' entry '" + name + "' doesn't match its hash.");
+		}
+		checked = true;
+	}
+
+	return true;
+}
+
+AssetArchive const *data_archive() {
+	//(static local, so the first thread to ask maps the archive and any others wait for it)
+	static std::unique_ptr< AssetArchive > archive = []() -> std::unique_ptr< AssetArchive > {
+		std::string filename = data_path("assets.pack");
+		try {
+			std::unique_ptr< AssetArchive > ret(new AssetArchive(filename));
+			std::cout << "Using " << ret->header.entry_count << " data files from '" << filename << "'." << std::endl;
+			return ret;
+		} catch (std::exception &e) {
+			//no archive is fine (loose files are used instead), but a broken one is worth mentioning:
+			std::ifstream test(filename, std::ios::binary);
+			if (test) {
+				std::cerr << "WARNING: ignoring data archive: " << e.what() << std::endl;
+			}
+			return nullptr;
+		}
+	}();
+	return archive.get();
+}
+
+bool find_data_file(std::string const &path, AssetArchive::Contents *contents) {
+	AssetArchive const *archive = data_archive();
+	if (!archive) return false;
+
+	//archive names are relative to the data directory:
+	static std::string const prefix = data_path("");
+	if (path.compare(0, prefix.size(), prefix) != 0) return false;
+	return archive->find(path.substr(prefix.size()), contents);
+}
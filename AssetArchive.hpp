@@ -0,0 +1,77 @@
+#pragma once
+
+#include "MappedFile.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+//"AssetArchive" reads a packed archive of data files (written by the 'pack_assets' tool):
+// - a header, then an index of entries sorted by name, then the entry names, then entry contents
+// - each entry's contents start on an 'Alignment'-byte boundary (so ChunkFile spans into them stay aligned)
+// - entries are either stored or LZ4-compressed, and carry a hash of their (uncompressed) contents
+//
+//Loaders don't use this directly; ChunkFile, load_png, Sound::Sample, etc. call find_data_file() with the
+// path they got from data_path(), which looks in data_path("assets.pack") before they fall back to loose files.
+struct AssetArchive {
+	static constexpr uint32_t Version = 1;
+	static constexpr size_t Alignment = 16;
+
+	struct Header {
+		char magic[4] = {'p', 'a', 'c', 'k'};
+		uint32_t version = Version;
+		uint32_t entry_count = 0;
+		uint32_t names_size = 0; //bytes of names following the index
+	};
+	static_assert(sizeof(Header) == 16, "header is packed");
+
+	enum : uint32_t {
+		FlagLZ4 = 1, //contents are an LZ4 block
+	};
+
+	struct Entry {
+		uint64_t offset = 0; //from start of archive
+		uint64_t stored_size = 0; //bytes in the archive
+		uint64_t size = 0; //bytes once decompressed
+		uint64_t hash = 0; //asset_hash() of the decompressed contents
+		uint32_t name_begin = 0; //name is [name_begin,name_end) in the names block
+		uint32_t name_end = 0;
+		uint32_t flags = 0;
+		uint32_t reserved = 0;
+	};
+	static_assert(sizeof(Entry) == 48, "entry is packed");
+
+	//contents of an entry:
+	struct Contents {
+		uint8_t const *data = nullptr;
+		size_t size = 0;
+		std::shared_ptr< std::vector< uint8_t > > decompressed; //owns 'data' for compressed entries (stored entries point into the mapping)
+	};
+
+	//note: will throw if the file can't be opened or its index is malformed
+	AssetArchive(std::string const &filename);
+
+	//look up an entry by name (e.g. "textures/sky_px.png"); returns false if there isn't one:
+	// note: will throw if the entry is corrupt (bad compressed data or hash mismatch); safe to call from any thread
+	bool find(std::string const &name, Contents *contents) const;
+
+	MappedFile file;
+	Header header;
+	Entry const *entries = nullptr;
+	char const *names = nullptr;
+
+	//internals:
+	std::unique_ptr< std::atomic< bool >[] > verified; //has each entry's hash been checked yet?
+};
+
+//64-bit FNV-1a, used for archive content hashes:
+uint64_t asset_hash(void const *data, size_t size);
+
+//the archive at data_path("assets.pack"), mapped the first time this is called (nullptr if there isn't one):
+AssetArchive const *data_archive();
+
+//look up a path returned by data_path() in data_archive(); returns false if it isn't there:
+bool find_data_file(std::string const &path, AssetArchive::Contents *contents);
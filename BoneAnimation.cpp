@@ -1,21 +1,20 @@
 #include "BoneAnimation.hpp"
 
-#include "read_chunk.hpp"
+#include "ChunkFile.hpp"
 #include "gl_errors.hpp"
 
-#include <glm/gtc/type_ptr.hpp>
-
 #include <set>
 #include <fstream>
 #include <algorithm>
+#include <cassert>
+#include <cmath>
 
 BoneAnimation::BoneAnimation(std::string const &filename) {
 	std::cout << "Reading bone-based animation from '" << filename << "'." << std::endl;
 
-	std::ifstream file(filename, std::ios::binary);
+	ChunkFile file(filename);
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	ChunkFile::Span< char > strings = file.read< char >("str0");
 
 	{ //read bones:
 		struct BoneInfo {
@@ -25,8 +24,7 @@ BoneAnimation::BoneAnimation(std::string const &filename) {
 		};
 		static_assert(sizeof(BoneInfo) == 4*2 + 4 + 4*12, "BoneInfo is packed.");
 
-		std::vector< BoneInfo > file_bones;
-		read_chunk(file, "bon0", &file_bones);
+		ChunkFile::Span< BoneInfo > file_bones = file.read< BoneInfo >("bon0");
 		bones.reserve(file_bones.size());
 		for (auto const &file_bone : file_bones) {
 			if (!(file_bone.name_begin <= file_bone.name_end && file_bone.name_end <= strings.size())) {
@@ -37,20 +35,26 @@ BoneAnimation::BoneAnimation(std::string const &filename) {
 			}
 			bones.emplace_back();
 			Bone &bone = bones.back();
-			bone.name = std::string(&strings[0] + file_bone.name_begin, &strings[0] + file_bone.name_end);
+			bone.name = std::string(strings.data() + file_bone.name_begin, strings.data() + file_bone.name_end);
 			bone.parent = file_bone.parent;
 			bone.inverse_bind_matrix = file_bone.inverse_bind_matrix;
 		}
 	}
 
 	static_assert(sizeof(PoseBone) == 3*4 + 4*4 + 3*4, "PoseBone is packed.");
-	read_chunk(file, "frm0", &frame_bones);
-	if (frame_bones.size() % bones.size() != 0) {
-		throw std::runtime_error("frame bones is not divisible by bones");
+	ChunkFile::Span< PoseBone > raw_frames; //(uncompressed frames, if the file has them)
+	uint32_t frames = 0;
+	if (file.next_magic() == "frm0") {
+		raw_frames = file.read< PoseBone >("frm0");
+		if (bones.empty() || raw_frames.size() % bones.size() != 0) {
+			throw std::runtime_error("frame bones is not divisible by bones");
+		}
+		frames = static_cast<uint32_t>(raw_frames.size() / bones.size());
+	} else {
+		tracks.read(file, static_cast<uint32_t>(bones.size()));
+		frames = tracks.frame_count;
 	}
 
-	uint32_t frames = static_cast<uint32_t>(frame_bones.size() / bones.size());
-
 	{ //read actions (animations):
 		struct AnimationInfo {
 			uint32_t name_begin, name_end;
@@ -58,8 +62,7 @@ BoneAnimation::BoneAnimation(std::string const &filename) {
 		};
 		static_assert(sizeof(AnimationInfo) == 4*2 + 4*2, "AnimationInfo is packed.");
 
-		std::vector< AnimationInfo > file_animations;
-		read_chunk(file, "act0", &file_animations);
+		ChunkFile::Span< AnimationInfo > file_animations = file.read< AnimationInfo >("act0");
 		animations.reserve(file_animations.size());
 		for (auto const &file_animation : file_animations) {
 			if (!(file_animation.name_begin <= file_animation.name_end && file_animation.name_end <= strings.size())) {
@@ -70,12 +73,23 @@ BoneAnimation::BoneAnimation(std::string const &filename) {
 			}
 			animations.emplace_back();
 			Animation &animation = animations.back();
-			animation.name = std::string(&strings[0] + file_animation.name_begin, &strings[0] + file_animation.name_end);
+			animation.name = std::string(strings.data() + file_animation.name_begin, strings.data() + file_animation.name_end);
 			animation.begin = file_animation.begin;
 			animation.end = file_animation.end;
 		}
 	}
 
+	if (!raw_frames.empty()) { //compress uncompressed frames (keeping the ends of each animation, so they don't blend together):
+		std::vector< uint32_t > keep;
+		for (auto const &animation : animations) {
+			if (animation.begin == animation.end) continue;
+			keep.emplace_back(animation.begin);
+			keep.emplace_back(animation.end - 1);
+		}
+		//(quietly: this happens on every load of an unconverted file; compress_banim reports sizes)
+		tracks = BoneTracks(raw_frames.data(), static_cast<uint32_t>(bones.size()), frames, keep, BoneTracks::Tolerance());
+	}
+
 	{ //read actual mesh:
 		struct Vertex {
 			glm::vec3 Position;
@@ -87,8 +101,7 @@ BoneAnimation::BoneAnimation(std::string const &filename) {
 		};
 		static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4+4*4+4*4, "Vertex is packed.");
 		//GLAttribBuffer< glm::vec3, glm::vec3, glm::u8vec4, glm::vec2, glm::vec4, glm::uvec4 > buffer;
-		std::vector< Vertex > data;
-		read_chunk(file, "msh0", &data);
+		ChunkFile::Span< Vertex > data = file.read< Vertex >("msh0");
 
 		//check bone indices:
 		for (auto const &vertex : data) {
@@ -194,7 +207,70 @@ GLuint BoneAnimation::make_vao_for_program(GLuint program) const {
 	return vao;
 }
 
-BoneAnimationPlayer::BoneAnimationPlayer(BoneAnimation const &banims_, BoneAnimation::Animation const &anim_, LoopOrOnce loop_or_once_, float speed) : banims(banims_), anim(anim_), loop_or_once(loop_or_once_) {
+BoneAnimation::Animation const *BoneAnimation::find(std::string const &name) const {
+	for (auto const &animation : animations) {
+		if (animation.name == name) return &animation;
+	}
+	return nullptr;
+}
+
+std::vector< float > BoneAnimation::bone_mask(std::string const &root) const {
+	uint32_t r = -1U;
+	for (uint32_t b = 0; b < bones.size(); ++b) {
+		if (bones[b].name == root) r = b;
+	}
+	if (r == -1U) throw std::runtime_error("Bone with name '" + root + "' does not exist.");
+
+	//(parents always come before their children)
+	std::vector< float > mask(bones.size(), 0.0f);
+	for (uint32_t b = r; b < bones.size(); ++b) {
+		if (b == r || (bones[b].parent != -1U && mask[bones[b].parent] != 0.0f)) mask[b] = 1.0f;
+	}
+	return mask;
+}
+
+static BoneAnimation::PoseBone blend(BoneAnimation::PoseBone const &a, BoneAnimation::PoseBone const &b, float amt) {
+	BoneAnimation::PoseBone ret;
+	ret.position = glm::mix(a.position, b.position, amt);
+	ret.rotation = glm::slerp(a.rotation, b.rotation, amt);
+	ret.scale = glm::mix(a.scale, b.scale, amt);
+	return ret;
+}
+
+//local transform for a posed bone:
+static glm::mat4x3 bone_trs(BoneAnimation::PoseBone const &pose_bone) {
+	glm::mat3 r = glm::mat3_cast(pose_bone.rotation);
+	return glm::mat4x3(
+		r[0] * pose_bone.scale.x,
+		r[1] * pose_bone.scale.y,
+		r[2] * pose_bone.scale.z,
+		pose_bone.position
+	);
+}
+
+void BoneAnimation::sample(Animation const &anim, float position, PoseBone *out) const {
+	assert(anim.begin < anim.end);
+	float at = (anim.end - 1 - anim.begin) * std::max(0.0f, std::min(position, 1.0f));
+	tracks.sample(anim.begin + at, out);
+}
+
+void BoneAnimation::compute_palette(PoseBone const *pose, glm::mat4x3 *bone_to_object, glm::mat4x3 *out) const {
+	//(parents always come before their children, so one pass suffices)
+	for (uint32_t b = 0; b < bones.size(); ++b) {
+		PoseBone const &pose_bone = pose[b];
+		Bone const &bone = bones[b];
+
+		if (bone.parent == -1U) {
+			bone_to_object[b] = glm::mat4x3(1.0f); //clear root position
+		} else {
+			bone_to_object[b] = bone_to_object[bone.parent] * glm::mat4(bone_trs(pose_bone));
+		}
+		out[b] = bone_to_object[b] * glm::mat4(bone.inverse_bind_matrix);
+	}
+}
+
+BoneAnimationPlayer::BoneAnimationPlayer(BoneAnimation const &banims_, BoneAnimation::Animation const &anim_, LoopOrOnce loop_or_once_, float speed) : banims(banims_), anim(anim_), loop_or_once(loop_or_once_),
+	pose(banims_.bones.size()), bone_to_object(banims_.bones.size()), bones(banims_.bones.size()) {
 	set_speed(speed);
 }
 
@@ -207,35 +283,163 @@ void BoneAnimationPlayer::update(float elapsed) {
 	}
 }
 
-void BoneAnimationPlayer::set_uniform(GLint bones_mat4x3_array) const {
-	std::vector< glm::mat4x3 > bone_to_object(banims.bones.size()); //needed for hierarchy
-	std::vector< glm::mat4x3 > bones(banims.bones.size()); //actual uniforms
+glm::mat4x3 const *BoneAnimationPlayer::palette() const {
+	if (bones_position != position) {
+		banims.sample(anim, position, pose.data());
+		banims.compute_palette(pose.data(), bone_to_object.data(), bones.data());
+		bones_position = position;
+	}
+	return bones.data();
+}
 
-	int32_t frame = static_cast<int32_t>(std::floor((anim.end - 1 - anim.begin) * position + anim.begin));
-	if (frame < int32_t(anim.begin)) frame = anim.begin;
-	if (frame > int32_t(anim.end)-1) frame = int32_t(anim.end)-1;
-	BoneAnimation::PoseBone const *pose = banims.get_frame(frame);
-	for (uint32_t b = 0; b < bones.size(); ++b) {
-		BoneAnimation::PoseBone const &pose_bone = pose[b];
-		BoneAnimation::Bone const &bone = banims.bones[b];
+//------------------
+
+void BoneAnimationMixer::Track::update(float elapsed) {
+	if (!anim) return;
+	position += elapsed * position_per_second;
+	if (loop_or_once == BoneAnimationPlayer::Loop) {
+		position -= std::floor(position);
+	} else { //(loop_or_once == Once)
+		position = std::max(std::min(position, 1.0f), 0.0f);
+	}
+}
 
-		glm::mat3 r = glm::mat3_cast(pose_bone.rotation);
-		glm::mat3 rs = glm::mat3(
-			r[0] * pose_bone.scale.x,
-			r[1] * pose_bone.scale.y,
-			r[2] * pose_bone.scale.z
-		);
-		glm::mat4x3 trs = glm::mat4x3(
-			rs[0], rs[1], rs[2], pose_bone.position
-		);
+BoneAnimationMixer::BoneAnimationMixer(BoneAnimation const &banims_, uint32_t layer_count) : banims(banims_), layers(layer_count),
+	poses(layer_count * 4 * banims_.bones.size()), bone_to_object(banims_.bones.size()), bones(banims_.bones.size()) {
+	if (layer_count < 1 || layer_count > MaxLayers) {
+		throw std::runtime_error("BoneAnimationMixer supports 1 to " + std::to_string(MaxLayers) + " layers.");
+	}
+	for (auto &layer : layers) {
+		layer.mask.reserve(banims.bones.size()); //(so setting a mask later doesn't need to allocate)
+	}
+}
 
+void BoneAnimationMixer::play(uint32_t l, BoneAnimation::Animation const &anim, BoneAnimationPlayer::LoopOrOnce loop_or_once, float speed, float fade) {
+	Layer &layer = layers.at(l);
+	//(if a crossfade was already underway, whichever animation was more visible is faded out)
+	if (layer.fade >= 0.5f || !layer.previous.anim) layer.previous = layer.current;
+	layer.current.anim = &anim;
+	layer.current.position = 0.0f;
+	layer.current.loop_or_once = loop_or_once;
+	set_speed(l, speed);
+	//(additive layers fade in from nothing; the base layer only fades from another animation)
+	if (fade > 0.0f && (l != 0 || layer.previous.anim)) {
+		layer.fade = 0.0f;
+		layer.fade_per_second = 1.0f / fade;
+	} else {
+		layer.fade = 1.0f;
+	}
+	bones_current = false;
+}
+
+void BoneAnimationMixer::stop(uint32_t l, float fade) {
+	Layer &layer = layers.at(l);
+	assert(l != 0 && "The base layer must always be playing something.");
+	if (!layer.current.anim) return;
+	layer.previous = layer.current;
+	layer.current.anim = nullptr;
+	if (fade > 0.0f) {
+		layer.fade = 0.0f;
+		layer.fade_per_second = 1.0f / fade;
+	} else {
+		layer.fade = 1.0f;
+	}
+	bones_current = false;
+}
+
+void BoneAnimationMixer::set_speed(uint32_t l, float speed, float fps) {
+	Track &track = layers.at(l).current;
+	if (!track.anim) return;
+	if (track.anim->end - track.anim->begin > 1) {
+		track.position_per_second = speed / ((track.anim->end - 1 - track.anim->begin) / fps);
+	} else {
+		track.position_per_second = 0.0f;
+	}
+}
+
+void BoneAnimationMixer::update(float elapsed) {
+	for (auto &layer : layers) {
+		layer.current.update(elapsed);
+		if (layer.fade < 1.0f) {
+			layer.previous.update(elapsed);
+			layer.fade = std::min(1.0f, layer.fade + elapsed * layer.fade_per_second);
+		}
+		//stop additive layers once their animation is over:
+		if (&layer != &layers[0] && layer.current.anim && layer.current.done()) {
+			stop(uint32_t(&layer - &layers[0]));
+		}
+	}
+	bones_current = false;
+}
+
+glm::mat4x3 const *BoneAnimationMixer::palette() const {
+	if (bones_current) return bones.data();
+	assert(layers[0].current.anim && "The base layer must be playing something before posing.");
+
+	//sample each track (and, for additive layers, the first frame it is relative to):
+	uint32_t const count = uint32_t(banims.bones.size());
+	BoneAnimation::PoseBone const *current[MaxLayers] = { nullptr };
+	BoneAnimation::PoseBone const *previous[MaxLayers] = { nullptr };
+	BoneAnimation::PoseBone const *reference[MaxLayers][2] = { { nullptr } };
+	for (uint32_t l = 0; l < layers.size(); ++l) {
+		Layer const &layer = layers[l];
+		BoneAnimation::PoseBone *storage = &poses[l * 4 * count];
+		if (layer.current.anim) {
+			banims.sample(*layer.current.anim, layer.current.position, storage + 0 * count);
+			current[l] = storage + 0 * count;
+			if (l != 0) {
+				banims.sample(*layer.current.anim, 0.0f, storage + 2 * count);
+				reference[l][0] = storage + 2 * count;
+			}
+		}
+		if (layer.fade < 1.0f && layer.previous.anim) {
+			banims.sample(*layer.previous.anim, layer.previous.position, storage + 1 * count);
+			previous[l] = storage + 1 * count;
+			if (l != 0) {
+				banims.sample(*layer.previous.anim, 0.0f, storage + 3 * count);
+				reference[l][1] = storage + 3 * count;
+			}
+		}
+	}
+
+	//pose each bone through all the layers, then build its matrix:
+	for (uint32_t b = 0; b < banims.bones.size(); ++b) {
+		BoneAnimation::Bone const &bone = banims.bones[b];
 		if (bone.parent == -1U) {
-			bone_to_object[b] = trs;
 			bone_to_object[b] = glm::mat4x3(1.0f); //clear root position
-		} else {
-			bone_to_object[b] = bone_to_object[bone.parent] * glm::mat4(trs);
+			bones[b] = bone_to_object[b] * glm::mat4(bone.inverse_bind_matrix);
+			continue;
 		}
+
+		//base layer (crossfaded):
+		Layer const &base = layers[0];
+		BoneAnimation::PoseBone pose = current[0][b];
+		if (previous[0]) {
+			pose = blend(previous[0][b], pose, base.fade);
+		}
+
+		//additive layers (the outgoing track of a crossfade is added with the remaining weight):
+		for (uint32_t l = 1; l < layers.size(); ++l) {
+			Layer const &layer = layers[l];
+			float weight = layer.weight * (layer.mask.empty() ? 1.0f : layer.mask[b]);
+			if (weight == 0.0f) continue;
+			for (uint32_t t = 0; t < 2; ++t) {
+				BoneAnimation::PoseBone const *track = (t == 0 ? current[l] : previous[l]);
+				if (!track) continue;
+				float w = weight * (t == 0 ? layer.fade : 1.0f - layer.fade);
+				if (w == 0.0f) continue;
+				BoneAnimation::PoseBone const &now = track[b];
+				BoneAnimation::PoseBone const &ref = reference[l][t][b];
+				pose.position += w * (now.position - ref.position);
+				pose.rotation = pose.rotation * glm::slerp(glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::inverse(ref.rotation) * now.rotation, w);
+				pose.scale *= glm::mix(glm::vec3(1.0f), now.scale / ref.scale, w);
+			}
+		}
+
+		bone_to_object[b] = bone_to_object[bone.parent] * glm::mat4(bone_trs(pose));
 		bones[b] = bone_to_object[b] * glm::mat4(bone.inverse_bind_matrix);
 	}
-	glUniformMatrix4x3fv(bones_mat4x3_array, static_cast<GLsizei>(bones.size()), GL_FALSE, glm::value_ptr(bones[0]));
+
+	bones_current = true;
+	return bones.data();
 }
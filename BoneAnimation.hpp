@@ -1,6 +1,7 @@
 #pragma once
 
 #include "MeshBuffer.hpp"
+#include "BoneTracks.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -32,17 +33,9 @@ struct BoneAnimation {
 	};
 	std::vector< Bone > bones;
 
-	//Animation poses:
-	struct PoseBone {
-		glm::vec3 position;
-		glm::quat rotation;
-		glm::vec3 scale;
-	};
-	std::vector< PoseBone > frame_bones;
-
-	PoseBone const *get_frame(uint32_t frame) const {
-		return &frame_bones[frame * bones.size()];
-	}
+	//Animation poses (compressed; see BoneTracks.hpp):
+	typedef BoneTracks::PoseBone PoseBone;
+	BoneTracks tracks;
 
 	//Animation index:
 	struct Animation {
@@ -56,11 +49,27 @@ struct BoneAnimation {
 
 	//construct from a file:
 	// note: will throw if file fails to read.
+	// (files with uncompressed frames -- a "frm0" chunk -- are compressed as they load; see compress_banim.cpp)
 	BoneAnimation(std::string const &filename);
 
 	//look up a particular animation, will throw if not found:
 	const Animation &lookup(std::string const &name) const;
 
+	//...or return nullptr if not found:
+	Animation const *find(std::string const &name) const;
+
+	//per-bone weights that are 1.0 for 'root' and its descendants and 0.0 elsewhere (e.g. "Back" for an upper-body layer):
+	// will throw if 'root' isn't a bone
+	std::vector< float > bone_mask(std::string const &root) const;
+
+	//pose evaluation (none of these allocate; 'out' arrays hold bones.size() entries):
+
+	//pose of 'anim' at 'position' (0.0 == first frame, 1.0 == last frame), blending between the nearest two frames:
+	void sample(Animation const &anim, float position, PoseBone *out) const;
+
+	//skinning matrices (bone_to_object * inverse_bind) for a pose; 'bone_to_object' is scratch storage:
+	void compute_palette(PoseBone const *pose, glm::mat4x3 *bone_to_object, glm::mat4x3 *out) const;
+
 	//build a vertex array object that links this vbo to attributes to a program:
 	//  will throw if program defines attributes not contained in this buffer
 	//  and warn if this buffer contains attributes not active in the program
@@ -84,8 +93,66 @@ struct BoneAnimationPlayer {
 
 	void update(float elapsed);
 
-	void set_uniform(GLint bones_mat4x3_array) const;
+	//current skinning matrices; only re-evaluated when 'position' changes, so drawing the
+	// same player in several passes (main view, shadows, ...) only poses it once per frame:
+	glm::mat4x3 const *palette() const;
 
 	bool done() const { return (loop_or_once == Once && position >= 1.0f); }
 
+	//evaluation storage (sized once, at construction):
+	mutable std::vector< BoneAnimation::PoseBone > pose;
+	mutable std::vector< glm::mat4x3 > bone_to_object;
+	mutable std::vector< glm::mat4x3 > bones;
+	mutable float bones_position = -1.0f; //'position' that 'bones' was evaluated at
+
+};
+
+//"BoneAnimationMixer" poses a skeleton from several animations at once:
+// - layer 0 is the base pose; play() crossfades from whatever the layer was playing
+// - higher layers are additive (relative to their animation's first frame), weighted, and optionally masked to some bones
+// - all layers are evaluated together in one pass over the bones; nothing allocates after construction
+struct BoneAnimationMixer {
+	enum : uint32_t { MaxLayers = 4 };
+	BoneAnimationMixer(BoneAnimation const &banims, uint32_t layer_count = 1);
+
+	BoneAnimation const &banims;
+
+	struct Track {
+		BoneAnimation::Animation const *anim = nullptr; //(nullptr for an additive layer that isn't playing)
+		float position = 0.0f; //from 0.0 == beginning to 1.0 == end
+		float position_per_second = 0.0f;
+		BoneAnimationPlayer::LoopOrOnce loop_or_once = BoneAnimationPlayer::Once;
+		void update(float elapsed);
+		bool done() const { return anim == nullptr || (loop_or_once == BoneAnimationPlayer::Once && position >= 1.0f); }
+	};
+
+	struct Layer {
+		Track current;
+		Track previous; //(what is being faded out)
+		float fade = 1.0f; //0.0 == all 'previous', 1.0 == all 'current'
+		float fade_per_second = 0.0f;
+		float weight = 1.0f; //(additive layers only)
+		std::vector< float > mask; //per-bone weights (additive layers only; empty means every bone)
+	};
+	std::vector< Layer > layers;
+
+	//crossfade layer 'layer' to 'anim' over 'fade' seconds (speed as in BoneAnimationPlayer::set_speed):
+	void play(uint32_t layer, BoneAnimation::Animation const &anim, BoneAnimationPlayer::LoopOrOnce loop_or_once, float speed = 1.0f, float fade = 0.2f);
+	//fade an additive layer out over 'fade' seconds:
+	void stop(uint32_t layer, float fade = 0.2f);
+
+	//change the playback speed of a layer's current animation (e.g. to match a diver's velocity):
+	void set_speed(uint32_t layer, float speed, float fps = 24.0f);
+
+	void update(float elapsed);
+
+	//current skinning matrices; only re-evaluated after update() or play(), so drawing the
+	// same diver in several passes (main view, shadows, ...) only poses it once per frame:
+	glm::mat4x3 const *palette() const;
+
+	//evaluation storage (sized once, at construction):
+	mutable std::vector< BoneAnimation::PoseBone > poses; //per layer: current, previous, and their first frames
+	mutable std::vector< glm::mat4x3 > bone_to_object;
+	mutable std::vector< glm::mat4x3 > bones;
+	mutable bool bones_current = false;
 };
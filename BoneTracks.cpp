@@ -0,0 +1,268 @@
+#include "BoneTracks.hpp"
+
+#include "ChunkFile.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <cassert>
+#include <cmath>
+
+//------ quantization ------
+
+static constexpr float Sqrt2 = 1.41421356f;
+
+//smallest three: the largest component is dropped (and made positive, since q == -q),
+// and its index is kept in the top bits of the first two words:
+static glm::u16vec3 encode_rotation(glm::quat const &q_) {
+	glm::quat q = glm::normalize(q_);
+	float c[4] = { q.x, q.y, q.z, q.w };
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; ++i) {
+		if (std::abs(c[i]) > std::abs(c[largest])) largest = i;
+	}
+	float sign = (c[largest] < 0.0f ? -1.0f : 1.0f);
+	uint16_t words[3];
+	for (uint32_t i = 0, w = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		float v = sign * c[i] * Sqrt2; //(the other components are within +/- 1/sqrt(2))
+		words[w++] = uint16_t(std::max(0.0f, std::min(std::round((0.5f * v + 0.5f) * 32767.0f), 32767.0f)));
+	}
+	words[0] |= uint16_t((largest & 1) << 15);
+	words[1] |= uint16_t((largest >> 1) << 15);
+	return glm::u16vec3(words[0], words[1], words[2]);
+}
+
+static glm::quat decode_rotation(glm::u16vec3 const &v) {
+	uint32_t largest = (v.x >> 15) | ((v.y >> 15) << 1);
+	float c[4];
+	float sum = 0.0f;
+	for (uint32_t i = 0, w = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		c[i] = ((v[w++] & 0x7fff) * (2.0f / 32767.0f) - 1.0f) * (1.0f / Sqrt2);
+		sum += c[i] * c[i];
+	}
+	c[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+	return glm::quat(c[3], c[0], c[1], c[2]);
+}
+
+static glm::u16vec3 encode_vec3(BoneTracks::Track const &track, glm::vec3 const &v) {
+	glm::u16vec3 ret;
+	for (uint32_t i = 0; i < 3; ++i) {
+		float q = (track.step[i] > 0.0f ? std::round((v[i] - track.min[i]) / track.step[i]) : 0.0f);
+		ret[i] = uint16_t(std::max(0.0f, std::min(q, 65535.0f)));
+	}
+	return ret;
+}
+
+static glm::vec3 decode_vec3(BoneTracks::Track const &track, glm::u16vec3 const &v) {
+	return track.min + track.step * glm::vec3(v);
+}
+
+//------ compression ------
+
+//difference between two values of a channel (in the units of the matching tolerance):
+static float vec3_error(glm::vec3 const &a, glm::vec3 const &b) {
+	glm::vec3 d = glm::abs(a - b);
+	return std::max(d.x, std::max(d.y, d.z));
+}
+
+//(angle of the rotation between a and b; computed from the chord between them, since acos(dot(a,b)) is imprecise for small angles)
+float rotation_error(glm::quat const &a_, glm::quat const &b_) {
+	glm::quat a = glm::normalize(a_);
+	glm::quat b = glm::normalize(b_);
+	if (glm::dot(a, b) < 0.0f) b = -b;
+	glm::vec4 d = glm::vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+	return 4.0f * std::asin(std::min(1.0f, 0.5f * glm::length(d)));
+}
+
+BoneTracks::BoneTracks(PoseBone const *frames, uint32_t bone_count_, uint32_t frame_count_, std::vector< uint32_t > const &keep, Tolerance const &tolerance) : bone_count(bone_count_), frame_count(frame_count_) {
+	assert(frames || bone_count * frame_count == 0);
+	if (frame_count > 0x10000) throw std::runtime_error("BoneTracks supports at most 65536 frames.");
+
+	std::vector< bool > keep_frame(frame_count, false);
+	for (uint32_t f : keep) {
+		if (f < frame_count) keep_frame[f] = true;
+	}
+	if (frame_count) keep_frame.back() = true;
+
+	tracks.resize(bone_count * Channels);
+
+	//per-frame original and quantized-then-decoded values for the track being compressed:
+	std::vector< glm::vec4 > original(frame_count);
+	std::vector< glm::u16vec3 > quantized(frame_count);
+	std::vector< glm::vec4 > decoded(frame_count);
+
+	for (uint32_t b = 0; b < bone_count; ++b) {
+		for (uint32_t c = 0; c < Channels; ++c) {
+			Track &track = tracks[b * Channels + c];
+
+			float tol = 0.0f;
+			if (c == Rotation) {
+				tol = tolerance.rotation;
+				for (uint32_t f = 0; f < frame_count; ++f) {
+					glm::quat q = frames[f * bone_count + b].rotation;
+					original[f] = glm::vec4(q.x, q.y, q.z, q.w);
+					quantized[f] = encode_rotation(q);
+					glm::quat d = decode_rotation(quantized[f]);
+					decoded[f] = glm::vec4(d.x, d.y, d.z, d.w);
+				}
+			} else {
+				tol = (c == Position ? tolerance.position : tolerance.scale);
+				glm::vec3 min = glm::vec3(std::numeric_limits< float >::infinity());
+				glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+				for (uint32_t f = 0; f < frame_count; ++f) {
+					PoseBone const &pose = frames[f * bone_count + b];
+					glm::vec3 v = (c == Position ? pose.position : pose.scale);
+					original[f] = glm::vec4(v, 0.0f);
+					min = glm::min(min, v);
+					max = glm::max(max, v);
+				}
+				if (frame_count) {
+					track.min = min;
+					track.step = (max - min) / 65535.0f;
+				}
+				for (uint32_t f = 0; f < frame_count; ++f) {
+					quantized[f] = encode_vec3(track, glm::vec3(original[f]));
+					decoded[f] = glm::vec4(decode_vec3(track, quantized[f]), 0.0f);
+				}
+			}
+
+			auto error = [&](glm::vec4 const &value, uint32_t f) {
+				if (c == Rotation) {
+					return rotation_error(glm::quat(value.w, value.x, value.y, value.z), glm::quat(original[f].w, original[f].x, original[f].y, original[f].z));
+				} else {
+					return vec3_error(glm::vec3(value), glm::vec3(original[f]));
+				}
+			};
+			//(interpolation must match sample())
+			auto interpolate = [&](uint32_t a, uint32_t b, uint32_t f) {
+				float amt = float(f - a) / float(b - a);
+				if (c == Rotation) {
+					glm::quat q = glm::slerp(glm::quat(decoded[a].w, decoded[a].x, decoded[a].y, decoded[a].z), glm::quat(decoded[b].w, decoded[b].x, decoded[b].y, decoded[b].z), amt);
+					return glm::vec4(q.x, q.y, q.z, q.w);
+				} else {
+					return glm::mix(decoded[a], decoded[b], amt);
+				}
+			};
+			auto add_key = [&](uint32_t f) {
+				key_frames.emplace_back(uint16_t(f));
+				key_values.emplace_back(quantized[f]);
+				track.count += 1;
+			};
+
+			track.first = uint32_t(key_frames.size());
+			track.count = 0;
+
+			//constant tracks keep just one key:
+			bool constant = true;
+			for (uint32_t f = 0; f < frame_count && constant; ++f) {
+				constant = (error(decoded[0], f) <= tol);
+			}
+			if (constant || frame_count == 1) {
+				add_key(0);
+				continue;
+			}
+
+			//otherwise, greedily extend each segment as long as interpolating it stays within tolerance:
+			uint32_t a = 0;
+			add_key(a);
+			while (a + 1 < frame_count) {
+				uint32_t b = a + 1;
+				while (!keep_frame[b] && b + 1 < frame_count) {
+					bool fits = true;
+					for (uint32_t f = a + 1; f <= b && fits; ++f) {
+						fits = (error(interpolate(a, b + 1, f), f) <= tol);
+					}
+					if (!fits) break;
+					b += 1;
+				}
+				add_key(b);
+				a = b;
+			}
+		}
+	}
+}
+
+//------ sampling ------
+
+void BoneTracks::sample(float frame, PoseBone *out) const {
+	for (uint32_t b = 0; b < bone_count; ++b) {
+		Track const *track = &tracks[b * Channels];
+		for (uint32_t c = 0; c < Channels; ++c, ++track) {
+			//find the keys on either side of 'frame':
+			uint32_t lo = track->first;
+			uint32_t hi = track->first;
+			float amt = 0.0f;
+			if (track->count > 1) {
+				uint16_t const *frames = key_frames.data() + track->first;
+				uint32_t after = uint32_t(std::upper_bound(frames, frames + track->count, frame) - frames);
+				if (after == track->count) {
+					lo = hi = track->first + track->count - 1;
+				} else if (after > 0) {
+					lo = track->first + after - 1;
+					hi = track->first + after;
+					amt = (frame - key_frames[lo]) / float(key_frames[hi] - key_frames[lo]);
+				}
+			}
+
+			if (c == Rotation) {
+				glm::quat r = decode_rotation(key_values[lo]);
+				if (hi != lo) r = glm::slerp(r, decode_rotation(key_values[hi]), amt);
+				out[b].rotation = r;
+			} else {
+				glm::vec3 v = decode_vec3(*track, key_values[lo]);
+				if (hi != lo) v = glm::mix(v, decode_vec3(*track, key_values[hi]), amt);
+				(c == Position ? out[b].position : out[b].scale) = v;
+			}
+		}
+	}
+}
+
+//------ file i/o ------
+
+//chunks:
+// "bth0": frame count (one uint32)
+// "btk0": tracks (bone_count * Channels Track structures)
+// "bkf0": key frame numbers (uint16 each)
+// "bkv0": key values (three uint16 each)
+
+void BoneTracks::read(ChunkFile &file, uint32_t bone_count_) {
+	bone_count = bone_count_;
+
+	ChunkFile::Span< uint32_t > header = file.read< uint32_t >("bth0");
+	if (header.size() != 1) throw std::runtime_error("bone track header is the wrong size");
+	frame_count = header[0];
+
+	ChunkFile::Span< Track > file_tracks = file.read< Track >("btk0");
+	ChunkFile::Span< uint16_t > file_key_frames = file.read< uint16_t >("bkf0");
+	ChunkFile::Span< glm::u16vec3 > file_key_values = file.read< glm::u16vec3 >("bkv0");
+	if (file_tracks.size() != size_t(bone_count) * Channels) {
+		throw std::runtime_error("bone track count doesn't match bone count");
+	}
+	if (file_key_frames.size() != file_key_values.size()) {
+		throw std::runtime_error("bone track key frame and key value counts differ");
+	}
+
+	tracks.assign(file_tracks.begin(), file_tracks.end());
+	key_frames.assign(file_key_frames.begin(), file_key_frames.end());
+	key_values.assign(file_key_values.begin(), file_key_values.end());
+
+	for (auto const &track : tracks) {
+		if (!(track.count >= 1 && track.first <= key_frames.size() && track.count <= key_frames.size() - track.first)) {
+			throw std::runtime_error("bone track has out-of-range keys");
+		}
+		for (uint32_t k = track.first; k < track.first + track.count; ++k) {
+			if (key_frames[k] >= frame_count || (k > track.first && key_frames[k] <= key_frames[k-1])) {
+				throw std::runtime_error("bone track has out-of-order or out-of-range key frames");
+			}
+		}
+	}
+}
+
+void BoneTracks::write(std::ostream &out) const {
+	write_chunk(out, "bth0", &frame_count, sizeof(frame_count));
+	write_chunk(out, "btk0", tracks);
+	write_chunk(out, "bkf0", key_frames);
+	write_chunk(out, "bkv0", key_values);
+}
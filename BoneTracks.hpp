@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct ChunkFile;
+
+//"BoneTracks" stores the frames of a skeleton's animations compressed:
+// - each bone has a position, rotation, and scale track, each a list of keys (frame number + quantized value)
+// - rotations are stored "smallest three" (the three smallest quaternion components, 15 bits each)
+// - positions and scales are stored as 16-bit fractions of the track's range
+// - tracks that never change (within tolerance) keep a single key
+// - frames that interpolating their neighbors reproduces (within tolerance) are dropped
+//
+//A key is 8 bytes, vs. 40 bytes per bone per frame for uncompressed poses.
+//Sampling is done directly from the compressed keys (no decompressed copy is kept).
+
+struct BoneTracks {
+	struct PoseBone {
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+
+	//how far compressed poses may stray from the originals:
+	// (quantization alone is off by up to ~0.0001 radians, so smaller rotation tolerances just keep every frame)
+	struct Tolerance {
+		float position = 0.0005f; //(object units)
+		float rotation = 0.0005f; //(radians)
+		float scale = 0.0005f;
+	};
+
+	BoneTracks() = default;
+
+	//compress 'frame_count' poses of 'bone_count' bones each ('frames' is frame-major);
+	// frames listed in 'keep' (e.g. the first and last frame of each animation) are never dropped,
+	// so animations don't blend into their neighbors:
+	BoneTracks(PoseBone const *frames, uint32_t bone_count, uint32_t frame_count, std::vector< uint32_t > const &keep, Tolerance const &tolerance);
+
+	//read/write the chunks that hold compressed tracks (see write() for the layout):
+	// note: read will throw if the chunks are missing or inconsistent.
+	void read(ChunkFile &file, uint32_t bone_count);
+	void write(std::ostream &out) const;
+
+	//pose of every bone at (possibly fractional) frame 'frame', interpolating between keys:
+	// ('out' holds bone_count entries)
+	void sample(float frame, PoseBone *out) const;
+
+	uint32_t bone_count = 0;
+	uint32_t frame_count = 0;
+
+	//storage:
+	enum Channel : uint32_t { Position = 0, Rotation = 1, Scale = 2, Channels = 3 };
+	struct Track {
+		uint32_t first = 0; //index of first key
+		uint32_t count = 0; //number of keys (always at least one)
+		glm::vec3 min = glm::vec3(0.0f); //(position/scale tracks) decoded value = min + step * key value
+		glm::vec3 step = glm::vec3(0.0f);
+	};
+	static_assert(sizeof(Track) == 4*2 + 4*3*2, "Track is packed.");
+	std::vector< Track > tracks; //bone_count * Channels, bone-major
+
+	std::vector< uint16_t > key_frames; //frame number of each key
+	std::vector< glm::u16vec3 > key_values; //quantized value of each key
+
+	size_t bytes() const {
+		return tracks.size() * sizeof(Track) + key_frames.size() * sizeof(uint16_t) + key_values.size() * sizeof(glm::u16vec3);
+	}
+};
+
+//angle (in radians) of the rotation that takes 'a' to 'b' (as used for Tolerance::rotation):
+float rotation_error(glm::quat const &a, glm::quat const &b);
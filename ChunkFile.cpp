@@ -0,0 +1,85 @@
+#include "ChunkFile.hpp"
+
+#include "AssetArchive.hpp"
+
+#include <iostream>
+#include <ostream>
+#include <cstring>
+
+namespace {
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+}
+
+ChunkFile::ChunkFile(std::string const &filename_) : filename(filename_) {
+	//use the copy in the data archive, if there is one:
+	if (find_data_file(filename, &archived)) {
+		bytes = archived.data;
+		size = archived.size;
+		return;
+	}
+
+	try {
+		file.reset(new MappedFile(filename, MappedFile::Sequential));
+	} catch (std::exception &) {
+		throw std::runtime_error("Failed to open chunk file '" + filename + "'");
+	}
+	bytes = file->bytes;
+	size = file->size;
+}
+
+std::string ChunkFile::next_magic() const {
+	if (size - offset < sizeof(ChunkHeader)) return "";
+	return std::string(reinterpret_cast< char const * >(bytes + offset), 4);
+}
+
+void const *ChunkFile::read_raw(std::string const &magic, size_t element_size, size_t element_align, size_t *count) {
+	assert(count);
+	assert(element_size > 0);
+
+	ChunkHeader header;
+	if (size - offset < sizeof(ChunkHeader)) {
+		throw std::runtime_error("Failed to read chunk header in '" + filename + "'");
+	}
+	std::memcpy(&header, bytes + offset, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		std::cout << "got: " << std::string(header.magic,4) << std::endl;
+		throw std::runtime_error("Unexpected magic number in chunk in '" + filename + "' (expected '" + magic + "')");
+	}
+	offset += sizeof(ChunkHeader);
+
+	if (header.size % element_size != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size in '" + filename + "'");
+	}
+	if (size - offset < header.size) {
+		throw std::runtime_error("Failed to read chunk data in '" + filename + "'");
+	}
+
+	void const *at = bytes + offset;
+	offset += header.size;
+	*count = header.size / element_size;
+
+	if (reinterpret_cast< uintptr_t >(at) % element_align != 0) {
+		//chunk doesn't start on an element boundary (e.g. it follows a string chunk), so copy it somewhere that does:
+		assert(element_align <= alignof(uint64_t));
+		aligned_copies.emplace_back(new uint64_t[(header.size + 7) / 8]);
+		std::memcpy(aligned_copies.back().get(), at, header.size);
+		at = aligned_copies.back().get();
+	}
+
+	return at;
+}
+
+void write_chunk(std::ostream &out, std::string const &magic, void const *data, size_t size) {
+	assert(magic.size() == 4);
+	if (size > 0xffffffff) throw std::runtime_error("Chunk '" + magic + "' is too large to write.");
+	ChunkHeader header;
+	std::memcpy(header.magic, magic.data(), 4);
+	header.size = uint32_t(size);
+	out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	out.write(reinterpret_cast< char const * >(data), size);
+	if (!out) throw std::runtime_error("Failed to write chunk '" + magic + "'.");
+}
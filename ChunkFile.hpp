@@ -0,0 +1,84 @@
+#pragma once
+
+#include "MappedFile.hpp"
+#include "AssetArchive.hpp"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <cassert>
+
+//"ChunkFile" maps a chunk-based asset file (the format read_chunk reads) into memory:
+// - each chunk is an 8-byte header (4-byte magic + 32-bit size) followed by 'size' bytes of data
+// - chunks are read in order and returned as typed read-only spans that point into the mapping
+//   (no per-chunk allocation or copy; only chunks that are misaligned for their type are copied)
+// - spans stay valid as long as the ChunkFile that returned them
+// - files packed into the data archive are read from there instead of opened separately
+//
+//Usage:
+//  ChunkFile file(data_path("level.pnc"));
+//  ChunkFile::Span< Vertex > vertices = file.read< Vertex >("pnc.");
+//  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+struct ChunkFile {
+	//note: will throw if file can't be opened
+	ChunkFile(std::string const &filename);
+	ChunkFile(ChunkFile const &) = delete;
+	ChunkFile &operator=(ChunkFile const &) = delete;
+
+	template< typename T >
+	struct Span {
+		T const *ptr = nullptr;
+		size_t count = 0;
+
+		Span() = default;
+		Span(T const *ptr_, size_t count_) : ptr(ptr_), count(count_) { }
+
+		T const *data() const { return ptr; }
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		T const *begin() const { return ptr; }
+		T const *end() const { return ptr + count; }
+		T const &operator[](size_t i) const { assert(i < count); return ptr[i]; }
+	};
+
+	//read the next chunk, which must have magic number 'magic' and a size that is a multiple of sizeof(T):
+	// note: will throw if the header is truncated or mismatched or the data is truncated.
+	template< typename T >
+	Span< T > read(std::string const &magic) {
+		size_t count = 0;
+		void const *at = read_raw(magic, sizeof(T), alignof(T), &count);
+		return Span< T >(reinterpret_cast< T const * >(at), count);
+	}
+
+	//magic number of the next chunk ("" at end of file):
+	std::string next_magic() const;
+
+	//has every chunk been read?
+	bool at_end() const { return offset == size; }
+
+	std::string filename;
+
+	//internals:
+	uint8_t const *bytes = nullptr; //start of file contents
+	size_t size = 0; //length of file contents
+	size_t offset = 0; //start of next chunk header
+
+	std::unique_ptr< MappedFile > file; //file contents (if not read from the data archive)
+	AssetArchive::Contents archived; //archive contents (if read from the data archive)
+	std::vector< std::unique_ptr< uint64_t[] > > aligned_copies; //storage for chunks that were misaligned in the file
+
+	void const *read_raw(std::string const &magic, size_t element_size, size_t element_align, size_t *count);
+};
+
+//write a chunk in the format ChunkFile reads (for tools that produce chunk files):
+// note: will throw if writing fails.
+void write_chunk(std::ostream &out, std::string const &magic, void const *data, size_t size);
+
+template< typename T >
+void write_chunk(std::ostream &out, std::string const &magic, std::vector< T > const &data) {
+	write_chunk(out, magic, data.data(), data.size() * sizeof(T));
+}
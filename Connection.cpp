@@ -118,8 +118,8 @@ void poll_connections(
 		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), c.send_buffer.size(), MSG_DONTWAIT);
 		#endif 
 		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			//~no problem~, but don't keep trying
-			break;
+			//~no problem~, but don't keep trying (this connection; others may still have room)
+			continue;
 		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
 			if (ret < 0) {
 				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
@@ -221,7 +221,7 @@ Server::Server(std::string const &port) {
 	}
 
 	{ //listen on socket
-		int ret = ::listen(listen_socket, 5);
+		int ret = ::listen(listen_socket, SOMAXCONN); //(deep backlog, so bursts of connections -- e.g., from bot_client -- aren't refused)
 		if (ret < 0) {
 			closesocket(listen_socket);
 			throw std::system_error(errno, std::system_category(), "failed to listen on socket");
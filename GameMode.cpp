@@ -10,7 +10,9 @@
 #include "compile_program.hpp" //helper to compile opengl shader programs
 #include "draw_text.hpp" //helper to... um.. draw text
 #include "check_fb.hpp" //helper for checking currently bound OpenGL framebuffers
+#include "Profiler.hpp" //helper for timing sections of the frame
 #include "vertex_color_program.hpp"
+#include "depth_program.hpp"
 #include "bone_vertex_color_program.hpp"
 #include "load_save_png.hpp"
 
@@ -28,141 +30,98 @@
 #include <array>
 #include <type_traits>
 #include <sstream>
+#include <unordered_set>
+#include <limits>
+#include <algorithm>
+#include <tuple>
 
 glm::vec3 lerp(glm::vec3 start, glm::vec3 end, float t)
 {
     return (1 - t) * start + t * end;
 }
 
-Load<MeshBuffer> meshes(LoadTagDefault, []()
+//Level assets are lazy: LobbyMode prefetches them just before a game starts, GameMode holds them
+// while it runs, and they are unloaded when it ends.
+
+static void delete_vao(GLuint const *vao)
 {
-    return new MeshBuffer(data_path("test_level_complex.pnc"));
-});
+    glDeleteVertexArrays(1, vao);
+    delete vao;
+}
 
-Load<GLuint> meshes_for_vertex_color_program(LoadTagDefault, []()
+static void delete_texture(GLuint const *tex)
 {
-    return new GLuint(meshes->make_vao_for_program(vertex_color_program->program));
-});
+    glDeleteTextures(1, tex);
+    delete tex;
+}
 
-//used for fullscreen passes:
-Load<GLuint> empty_vao(LoadTagDefault, []()
+Load<MeshBuffer> meshes(LoadTagDefault, Load<MeshBuffer>::Lazy("test_level_complex.pnc"), []()
 {
-    GLuint vao = 0;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    glBindVertexArray(0);
-    return new GLuint(vao);
+    return std::unique_ptr<MeshBuffer>(new MeshBuffer(data_path("test_level_complex.pnc"), MeshBuffer::DeferUpload()));
+}, [](std::unique_ptr<MeshBuffer> &decoded) -> MeshBuffer const *
+{
+    note_load_bytes(decoded->pending_size);
+    decoded->upload();
+    return decoded.release();
 });
 
-Load<GLuint> hit_program(LoadTagDefault, []()
+Load<GLuint> underwater_cube_map(LoadTagDefault, Load<GLuint>::Lazy("underwater_cube_map", delete_texture), []()
 {
-    GLuint program = compile_program(
-        //this draws a triangle that covers the entire screen:
-        "#version 330\n"
-        "void main() {\n"
-        "	gl_Position = vec4(4 * (gl_VertexID & 1) - 1,  2 * (gl_VertexID & 2) - 1, 0.0, 1.0);\n"
-        "}\n",
-        //NOTE on reading screen texture:
-        //texelFetch() gives direct pixel access with integer coordinates, but accessing out-of-bounds pixel is undefined:
-        //	vec4 color = texelFetch(tex, ivec2(gl_FragCoord.xy), 0);
-        //texture() requires using [0,1] coordinates, but handles out-of-bounds more gracefully (using wrap settings of underlying texture):
-        //	vec4 color = texture(tex, gl_FragCoord.xy / textureSize(tex,0));
-
-        "#version 330\n"
-        "uniform sampler2D tex;\n"
-        "out vec4 fragColor;\n"
-        "void main() {\n"
-        "	vec2 at = (gl_FragCoord.xy - 0.5 * textureSize(tex, 0)) / textureSize(tex, 0);\n"
-        //make tint amount more near the edges and less in the middle:
-        "	float tint_amt = max(0.0, length(at));\n"
-        "	float blur_amt = 2.0;\n"
-        //pick a vector to move in for blur using function inspired by:
-        //https://stackoverflow.com/questions/12964279/whats-the-origin-of-this-glsl-rand-one-liner
-        "	vec2 ofs = blur_amt * normalize(vec2(\n"
-        "		fract(dot(gl_FragCoord.xy ,vec2(12.9898,78.233))),\n"
-        "		fract(dot(gl_FragCoord.xy ,vec2(96.3869,-27.5796)))\n"
-        "	));\n"
-        //do a four-pixel average to blur:
-        "	vec4 blur =\n"
-        "		+ 0.25 * texture(tex, (gl_FragCoord.xy + vec2(ofs.x,ofs.y)) / textureSize(tex, 0))\n"
-        "		+ 0.25 * texture(tex, (gl_FragCoord.xy + vec2(-ofs.y,ofs.x)) / textureSize(tex, 0))\n"
-        "		+ 0.25 * texture(tex, (gl_FragCoord.xy + vec2(-ofs.x,-ofs.y)) / textureSize(tex, 0))\n"
-        "		+ 0.25 * texture(tex, (gl_FragCoord.xy + vec2(ofs.y,-ofs.x)) / textureSize(tex, 0))\n"
-        "	;\n"
-        "	float tint_col = clamp(1.0 - tint_amt, 0.0, 1.0);\n"
-        "	vec4 tint = vec4(1.0, tint_col, tint_col, 1.0);\n"
-        "	fragColor = vec4(blur.rgb * tint.rgb, 1.0);\n"
-        "}\n"
-    );
-
-    glUseProgram(program);
-
-    glUniform1i(glGetUniformLocation(program, "tex"), 0);
-
-    glUseProgram(0);
+    TextureData faces = decode_cube_map(data_path("textures/underwater_cube_map"));
+    note_load_bytes(faces.total_bytes());
+    return faces;
+}, [](TextureData const &faces)
+{
+    return new GLuint(upload_cube_map(faces));
+});
 
-    return new GLuint(program);
+Load<GLuint> meshes_for_vertex_color_program(LoadTagDefault, Load<GLuint>::Lazy("level vao (vertex color)", delete_vao), []()
+{
+    return new GLuint(meshes->make_vao_for_program(vertex_color_program->program));
 });
 
-Load<GLuint> nohit_program(LoadTagDefault, []()
+Load<GLuint> meshes_for_depth_program(LoadTagDefault, Load<GLuint>::Lazy("level vao (depth)", delete_vao), []()
 {
-    GLuint program = compile_program(
-        //this draws a triangle that covers the entire screen:
-        "#version 330\n"
-        "void main() {\n"
-        "	gl_Position = vec4(4 * (gl_VertexID & 1) - 1,  2 * (gl_VertexID & 2) - 1, 0.0, 1.0);\n"
-        "}\n",
-        //	vec4 color = texture(tex, gl_FragCoord.xy / textureSize(tex,0));
-
-        "#version 330\n"
-        "uniform sampler2D color_tex;\n"
-        "uniform sampler2D depth_tex;\n"
-        "out vec4 fragColor;\n"
-        "void main() {\n"
-        //Depth of field- blur when further away
-        " float depth = texelFetch(depth_tex, ivec2(gl_FragCoord.xy), 0).r;\n"
-        "	float blur_amt = max((depth - 0.99) * 120, 0);\n"
-        //pick a vector to move in for blur using function inspired by:
-        //https://stackoverflow.com/questions/12964279/whats-the-origin-of-this-glsl-rand-one-liner
-        "	vec2 ofs = blur_amt * normalize(vec2(\n"
-        "		fract(dot(gl_FragCoord.xy ,vec2(12.9898,78.233))),\n"
-        "		fract(dot(gl_FragCoord.xy ,vec2(96.3869,-27.5796)))\n"
-        "	));\n"
-        //do a four-pixel average to blur:
-        "	vec4 blur =\n"
-        "		+ 0.25 * texture(color_tex, (gl_FragCoord.xy + vec2(ofs.x,ofs.y)) / textureSize(color_tex, 0))\n"
-        "		+ 0.25 * texture(color_tex, (gl_FragCoord.xy + vec2(-ofs.y,ofs.x)) / textureSize(color_tex, 0))\n"
-        "		+ 0.25 * texture(color_tex, (gl_FragCoord.xy + vec2(-ofs.x,-ofs.y)) / textureSize(color_tex, 0))\n"
-        "		+ 0.25 * texture(color_tex, (gl_FragCoord.xy + vec2(ofs.y,-ofs.x)) / textureSize(color_tex, 0))\n"
-        "	;\n"
-
-        //Vignette effect (darken around edges)
-        "	vec2 at = (gl_FragCoord.xy - 0.5 * textureSize(color_tex, 0)) / textureSize(color_tex, 0);\n"
-        "	float tint_amt = length(at) * 0.6;\n"
-        " if (depth < 0.58) tint_amt = 0;\n" //don't vignette text
-        "	float tint_col = clamp(1.0 - tint_amt, 0.0, 1.0);\n"
-        "	vec4 tint = vec4(tint_col, tint_col, tint_col, 1.0);\n"
-        "	fragColor = vec4(blur.rgb * tint.rgb, 1.0);\n"
-        //"	fragColor = vec4(0.1, blur_amt, 0.1, 1.0);\n" //sonar mode
-        "}\n"
-    );
-
-    glUseProgram(program);
-
-    glUniform1i(glGetUniformLocation(program, "color_tex"), 0);
-    glUniform1i(glGetUniformLocation(program, "depth_tex"), 1);
+    return new GLuint(meshes->make_vao_for_program(depth_program->program));
+});
 
-    glUseProgram(0);
+Load<BoneAnimation> player_banims(LoadTagDefault, Load<BoneAnimation>::Lazy("test_level_complex.banim"), []()
+{
+    return new BoneAnimation(data_path("test_level_complex.banim"));
+});
 
-    return new GLuint(program);
+Load<GLuint> player_banims_for_bone_vertex_color_program(LoadTagDefault, Load<GLuint>::Lazy("diver vao (bone vertex color)", delete_vao), []()
+{
+    return new GLuint(player_banims->make_vao_for_program(bone_vertex_color_program->program));
 });
 
+//diver clips (looked up when a game starts; clips missing from the file fall back to 'swim'):
+static struct
+{
+    BoneAnimation::Animation const *swim = nullptr;
+    BoneAnimation::Animation const *idle = nullptr;
+    BoneAnimation::Animation const *stunned = nullptr;
+    BoneAnimation::Animation const *shoot = nullptr; //(nullptr if missing; the upper-body layer just stays off)
+} diver_clips;
+
+//suit colors of the two teams' static diver meshes (the skinned mesh is recolored to match):
+static const glm::vec3 team_suit_colors[GameState::num_teams] = {
+    glm::vec3(255.0f, 64.0f, 125.0f) / 255.0f,
+    glm::vec3(13.0f, 27.0f, 88.0f) / 255.0f,
+};
+
 static Scene::Lamp *sun = nullptr;
 
 static Scene::Camera *camera = nullptr;
 
 static Scene::Object::ProgramInfo *vertex_color_program_info = nullptr;
 
+static Scene::Object::ProgramInfo *depth_program_info = nullptr;
+
+//world-space bounds of the level geometry (used to fit the static shadow map):
+static glm::vec3 level_min = glm::vec3(std::numeric_limits<float>::infinity());
+static glm::vec3 level_max = glm::vec3(-std::numeric_limits<float>::infinity());
+
 static std::string gun_mesh_name;
 
 static std::string harpoon_mesh_name;
@@ -177,26 +136,60 @@ static std::array<Scene::Transform *, 2> treasures_transform;
 
 static Scene *current_scene = nullptr;
 
+//copy a mesh's reduced-detail ranges and bounds into an object, so Scene::update_lods can pick among them:
+static void set_object_lods(Scene::Object *obj, MeshBuffer::Mesh const &mesh)
+{
+    obj->bounds_center = 0.5f * (mesh.min + mesh.max);
+    obj->bounds_radius = 0.5f * glm::length(mesh.max - mesh.min);
+    obj->lod_count = std::min< uint32_t >(uint32_t(mesh.lods.size()), Scene::Object::MaxLODs);
+    obj->lod = 0;
+    for (uint32_t i = 0; i < obj->lod_count; ++i) {
+        obj->lods[i].start = mesh.lods[i].start;
+        obj->lods[i].count = mesh.lods[i].count;
+        obj->lods[i].screen_size = mesh.lods[i].screen_size;
+    }
+}
+
+//(samples need no OpenGL, so they are decoded entirely on loader threads)
+//(the music loop is streamed, so only a few mix periods of it are ever decoded at once)
 Load<Sound::Sample> sound_loop(LoadTagDefault, []()
 {
-    return new Sound::Sample(data_path("loop.wav"));
-});
+    std::unique_ptr<Sound::Sample> sample(new Sound::Sample(data_path("loop.wav"), Sound::Sample::Streamed));
+    //(one copy of the music, which is never culled in favor of effects)
+    sample->max_voices = 1;
+    sample->replace_oldest = false;
+    sample->priority = 10;
+    return sample;
+}, load_decoded<Sound::Sample>);
 
 Load<Sound::Sample> sound_shoot(LoadTagDefault, []()
 {
-  return new Sound::Sample(data_path("sfx/shoot.wav"));
-});
+    std::unique_ptr<Sound::Sample> sample(new Sound::Sample(data_path("sfx/shoot.wav")));
+    sample->max_voices = 4;
+    return sample;
+}, load_decoded<Sound::Sample>);
 
 Load<Sound::Sample> sound_swim(LoadTagDefault, []()
 {
-  return new Sound::Sample(data_path("sfx/swim.wav"));
-});
+    std::unique_ptr<Sound::Sample> sample(new Sound::Sample(data_path("sfx/swim.wav")));
+    //(only the newest swim loop is kept in swim_sound, so older ones can go)
+    sample->max_voices = 1;
+    return sample;
+}, load_decoded<Sound::Sample>);
 
-Load<Scene> scene(LoadTagDefault, []()
+Load<Scene> scene(LoadTagDefault, Load<Scene>::Lazy("test_level_complex.scene"), []()
 {
     Scene *ret = new Scene;
     current_scene = ret;
 
+    //(the scene may be loaded again for a later game, so clear anything left from last time)
+    sun = nullptr;
+    camera = nullptr;
+    level_min = glm::vec3(std::numeric_limits<float>::infinity());
+    level_max = glm::vec3(-std::numeric_limits<float>::infinity());
+    delete vertex_color_program_info;
+    delete depth_program_info;
+
     //pre-build some program info (material) blocks to assign to each object:
     vertex_color_program_info = new Scene::Object::ProgramInfo;
     vertex_color_program_info->program = vertex_color_program->program;
@@ -205,6 +198,11 @@ Load<Scene> scene(LoadTagDefault, []()
     vertex_color_program_info->mv_mat4 = vertex_color_program->object_to_light_mat4;
     vertex_color_program_info->itmv_mat3 = vertex_color_program->normal_to_light_mat3;
 
+    depth_program_info = new Scene::Object::ProgramInfo;
+    depth_program_info->program = depth_program->program;
+    depth_program_info->vao = *meshes_for_depth_program;
+    depth_program_info->mvp_mat4 = depth_program->object_to_clip_mat4;
+
     //load transform hierarchy:
     ret->load(data_path("test_level_complex.scene"), [&](Scene &s, Scene::Transform *t, std::string const &m)
     {
@@ -242,8 +240,21 @@ Load<Scene> scene(LoadTagDefault, []()
         obj->programs[Scene::Object::ProgramTypeDefault].start = mesh.start;
         obj->programs[Scene::Object::ProgramTypeDefault].count = mesh.count;
 
+        obj->programs[Scene::Object::ProgramTypeShadow] = *depth_program_info;
         obj->programs[Scene::Object::ProgramTypeShadow].start = mesh.start;
         obj->programs[Scene::Object::ProgramTypeShadow].count = mesh.count;
+        set_object_lods(obj, mesh);
+
+        //grow level bounds by the mesh's (transformed) bounding box:
+        glm::mat4 to_world = t->make_local_to_world();
+        for (uint32_t c = 0; c < 8; ++c) {
+            glm::vec3 corner = glm::vec3((c & 1 ? mesh.max.x : mesh.min.x),
+                                         (c & 2 ? mesh.max.y : mesh.min.y),
+                                         (c & 4 ? mesh.max.z : mesh.min.z));
+            glm::vec3 at = glm::vec3(to_world * glm::vec4(corner, 1.0f));
+            level_min = glm::min(level_min, at);
+            level_max = glm::max(level_max, at);
+        }
     });
 
     //look up the camera:
@@ -277,6 +288,11 @@ Load<Scene> scene(LoadTagDefault, []()
         }
     }
 
+    note_load_bytes(ret->transforms.capacity() * sizeof(Scene::Transform)
+                    + ret->objects.capacity() * sizeof(Scene::Object)
+                    + ret->lamps.capacity() * sizeof(Scene::Lamp)
+                    + ret->cameras.capacity() * sizeof(Scene::Camera));
+
     return ret;
 });
 
@@ -316,30 +332,16 @@ void GameMode::spawn_player(uint32_t id, int team, std::string nickname)
         player_obj->programs[Scene::Object::ProgramTypeDefault].start = mesh.start;
         player_obj->programs[Scene::Object::ProgramTypeDefault].count = mesh.count;
 
+        player_obj->programs[Scene::Object::ProgramTypeShadow] = *depth_program_info;
         player_obj->programs[Scene::Object::ProgramTypeShadow].start = mesh.start;
         player_obj->programs[Scene::Object::ProgramTypeShadow].count = mesh.count;
-        // Scene::Object::ProgramInfo player_anim_info;
-		// player_anim_info.program = bone_vertex_color_program->program;
-		// player_anim_info.vao = *player_banims_for_bone_vertex_color_program;
-		// player_anim_info.start = player_banims->mesh.start;
-		// player_anim_info.count = player_banims->mesh.count;
-		// player_anim_info.mvp_mat4 = bone_vertex_color_program->object_to_clip_mat4;
-		// player_anim_info.mv_mat4x3 = bone_vertex_color_program->object_to_light_mat4x3;
-		// player_anim_info.itmv_mat3 = bone_vertex_color_program->normal_to_light_mat3;
-
-		// player_animations.insert(std::make_pair(id, BoneAnimationPlayer(*player_banims, 
-        //         *player_banim_swim, BoneAnimationPlayer::Loop, 0.0f)));
-
-		// BoneAnimationPlayer *player_anim_player = &player_animations.at(id);
-	
-		// player_anim_info.set_uniforms = [player_anim_player](){
-		// 	player_anim_player->set_uniform(bone_vertex_color_program->bones_mat4x3_array);
-		// };
-        
-        // // from orig:
-        // Scene::Object *player_obj = current_scene->new_object(players_transform[id]);
-
-        // player_obj->programs[Scene::Object::ProgramTypeDefault] = player_anim_info;
+        set_object_lods(player_obj, mesh);
+
+        //the diver itself is drawn skinned, by diver_batch, so the scene only draws its shadow (with the static mesh):
+        player_obj->programs[Scene::Object::ProgramTypeDefault].program = 0;
+        player_animations.emplace(std::piecewise_construct,
+                                  std::forward_as_tuple(id),
+                                  std::forward_as_tuple(*player_banims));
     }
 
     {
@@ -354,6 +356,7 @@ void GameMode::spawn_player(uint32_t id, int team, std::string nickname)
         MeshBuffer::Mesh const &mesh = meshes->lookup(gun_mesh_name);
         gun_obj->programs[Scene::Object::ProgramTypeDefault].start = mesh.start;
         gun_obj->programs[Scene::Object::ProgramTypeDefault].count = mesh.count;
+        gun_obj->programs[Scene::Object::ProgramTypeShadow] = *depth_program_info;
         gun_obj->programs[Scene::Object::ProgramTypeShadow].start = mesh.start;
         gun_obj->programs[Scene::Object::ProgramTypeShadow].count = mesh.count;
     }
@@ -371,21 +374,108 @@ void GameMode::spawn_player(uint32_t id, int team, std::string nickname)
         harpoon_obj->programs[Scene::Object::ProgramTypeDefault].start = mesh.start;
         harpoon_obj->programs[Scene::Object::ProgramTypeDefault].count = mesh.count;
 
+        harpoon_obj->programs[Scene::Object::ProgramTypeShadow] = *depth_program_info;
         harpoon_obj->programs[Scene::Object::ProgramTypeShadow].start = mesh.start;
         harpoon_obj->programs[Scene::Object::ProgramTypeShadow].count = mesh.count;
     }
 }
 
+//vertex_color_program and bone_vertex_color_program share their lighting uniforms:
+template< typename Program >
+static void set_light_colors(Program const &program)
+{
+    glUseProgram(program.program);
+    glUniform3fv(program.sun_color_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 1.0f)));
+    glUniform3fv(program.sky_color_vec3, 1, glm::value_ptr(glm::vec3(0.2, 0.2, 0.3)));
+    glUniform3fv(program.sky_direction_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 1.0f, 0.0f)));
+    glUseProgram(0);
+}
+
+template< typename Program >
+static void set_lighting(Program const &program, glm::vec3 const &view_pos, SunShadow const &sun_shadow, glm::vec3 const &sun_direction)
+{
+    glUseProgram(program.program);
+    glUniform3fv(program.view_pos_vec3, 1, glm::value_ptr(view_pos));
+    glUniformMatrix4fv(program.world_to_static_shadow_mat4, 1, GL_FALSE, glm::value_ptr(sun_shadow.world_to_static_shadow));
+    glUniformMatrix4fv(program.world_to_dynamic_shadow_mat4, 1, GL_FALSE, glm::value_ptr(sun_shadow.world_to_dynamic_shadow));
+    glUniform3fv(program.sun_direction_vec3, 1, glm::value_ptr(sun_direction));
+    glUseProgram(0);
+}
+
+GameMode::DiverAnimation::DiverAnimation(BoneAnimation const &banims) : mixer(banims, 2)
+{
+    mixer.layers[1].mask = banims.bone_mask("Back"); //(upper body)
+    mixer.play(0, *diver_clips.swim, BoneAnimationPlayer::Loop, 1.0f, 0.0f);
+}
+
+//pick a diver's clips from its state (called every frame; only touches the mixer when something changes):
+static void update_diver_animation(GameMode::DiverAnimation &anim, Player const &player, Harpoon const &harpoon, float elapsed)
+{
+    typedef GameMode::DiverAnimation DiverAnimation;
+    float speed = glm::length(player.velocity) / GameState::default_player_speed;
+    DiverAnimation::State state = DiverAnimation::Swim;
+    if (player.is_shot) state = DiverAnimation::Stunned;
+    else if (speed < 0.1f) state = DiverAnimation::Idle;
+
+    if (state != anim.state) {
+        anim.state = state;
+        if (state == DiverAnimation::Stunned) {
+            anim.mixer.play(0, *diver_clips.stunned, BoneAnimationPlayer::Loop, 1.0f, 0.15f);
+        } else if (state == DiverAnimation::Idle) {
+            anim.mixer.play(0, *diver_clips.idle, BoneAnimationPlayer::Loop, 1.0f, 0.4f);
+        } else {
+            anim.mixer.play(0, *diver_clips.swim, BoneAnimationPlayer::Loop, 1.0f, 0.25f);
+        }
+    }
+    //(kick faster when swimming faster; stand-in clips play slowly, or freeze when stunned)
+    if (state == DiverAnimation::Swim) {
+        anim.mixer.set_speed(0, std::max(0.25f, std::min(speed, 1.5f)));
+    } else if (state == DiverAnimation::Idle && diver_clips.idle == diver_clips.swim) {
+        anim.mixer.set_speed(0, 0.25f);
+    } else if (state == DiverAnimation::Stunned && diver_clips.stunned == diver_clips.swim) {
+        anim.mixer.set_speed(0, 0.0f);
+    }
+
+    //harpoon went from held to firing:
+    if (harpoon.state == 1 && anim.harpoon_state == 0 && diver_clips.shoot) {
+        anim.mixer.play(1, *diver_clips.shoot, BoneAnimationPlayer::Once, 1.0f, 0.1f);
+    }
+    anim.harpoon_state = harpoon.state;
+
+    anim.mixer.update(elapsed);
+}
+
 GameMode::GameMode(Client &client_,
                    int pid,
                    int player_count,
                    std::vector<int> player_teams,
                    std::vector<std::string> nicknames)
-    : underwater_skybox("textures/underwater_cube_map"), client(client_)
+    : underwater_skybox(*underwater_cube_map), client(client_)
 {
+    //hold level assets for as long as this game runs (LobbyMode usually prefetched them already):
+    meshes.acquire();
+    meshes_for_vertex_color_program.acquire();
+    meshes_for_depth_program.acquire();
+    underwater_cube_map.acquire();
+    scene.acquire();
+    player_banims.acquire();
+    player_banims_for_bone_vertex_color_program.acquire();
+
+    diver_clips.swim = &player_banims->lookup("Swim");
+    diver_clips.idle = player_banims->find("Idle");
+    if (!diver_clips.idle) diver_clips.idle = diver_clips.swim;
+    diver_clips.stunned = player_banims->find("Stunned");
+    if (!diver_clips.stunned) diver_clips.stunned = diver_clips.swim;
+    diver_clips.shoot = player_banims->find("Shoot");
+    diver_batch.reset(new SkinnedBatch(*player_banims, *player_banims_for_bone_vertex_color_program));
+
     player_id = pid;
     state.player_count = player_count;
 
+    //each player adds a diver, gun, and harpoon (transform + object each):
+    current_scene->reserve(current_scene->transforms.size() + 3 * player_count,
+                           current_scene->objects.size() + 3 * player_count);
+
     spawn_player(player_id, player_teams[player_id], nicknames[player_id]); //spawn ourselves first
     for (int i = 0; i < state.player_count; i++) {
         if (i != player_id) {
@@ -404,19 +494,42 @@ GameMode::GameMode(Client &client_,
     treasures_transform[0]->position = state.treasures[0].position;
     treasures_transform[1]->position = state.treasures[1].position;
 
+    // sort shadow casters: anything attached to a player, gun, harpoon, or treasure moves every frame
+    {
+        std::unordered_set<Scene::Transform const *> moving(treasures_transform.begin(), treasures_transform.end());
+        for (auto const &pair : players_transform) moving.insert(pair.second);
+        for (auto const &pair : guns_transform) moving.insert(pair.second);
+        for (auto const &pair : harpoons_transform) moving.insert(pair.second);
+
+        for (Scene::Object const &obj : current_scene->objects) {
+            bool is_moving = false;
+            for (Scene::Transform const *t = obj.transform; t != nullptr && !is_moving; t = t->parent) {
+                is_moving = (moving.count(t) != 0);
+            }
+            if (is_moving) sun_shadow.dynamic_casters.emplace_back(&obj);
+            else sun_shadow.static_casters.emplace_back(&obj);
+        }
+        sun_shadow.set_static_bounds(level_min, level_max);
+    }
+
     // OpenGL setup
     //set up light position + color:
-    glUseProgram(vertex_color_program->program);
-    glUniform3fv(vertex_color_program->sun_color_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 1.0f)));
-    glUniform3fv(vertex_color_program->sun_direction_vec3, 1,
-                 glm::value_ptr(glm::normalize(glm::vec3(-0.2f, 0.2f, 1.0f))));
-    glUniform3fv(vertex_color_program->sky_color_vec3, 1, glm::value_ptr(glm::vec3(0.2, 0.2, 0.3)));
-    glUniform3fv(vertex_color_program->sky_direction_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 1.0f, 0.0f)));
-    glUseProgram(0);
+    set_light_colors(*vertex_color_program);
+    set_light_colors(*bone_vertex_color_program);
 }
 
 GameMode::~GameMode()
 {
+    diver_batch.reset();
+
+    //release level assets (they are unloaded once nothing else holds them):
+    player_banims_for_bone_vertex_color_program.release();
+    player_banims.release();
+    scene.release();
+    underwater_cube_map.release();
+    meshes_for_depth_program.release();
+    meshes_for_vertex_color_program.release();
+    meshes.release();
 }
 
 bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
@@ -447,6 +560,44 @@ bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
             controls.grab = (evt.type == SDL_KEYDOWN);
             return true;
         }
+        // post-processing quality toggles
+        else if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_F2) {
+            post.settings.depth_of_field = PostProcess::Quality((post.settings.depth_of_field + 1) % PostProcess::QualityCount);
+            std::cout << "Depth of field: " << PostProcess::quality_name(post.settings.depth_of_field) << std::endl;
+            return true;
+        }
+        else if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_F3) {
+            post.settings.hit_blur = PostProcess::Quality((post.settings.hit_blur + 1) % PostProcess::QualityCount);
+            std::cout << "Hit blur: " << PostProcess::quality_name(post.settings.hit_blur) << std::endl;
+            return true;
+        }
+        else if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_F4) {
+            post.settings.vignette = !post.settings.vignette;
+            std::cout << "Vignette: " << (post.settings.vignette ? "on" : "off") << std::endl;
+            return true;
+        }
+        else if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_F8) {
+            post.settings.hit_tint = !post.settings.hit_tint;
+            std::cout << "Hit tint: " << (post.settings.hit_tint ? "on" : "off") << std::endl;
+            return true;
+        }
+        // profiler overlay + csv logging
+        else if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_F5) {
+            Profiler::enabled = !Profiler::enabled;
+            return true;
+        }
+        else if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_F6) {
+            static bool logging = false;
+            logging = !logging;
+            if (logging) Profiler::enabled = true;
+            Profiler::log_csv(logging ? "profile.csv" : "");
+            std::cout << (logging ? "Logging frame timings to profile.csv" : "Stopped logging frame timings") << std::endl;
+            return true;
+        }
+        else if (evt.type == SDL_KEYDOWN && evt.key.keysym.scancode == SDL_SCANCODE_F7) {
+            print_load_report(std::cout);
+            return true;
+        }
     }
 
     //handle tracking the mouse for rotation control:
@@ -533,82 +684,64 @@ void GameMode::poll_server()
                         while (!(c->recv_buffer.empty())) {
                             assert(event == Connection::OnRecv);
                             assert(c->recv_buffer[0] == 's');
-                            size_t packet_len = 1 + 1 * sizeof(bool) + 2 * sizeof(uint32_t)
-                                + (state.player_count * 20 + 6) * sizeof(float)
-                                + (state.player_count + 2) * sizeof(int);
+                            //(packets hold only the players relevant to us -- see Interest.hpp -- so every one is applied, in order)
+                            uint32_t size = 0;
+                            if (c->recv_buffer.size() < 1 + sizeof(uint32_t)) {
+                                return; //wait for more data
+                            }
+                            memcpy(&size, c->recv_buffer.data() + 1, sizeof(uint32_t));
+                            size_t packet_len = 1 + sizeof(uint32_t) + size;
                             if (c->recv_buffer.size() < packet_len) {
                                 return; //wait for more data
                             }
                             else {
-                                //if buffer length is more than twice the length of a full update, skip all but the last one
-                                while (c->recv_buffer.size() >= 2 * packet_len) {
-                                    c->recv_buffer
-                                        .erase(c->recv_buffer.begin(), c->recv_buffer.begin() + packet_len);
-                                }
+                                char const *data = c->recv_buffer.data() + 1 + sizeof(uint32_t);
 
                                 // update if the player if shot
-                                memcpy(&get_own_player().is_shot, c->recv_buffer.data() + 1, sizeof(bool));
+                                memcpy(&get_own_player().is_shot, data, sizeof(bool));
+                                data += sizeof(bool);
 
                                 // update current game points
-                                memcpy(&state.current_points,
-                                       c->recv_buffer.data() + 1 + 1 * sizeof(bool),
-                                       2 * sizeof(uint32_t));
-
-                                // update the players and the harpoons
-                                for (int i = 0; i < state.player_count; i++) {
-                                    //TODO: don't update position if it's self and close enough?
-                                    memcpy(&state.players[i].position,
-                                           c->recv_buffer.data() + 1 + 1 * sizeof(bool) + 2 * sizeof(uint32_t)
-                                               + (i * 20 + 0) * sizeof(float) + (i + 0) * sizeof(int),
-                                           sizeof(glm::vec3));
-                                    memcpy(&state.players[i].velocity,
-                                           c->recv_buffer.data() + 1 + 1 * sizeof(bool) + 2 * sizeof(uint32_t)
-                                               + (i * 20 + 3) * sizeof(float) + (i + 0) * sizeof(int),
-                                           sizeof(glm::vec3));
-
-                                    // only update player rotation if it's another player
-                                    if (player_id != i) {
-                                        memcpy(&state.players[i].rotation,
-                                               c->recv_buffer.data() + 1 + 1 * sizeof(bool) + 2 * sizeof(uint32_t)
-                                                   + (i * 20 + 6) * sizeof(float) + (i + 0) * sizeof(int),
-                                               sizeof(glm::quat));
+                                memcpy(&state.current_points, data, 2 * sizeof(uint32_t));
+                                data += 2 * sizeof(uint32_t);
+
+                                // update the (relevant) players and their harpoons
+                                uint32_t count = 0;
+                                memcpy(&count, data, sizeof(uint32_t));
+                                data += sizeof(uint32_t);
+                                for (uint32_t e = 0; e < count; e++) {
+                                    uint32_t i = 0;
+                                    memcpy(&i, data, sizeof(uint32_t));
+                                    data += sizeof(uint32_t);
+                                    if (state.players.count(i) && state.harpoons.count(i)) {
+                                        //TODO: don't update position if it's self and close enough?
+                                        memcpy(&state.players[i].position, data + 0 * sizeof(float), sizeof(glm::vec3));
+                                        memcpy(&state.players[i].velocity, data + 3 * sizeof(float), sizeof(glm::vec3));
+
+                                        // only update player rotation if it's another player
+                                        if (player_id != i) {
+                                            memcpy(&state.players[i].rotation, data + 6 * sizeof(float), sizeof(glm::quat));
+                                        }
+
+                                        memcpy(&state.harpoons[i].state, data + 10 * sizeof(float), sizeof(int));
+                                        memcpy(&state.harpoons[i].position, data + 10 * sizeof(float) + sizeof(int), sizeof(glm::vec3));
+                                        memcpy(&state.harpoons[i].velocity, data + 13 * sizeof(float) + sizeof(int), sizeof(glm::vec3));
+                                        memcpy(&state.harpoons[i].rotation, data + 16 * sizeof(float) + sizeof(int), sizeof(glm::quat));
                                     }
-
-                                    memcpy(&state.harpoons[i].state,
-                                           c->recv_buffer.data() + 1 + 1 * sizeof(bool) + 2 * sizeof(uint32_t)
-                                               + (i * 20 + 10) * sizeof(float) + (i + 0) * sizeof(int),
-                                           sizeof(int));
-                                    memcpy(&state.harpoons[i].position,
-                                           c->recv_buffer.data() + 1 + 1 * sizeof(bool) + 2 * sizeof(uint32_t)
-                                               + (i * 20 + 10) * sizeof(float) + (i + 1) * sizeof(int),
-                                           sizeof(glm::vec3));
-                                    memcpy(&state.harpoons[i].velocity,
-                                           c->recv_buffer.data() + 1 + 1 * sizeof(bool) + 2 * sizeof(uint32_t)
-                                               + (i * 20 + 13) * sizeof(float) + (i + 1) * sizeof(int),
-                                           sizeof(glm::vec3));
-                                    memcpy(&state.harpoons[i].rotation,
-                                           c->recv_buffer.data() + 1 + 1 * sizeof(bool) + 2 * sizeof(uint32_t)
-                                               + (i * 20 + 16) * sizeof(float) + (i + 1) * sizeof(int),
-                                           sizeof(glm::quat));
+                                    data += 20 * sizeof(float) + sizeof(int);
                                 }
+
                                 // update treasure pos and state
                                 for (int j = 0; j < 2; j++) {
-                                    memcpy(&state.treasures[j].position,
-                                           c->recv_buffer.data() + 1 + sizeof(bool) + 2 * sizeof(uint32_t)
-                                               + (state.player_count * 20 + j * 3 + 0) * sizeof(float)
-                                               + (j + state.player_count) * sizeof(int),
-                                           sizeof(glm::vec3));
-                                    memcpy(&state.treasures[j].held_by,
-                                           c->recv_buffer.data() + 1 + sizeof(bool) + 2 * sizeof(uint32_t)
-                                               + (state.player_count * 20 + j * 3 + 3) * sizeof(float)
-                                               + (j + state.player_count) * sizeof(int),
-                                           sizeof(int));
+                                    memcpy(&state.treasures[j].position, data, sizeof(glm::vec3));
+                                    memcpy(&state.treasures[j].held_by, data + 3 * sizeof(float), sizeof(int));
+                                    data += 3 * sizeof(float) + sizeof(int);
                                 }
 
-                                //1 for 's' char
-                                //1 bool for is_shot
-                                //player_count * 20 floats for pos(3), vel(3), rot(4), harpoon pos(3), harpoon vel(3), harpoon rotation(4), plus 6 for two treasure pos(3)
-                                //player_count ints for harpoon states, plus 2 for two treasure held_by
+                                //1 for 's' char, 1 uint32 for the size of the rest
+                                //1 bool for is_shot, 2 uint32s for points
+                                //1 uint32 count, then count * (uint32 id, 20 floats for pos(3), vel(3), rot(4), harpoon pos(3), harpoon vel(3), harpoon rotation(4), 1 int for harpoon state)
+                                //2 * (3 floats for treasure pos, 1 int for held_by)
                                 c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + packet_len);
 
                                 // set flag once player has recieved first info from the server
@@ -722,23 +855,10 @@ void GameMode::update(float elapsed)
         }
     }
 
-    // {
-
-	// 	// if (controls.back) step -= elapsed * 1.0f;
-    //     for (auto it = player_animations.begin(); it != player_animations.end(); it++){
-    //         uint32_t id = it->first;
-    //         if (id != player_id){
-    //             float vel = glm::length(state.players[id].velocity);
-    //             // std::cout<<glm::to_string(vel)<<std::endl;
-    //             it->second.position -= vel / 100.0f;
-    //             it->second.position -= std::floor(it->second.position);
-    //         }
-    //     }
-	// }
-
-    // for (auto &anim : player_animations) {
-	// 	anim.second.update(elapsed);
-    // }
+    //animate other divers:
+    for (auto &pair : player_animations) {
+        update_diver_animation(pair.second, state.players.at(pair.first), state.harpoons.at(pair.first), elapsed);
+    }
 
 }
 
@@ -825,8 +945,9 @@ struct Framebuffers
             if (color_tex == 0) glGenTextures(1, &color_tex);
             glBindTexture(GL_TEXTURE_2D, color_tex);
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x, size.y, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            //(linear so post-processing can downsample with bilinear taps)
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
             glBindTexture(GL_TEXTURE_2D, 0);
@@ -881,10 +1002,7 @@ void GameMode::draw(glm::uvec2 const &drawable_size)
     GL_ERRORS();
 
     // setup camera position
-    glUseProgram(vertex_color_program->program);
     auto cam_pos_rot = get_pos_rot(camera->transform->make_local_to_world());
-    glUniform3fv(vertex_color_program->view_pos_vec3, 1, glm::value_ptr(cam_pos_rot.first));
-    glUseProgram(0);
 
     GL_ERRORS();
 
@@ -898,6 +1016,23 @@ void GameMode::draw(glm::uvec2 const &drawable_size)
 
     GL_ERRORS();
 
+    //pick levels of detail for divers + props (shadow passes use the same levels):
+    current_scene->update_lods(camera);
+
+    //update sun shadow maps (static map is only re-rendered if the sun moved):
+    {
+        PROFILE_SCOPE("shadows");
+        sun_shadow.update(*scene, sun);
+    }
+    sun_shadow.bind(VertexColorProgram::StaticShadowUnit, VertexColorProgram::DynamicShadowUnit);
+
+    //sun lights along its -z axis, so direction *to* the sun is +z:
+    glm::vec3 sun_direction = glm::normalize(glm::vec3(sun->transform->make_local_to_world()[2]));
+    set_lighting(*vertex_color_program, cam_pos_rot.first, sun_shadow, sun_direction);
+    set_lighting(*bone_vertex_color_program, cam_pos_rot.first, sun_shadow, sun_direction);
+
+    GL_ERRORS();
+
     //Draw scene to off-screen antialiasing framebuffer:
     glBindFramebuffer(GL_FRAMEBUFFER, fbs_aa.fb);
     glViewport(0, 0, drawable_size.x, drawable_size.y);
@@ -906,13 +1041,30 @@ void GameMode::draw(glm::uvec2 const &drawable_size)
 
     GL_ERRORS();
 
-    scene->draw(camera);
+    {
+        PROFILE_SCOPE("scene");
+        scene->draw(camera);
+    }
+
+    //all other divers, in one instanced draw:
+    {
+        PROFILE_SCOPE("divers");
+        diver_batch->clear();
+        for (auto const &pair : player_animations) {
+            diver_batch->add(players_transform.at(pair.first)->make_local_to_world(),
+                             pair.second.mixer.palette(),
+                             team_suit_colors[state.players.at(pair.first).team]);
+        }
+        diver_batch->draw(camera->make_projection() * camera->transform->make_world_to_local());
+    }
 
     // only draw score and skybox if this is the foreground
     if (Mode::current == shared_from_this()) {
         // draw ambient skybox
         underwater_skybox.draw(camera);
 
+        PROFILE_SCOPE("hud");
+
         std::stringstream score_stream;
         score_stream << "Team 1: " << state.current_points[0] << " * " << "Team 2: " << state.current_points[1];
         draw_message(score_stream.str(), 0.9f);
@@ -934,57 +1086,58 @@ void GameMode::draw(glm::uvec2 const &drawable_size)
 
     GL_ERRORS();
 
-    //Set up the post-processing frame buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, fbs_pp.fb);
-    glViewport(0, 0, drawable_size.x, drawable_size.y);
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    //Draw into the post-processing framebuffer from the antialiased one- https://www.khronos.org/opengl/wiki/Multisampling#Allocating_a_Multisample_Render_Target
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);   // Make sure no FBO is set as the draw framebuffer
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbs_aa.fb); // Make sure your multisampled FBO is the read framebuffer
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbs_pp.fb); //Set the post-processing buffer as the draw buffer
-    glBlitFramebuffer(0,
-                      0,
-                      drawable_size.x,
-                      drawable_size.y,
-                      0,
-                      0,
-                      drawable_size.x,
-                      drawable_size.y,
-                      GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT,
-                      GL_NEAREST); //Blit using antialiasing
+    {
+        PROFILE_SCOPE("resolve");
+
+        //Set up the post-processing frame buffer
+        glBindFramebuffer(GL_FRAMEBUFFER, fbs_pp.fb);
+        glViewport(0, 0, drawable_size.x, drawable_size.y);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        //Draw into the post-processing framebuffer from the antialiased one- https://www.khronos.org/opengl/wiki/Multisampling#Allocating_a_Multisample_Render_Target
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);   // Make sure no FBO is set as the draw framebuffer
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbs_aa.fb); // Make sure your multisampled FBO is the read framebuffer
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbs_pp.fb); //Set the post-processing buffer as the draw buffer
+        glBlitFramebuffer(0,
+                          0,
+                          drawable_size.x,
+                          drawable_size.y,
+                          0,
+                          0,
+                          drawable_size.x,
+                          drawable_size.y,
+                          GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT,
+                          GL_NEAREST); //Blit using antialiasing
+    }
 
     //TODO: copy the depth buffer???
 
     GL_ERRORS();
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE0);
-
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     GL_ERRORS();
 
     //Copy scene from depth/color buffers to screen, performing post-processing effects:
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, fbs_pp.depth_tex);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, fbs_pp.color_tex);
+    {
+        PROFILE_SCOPE("post");
+        post.draw(fbs_pp.color_tex, fbs_pp.depth_tex, drawable_size, get_own_player().is_shot);
+    }
 
     GL_ERRORS();
 
-    glUseProgram(get_own_player().is_shot ? *hit_program : *nohit_program);
-    glBindVertexArray(*empty_vao);
-
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-
-    glUseProgram(0);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    GL_ERRORS();
+    //profiler overlay (toggled with F5) goes on top of everything:
+    if (Profiler::enabled) {
+        glDisable(GL_DEPTH_TEST);
+        std::vector<std::string> lines = Profiler::report();
+        float height = 0.04f;
+        for (uint32_t i = 0; i < lines.size(); i++) {
+            draw_text(lines[i], glm::vec2(-0.95f * camera->aspect, 0.9f - 1.5f * height * i), height,
+                      glm::vec4(1.0f, 1.0f, 0.0f, 1.0f));
+        }
+        glEnable(GL_DEPTH_TEST);
+    }
 
 }
 
@@ -9,8 +9,11 @@
 #include "GameState.hpp"
 #include "Scene.hpp"
 #include "Skybox.hpp"
+#include "SunShadow.hpp"
+#include "PostProcess.hpp"
 #include "Sound.hpp"
 #include "BoneAnimation.hpp"
+#include "SkinnedBatch.hpp"
 
 #include <math.h>
 #include <SDL.h>
@@ -80,9 +83,23 @@ struct GameMode: public Mode
 
     Skybox underwater_skybox;
 
+    SunShadow sun_shadow;
+
+    PostProcess post;
+
     std::shared_ptr< Sound::PlayingSample > swim_sound;
 
-    std::unordered_map< uint32_t, BoneAnimationPlayer > player_animations;
+    //other divers are drawn skinned: the base layer crossfades between idle/swim/stunned clips,
+    // and an additive upper-body layer plays the shoot clip over it:
+    struct DiverAnimation
+    {
+        DiverAnimation(BoneAnimation const &banims);
+        BoneAnimationMixer mixer;
+        enum State { Idle, Swim, Stunned } state = Swim;
+        int harpoon_state = 0; //(as of the last update, to notice shots)
+    };
+    std::unordered_map< uint32_t, DiverAnimation > player_animations;
+    std::unique_ptr< SkinnedBatch > diver_batch; //(draws all of them at once)
     //------ networking ------
     Client &client; //client object; manages connection to server.
 };
@@ -4,6 +4,7 @@
 #include "Scene.hpp"
 #include "data_path.hpp" //helper to get paths relative to executable
 #include <iostream>
+#include <cstring>
 
 #include <glm/gtx/string_cast.hpp>
 
@@ -15,13 +16,20 @@
 #define M_PI_2 (M_PI / 2.0)
 #endif // M_PI_2
 
-Load<CollisionMeshBuffer> meshes_for_collision(LoadTagDefault, []()
+//(collision meshes need no OpenGL, so they -- and their BVHs -- are built entirely on a loader thread)
+// lazy, so they are only resident while a GameState exists:
+Load<CollisionMeshBuffer> meshes_for_collision(LoadTagDefault,
+                                               Load<CollisionMeshBuffer>::Lazy("test_level_complex.collision"), []()
 {
-    return new CollisionMeshBuffer(data_path("test_level_complex.collision"));
-});
+    std::unique_ptr<CollisionMeshBuffer> ret(new CollisionMeshBuffer(data_path("test_level_complex.collision")));
+    note_load_bytes(ret->file->size);
+    return ret;
+}, load_decoded<CollisionMeshBuffer>);
 
 GameState::GameState()
 {
+    meshes_for_collision.acquire();
+
     bt_collision_configuration = new btDefaultCollisionConfiguration();
     bt_dispatcher = new btCollisionDispatcher(bt_collision_configuration);
 
@@ -47,6 +55,7 @@ GameState::GameState()
                             btVector3(t->position.x, t->position.y, t->position.z)));
             auto *capsule = new btCapsuleShapeZ((btScalar) player_capsule_radius, (btScalar) player_capsule_height);
             object->setCollisionShape(capsule);
+            object->setUserIndex(-2); //(not level geometry, as far as line_of_sight is concerned)
             bt_collision_world->addCollisionObject(object);
 
         }
@@ -56,32 +65,13 @@ GameState::GameState()
             object->setWorldTransform(
                 btTransform(btQuaternion(t->rotation.x, t->rotation.y, t->rotation.z, t->rotation.w),
                             btVector3(t->position.x, t->position.y, t->position.z)));
-            btScaledBvhTriangleMeshShape *scaled_mesh_shape;
 
-            if (collision_meshes.find(m) == collision_meshes.end()) {
-                CollisionMeshBuffer::CollisionMesh const &mesh = meshes_for_collision->lookup(m);
-                btStridingMeshInterface *tri_array = new btTriangleIndexVertexArray((int) mesh.triangle_count,
-                                                                                    (int *) &(meshes_for_collision
-                                                                                        ->triangles[mesh.triangle_start]
-                                                                                        .x),
-                                                                                    (int) sizeof(glm::uvec3),
-                                                                                    (int) meshes_for_collision->vertices
-                                                                                        .size(),
-                                                                                    (btScalar *) &(meshes_for_collision
-                                                                                        ->vertices[0].x),
-                                                                                    (int) sizeof(glm::vec3));
-                auto *mesh_shape = new btBvhTriangleMeshShape(tri_array, true);
-                collision_meshes[m] = mesh_shape;
-
-                scaled_mesh_shape =
-                    new btScaledBvhTriangleMeshShape(mesh_shape, btVector3(t->scale.x, t->scale.y, t->scale.z));
-            }
-            else {
-                std::cout << "identical mesh found" << std::endl;
-                auto *mesh_shape = collision_meshes.at(m);
-                scaled_mesh_shape =
-                    new btScaledBvhTriangleMeshShape(mesh_shape, btVector3(t->scale.x, t->scale.y, t->scale.z));
+            CollisionMeshBuffer::CollisionMesh const &mesh = meshes_for_collision->lookup(m);
+            if (!mesh.shape) {
+                throw std::runtime_error("collision mesh '" + m + "' has no triangles");
             }
+            auto *scaled_mesh_shape =
+                new btScaledBvhTriangleMeshShape(mesh.shape, btVector3(t->scale.x, t->scale.y, t->scale.z));
 
             object->setCollisionShape(scaled_mesh_shape);
             object->setUserPointer(scaled_mesh_shape);
@@ -105,24 +95,14 @@ GameState::GameState()
             // extract bounding box from this mesh
             if (t->name == "GM_Bounds") {
                 CollisionMeshBuffer::CollisionMesh const &mesh = meshes_for_collision->lookup(m);
-                btStridingMeshInterface *tri_array = new btTriangleIndexVertexArray((int) mesh.triangle_count,
-                                                                                    (int *) &(meshes_for_collision
-                                                                                        ->triangles[mesh.triangle_start]
-                                                                                        .x),
-                                                                                    (int) sizeof(glm::uvec3),
-                                                                                    (int) meshes_for_collision->vertices
-                                                                                        .size(),
-                                                                                    (btScalar *) &(meshes_for_collision
-                                                                                        ->vertices[0].x),
-                                                                                    (int) sizeof(glm::vec3));
-                auto *mesh_shape = new btBvhTriangleMeshShape(tri_array, true);
+                if (!mesh.shape) {
+                    throw std::runtime_error("bounds mesh '" + m + "' has no triangles");
+                }
                 auto scaled_mesh_shape =
-                    new btScaledBvhTriangleMeshShape(mesh_shape, btVector3(t->scale.x, t->scale.y, t->scale.z));
+                    new btScaledBvhTriangleMeshShape(mesh.shape, btVector3(t->scale.x, t->scale.y, t->scale.z));
                 auto transform = btTransform(btQuaternion(t->rotation.x, t->rotation.y, t->rotation.z, t->rotation.w),
                                              btVector3(t->position.x, t->position.y, t->position.z));
                 scaled_mesh_shape->getAabb(transform, bounds_min, bounds_max);
-                delete tri_array;
-                delete mesh_shape;
                 delete scaled_mesh_shape;
             }
         }
@@ -257,6 +237,52 @@ void GameState::add_player(uint32_t id, uint32_t team, std::string nickname)
     player_shot_timer[id] = 0.0f;
 }
 
+bool GameState::apply_player_message(uint32_t id, char const *data)
+{
+    auto f = players.find(id);
+    if (f == players.end()) {
+        return false;
+    }
+    Player *player_data = &f->second;
+    memcpy(&player_data->position, data, sizeof(glm::vec3));
+    memcpy(&player_data->velocity, data + 1 * sizeof(glm::vec3), sizeof(glm::vec3));
+    memcpy(&player_data->rotation, data + 2 * sizeof(glm::vec3), sizeof(glm::quat));
+
+    bool shot = false;
+    bool grabbed = false;
+    memcpy(&shot, data + 10 * sizeof(float) + 0 * sizeof(bool), sizeof(bool));
+    memcpy(&grabbed, data + 10 * sizeof(float) + 1 * sizeof(bool), sizeof(bool));
+    if (shot) {
+        player_data->shot_harpoon = true;
+    }
+    if (grabbed) {
+        player_data->grab = true;
+    }
+    return true;
+}
+
+bool GameState::line_of_sight(glm::vec3 const &from, glm::vec3 const &to) const
+{
+    //(level geometry is every object that wasn't given a player, harpoon, or treasure index)
+    struct LevelRayCallback : public btCollisionWorld::ClosestRayResultCallback
+    {
+        LevelRayCallback(btVector3 const &from, btVector3 const &to)
+            : btCollisionWorld::ClosestRayResultCallback(from, to)
+        {}
+        bool needsCollision(btBroadphaseProxy *proxy) const override
+        {
+            btCollisionObject const *object = static_cast<btCollisionObject const *>(proxy->m_clientObject);
+            return object->getUserIndex() == -1 && btCollisionWorld::ClosestRayResultCallback::needsCollision(proxy);
+        }
+    };
+
+    btVector3 bt_from(from.x, from.y, from.z);
+    btVector3 bt_to(to.x, to.y, to.z);
+    LevelRayCallback callback(bt_from, bt_to);
+    bt_collision_world->rayTest(bt_from, bt_to, callback);
+    return !callback.hasHit();
+}
+
 void GameState::handle_harpoon_collision(const btCollisionObject *harpoon_obj,
                                          const btCollisionObject *other_obj,
                                          const HarpoonCollision type,
@@ -768,4 +794,7 @@ GameState::~GameState()
     delete bt_broadphase;
     delete bt_dispatcher;
     delete bt_collision_configuration;
+
+    //(after the world, since its objects use the shared BVHs)
+    meshes_for_collision.release();
 }
@@ -14,7 +14,7 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtc/quaternion.hpp>
 
-#include "read_chunk.hpp"
+#include "ChunkFile.hpp"
 
 struct Translation
 {
@@ -62,8 +62,10 @@ struct Treasure
 
 struct CollisionMeshBuffer
 {
-    std::vector<glm::uvec3> triangles;
-    std::vector<glm::vec3> vertices;
+    //mapped file; triangles and vertices point directly into it (and are handed to bullet as-is):
+    std::unique_ptr<ChunkFile> file;
+    ChunkFile::Span<glm::uvec3> triangles;
+    ChunkFile::Span<glm::vec3> vertices;
 
     struct CollisionMesh
     {
@@ -71,25 +73,26 @@ struct CollisionMeshBuffer
         uint32_t vertex_count = 0;
         uint32_t triangle_start = 0;
         uint32_t triangle_count = 0;
+
+        //bullet view of the triangles + the BVH built over them (built once, at load, and shared by all objects using the mesh):
+        btTriangleIndexVertexArray *triangle_array = nullptr;
+        btBvhTriangleMeshShape *shape = nullptr;
     };
 
     std::unordered_map<std::string, CollisionMesh> meshes;
 
     CollisionMeshBuffer(std::string filename)
     {
-        std::ifstream file(filename, std::ios::binary);
+        file.reset(new ChunkFile(filename));
 
         static_assert(sizeof(glm::vec3) == 3 * 4, "vec3 is packed.");
         static_assert(sizeof(glm::uvec3) == 3 * 4, "uvec3 is packed.");
 
-        std::vector<glm::vec3> normals;
-
-        read_chunk(file, "p...", &vertices);
-        read_chunk(file, "n...", &normals);
-        read_chunk(file, "tri0", &triangles);
+        vertices = file->read<glm::vec3>("p...");
+        file->read<glm::vec3>("n..."); //(normals aren't needed for collision)
+        triangles = file->read<glm::uvec3>("tri0");
 
-        std::vector<char> strings;
-        read_chunk(file, "str0", &strings);
+        ChunkFile::Span<char> strings = file->read<char>("str0");
 
         { //read index chunk, add to meshes:
             struct IndexEntry
@@ -99,8 +102,7 @@ struct CollisionMeshBuffer
                 uint32_t triangle_begin, triangle_end;
             };
 
-            std::vector<IndexEntry> index;
-            read_chunk(file, "idxA", &index);
+            ChunkFile::Span<IndexEntry> index = file->read<IndexEntry>("idxA");
 
             for (auto const &entry : index) {
                 if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
@@ -112,7 +114,7 @@ struct CollisionMeshBuffer
                 if (!(entry.triangle_begin <= entry.triangle_end && entry.triangle_end <= triangles.size())) {
                     throw std::runtime_error("index entry has out-of-range triangle start/count");
                 }
-                std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+                std::string name(strings.data() + entry.name_begin, strings.data() + entry.name_end);
                 CollisionMesh mesh;
                 mesh.vertex_start = entry.vertex_begin;
                 mesh.vertex_count = entry.vertex_end - entry.vertex_begin;
@@ -126,11 +128,37 @@ struct CollisionMeshBuffer
             }
         }
 
-        if (file.peek() != EOF) {
+        if (file->next_magic() == "adj0") file->read<uint32_t>("adj0"); //(walk mesh adjacency isn't needed for collision)
+
+        if (!file->at_end()) {
             std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
         }
+
+        //build BVHs (the slow part of loading collision meshes; doesn't use OpenGL, so may run on a loader thread):
+        for (auto &name_mesh : meshes) {
+            CollisionMesh &mesh = name_mesh.second;
+            if (mesh.triangle_count == 0) continue;
+            mesh.triangle_array = new btTriangleIndexVertexArray((int) mesh.triangle_count,
+                                                                 (int *) &(triangles[mesh.triangle_start].x),
+                                                                 (int) sizeof(glm::uvec3),
+                                                                 (int) vertices.size(),
+                                                                 (btScalar *) &(vertices[0].x),
+                                                                 (int) sizeof(glm::vec3));
+            mesh.shape = new btBvhTriangleMeshShape(mesh.triangle_array, true);
+        }
     }
 
+    ~CollisionMeshBuffer()
+    {
+        for (auto &name_mesh : meshes) {
+            delete name_mesh.second.shape;
+            delete name_mesh.second.triangle_array;
+        }
+    }
+
+    CollisionMeshBuffer(CollisionMeshBuffer const &) = delete;
+    CollisionMeshBuffer &operator=(CollisionMeshBuffer const &) = delete;
+
     const CollisionMesh &lookup(std::string const &name) const
     {
         auto f = meshes.find(name);
@@ -196,6 +224,16 @@ public:
 
     void update(float time);
 
+    //a player's 'p' message (after the 'p'): position, velocity, rotation, fire, grab
+    static constexpr size_t player_message_size = 10 * sizeof(float) + 2 * sizeof(bool);
+
+    //apply a player's 'p' message (used by the server, and by replay to re-apply recorded messages):
+    // returns false (and does nothing) if 'id' isn't a player
+    bool apply_player_message(uint32_t id, char const *data);
+
+    //true if no level geometry (players, harpoons, and treasures don't count) is between 'from' and 'to':
+    bool line_of_sight(glm::vec3 const &from, glm::vec3 const &to) const;
+
 
 private:
     // private game state members
@@ -232,7 +270,6 @@ private:
     btBroadphaseInterface *bt_broadphase;
     btCollisionWorld *bt_collision_world;
 
-    std::unordered_map<std::string, btBvhTriangleMeshShape *> collision_meshes;
     std::unordered_map<uint32_t, std::pair<btCollisionObject *, btCollisionObject *>> player_collisions;
     btCollisionObject *treasure_collisions[2];
     btVector3 bounds_min, bounds_max;
@@ -0,0 +1,149 @@
+#include "Interest.hpp"
+
+#include "GameState.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+//how often (in ticks) line-of-sight between a client and a diver is re-checked:
+static constexpr uint32_t VisibilityRefresh = 6;
+
+InterestManager::InterestManager(Settings const &settings_) : settings(settings_) {
+	if (!(settings.near > 0.0f) || !std::isfinite(settings.near)) throw std::runtime_error("interest 'near' radius must be positive");
+	if (!std::isfinite(settings.far)) throw std::runtime_error("interest 'far' radius must be finite");
+	settings.far = std::max(settings.far, settings.near);
+	//(cells at least a unit across, so in_range() positions can't overflow a cell index)
+	cell_size = std::max(settings.far, 1.0f);
+	settings.mid_period = std::max(settings.mid_period, 1U);
+	bucket_start.assign(16 + 1, 0);
+}
+
+uint32_t InterestManager::bucket_of(glm::ivec3 const &cell) const {
+	uint32_t h = (uint32_t(cell.x) * 73856093U) ^ (uint32_t(cell.y) * 19349663U) ^ (uint32_t(cell.z) * 83492791U);
+	return h & uint32_t(bucket_start.size() - 2);
+}
+
+static glm::ivec3 cell_of(glm::vec3 const &position, float size) {
+	return glm::ivec3(glm::floor(position / size));
+}
+
+//positions come from clients, so guard against ones that would overflow a cell index:
+static bool in_range(glm::vec3 const &position) {
+	return std::abs(position.x) < 1e6f && std::abs(position.y) < 1e6f && std::abs(position.z) < 1e6f;
+}
+
+void InterestManager::update(GameState const &state) {
+	tick += 1;
+
+	//gather divers, and harpoons that are out (so a harpoon headed at a client is replicated at full rate):
+	unsorted.clear();
+	uint32_t max_id = 0;
+	for (auto const &pair : state.players) {
+		if (in_range(pair.second.position)) unsorted.emplace_back(Entry{pair.second.position, pair.first});
+		auto harpoon = state.harpoons.find(pair.first);
+		if (harpoon != state.harpoons.end() && harpoon->second.state != 0 && in_range(harpoon->second.position)) {
+			unsorted.emplace_back(Entry{harpoon->second.position, pair.first});
+		}
+		max_id = std::max(max_id, pair.first);
+	}
+	if (chosen.size() < size_t(max_id) + 1) chosen.resize(size_t(max_id) + 1, 0);
+
+	//bucket them by cell (counting sort; about two buckets per entry):
+	uint32_t buckets = 16;
+	while (buckets < 2 * unsorted.size()) buckets *= 2;
+	bucket_start.assign(buckets + 1, 0);
+	for (auto const &entry : unsorted) {
+		bucket_start[bucket_of(cell_of(entry.position, cell_size)) + 1] += 1;
+	}
+	for (uint32_t b = 0; b < buckets; ++b) {
+		bucket_start[b + 1] += bucket_start[b];
+	}
+	entries.resize(unsorted.size());
+	for (auto const &entry : unsorted) {
+		uint32_t b = bucket_of(cell_of(entry.position, cell_size));
+		entries[bucket_start[b]++] = entry;
+	}
+	//(placing entries advanced each bucket's start to the next bucket's start; shift back)
+	for (uint32_t b = buckets; b > 0; --b) {
+		bucket_start[b] = bucket_start[b - 1];
+	}
+	bucket_start[0] = 0;
+
+	//forget line-of-sight results nobody has asked about for a while (e.g. disconnected clients):
+	if (settings.occlusion && tick % 64 == 0) {
+		for (auto v = visibility.begin(); v != visibility.end(); /*later*/) {
+			if (tick - v->second.checked > 64) v = visibility.erase(v);
+			else ++v;
+		}
+	}
+}
+
+void InterestManager::relevant(GameState const &state, uint32_t viewer, std::vector< uint32_t > *out) {
+	out->clear();
+	auto v = state.players.find(viewer);
+	if (v == state.players.end()) return;
+
+	stamp += 1;
+	if (stamp == 0) {
+		std::fill(chosen.begin(), chosen.end(), 0);
+		stamp = 1;
+	}
+	auto choose = [&](uint32_t id) {
+		if (id < chosen.size() && chosen[id] != stamp) {
+			chosen[id] = stamp;
+			out->emplace_back(id);
+		}
+	};
+
+	choose(viewer);
+	for (uint32_t team = 0; team < GameState::num_teams; team++) {
+		int held_by = state.treasures[team].held_by;
+		if (held_by >= 0 && state.players.count(uint32_t(held_by))) choose(uint32_t(held_by));
+	}
+
+	//everyone, on this client's far tick:
+	if (settings.far_period != 0 && (viewer + tick) % settings.far_period == 0) {
+		for (auto const &pair : state.players) {
+			choose(pair.first);
+		}
+	}
+
+	//nearby divers:
+	glm::vec3 at = v->second.position;
+	if (!in_range(at)) at = glm::vec3(0.0f);
+	float near2 = settings.near * settings.near;
+	float far2 = settings.far * settings.far;
+	//(cells are at least 'far' across, so this is at most 3x3x3 cells)
+	glm::ivec3 lo = cell_of(at - glm::vec3(settings.far), cell_size);
+	glm::ivec3 hi = cell_of(at + glm::vec3(settings.far), cell_size);
+	glm::ivec3 cell;
+	for (cell.z = lo.z; cell.z <= hi.z; ++cell.z) {
+		for (cell.y = lo.y; cell.y <= hi.y; ++cell.y) {
+			for (cell.x = lo.x; cell.x <= hi.x; ++cell.x) {
+				uint32_t b = bucket_of(cell);
+				for (uint32_t e = bucket_start[b]; e < bucket_start[b + 1]; ++e) {
+					Entry const &entry = entries[e];
+					if (chosen[entry.id] == stamp) continue;
+					glm::vec3 d = entry.position - at;
+					float dist2 = glm::dot(d, d);
+					if (dist2 > far2) continue;
+
+					bool mid_turn = ((entry.id + tick) % settings.mid_period == 0);
+					bool near = (dist2 <= near2);
+					if (near && !mid_turn && settings.occlusion) {
+						Visibility &vis = visibility[(uint64_t(viewer) << 32) | entry.id];
+						if (vis.checked == 0 || tick - vis.checked >= VisibilityRefresh) {
+							vis.visible = state.line_of_sight(at, entry.position);
+							vis.checked = tick;
+						}
+						near = vis.visible;
+					}
+					if (near || mid_turn) choose(entry.id);
+				}
+			}
+		}
+	}
+
+	std::sort(out->begin(), out->end());
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+struct GameState;
+
+//"InterestManager" decides which divers (each sent with its harpoon) are worth replicating to each client, each tick:
+// - the client's own diver, and anyone holding a treasure, every tick
+// - divers within 'near' (or whose harpoon is out and within 'near'), every tick
+// - divers within 'far', every 'mid_period' ticks (staggered by diver, so packets stay evenly sized)
+// - everyone else, every 'far_period' ticks (staggered by client; 0 means never)
+//with 'occlusion', near divers that the level hides from the client are only sent at the mid rate.
+//
+//Nearby divers are found with a spatial hash over diver (and harpoon) positions, rebuilt once per tick,
+// with cells 'far' across, so each client scans at most 3x3x3 cells and the per-client cost depends
+// on how crowded the client's surroundings are, not on the match size (or on the radii).
+struct InterestManager {
+	struct Settings {
+		float near = 15.0f; //(harpoon range)
+		float far = 45.0f;
+		uint32_t mid_period = 3;
+		uint32_t far_period = 15;
+		bool occlusion = false;
+	};
+	InterestManager(Settings const &settings);
+
+	Settings settings;
+
+	//call once per tick (after GameState::update), before relevant():
+	void update(GameState const &state);
+
+	//ids of divers to send to 'viewer' this tick (sorted):
+	void relevant(GameState const &state, uint32_t viewer, std::vector< uint32_t > *out);
+
+	uint32_t tick = 0;
+
+	//spatial hash (entries sorted by bucket; bucket b's entries are [bucket_start[b], bucket_start[b+1])):
+	float cell_size;
+	struct Entry {
+		glm::vec3 position;
+		uint32_t id;
+	};
+	std::vector< Entry > entries;
+	std::vector< uint32_t > bucket_start; //(bucket count, a power of two, plus one)
+	std::vector< Entry > unsorted; //(scratch for update())
+	uint32_t bucket_of(glm::ivec3 const &cell) const;
+
+	//per-diver scratch (indexed by id): == 'stamp' if already chosen by the current relevant() call
+	std::vector< uint32_t > chosen;
+	uint32_t stamp = 0;
+
+	//line-of-sight cache (only used with 'occlusion'), keyed by viewer << 32 | id:
+	struct Visibility {
+		uint32_t checked = 0; //tick of last check
+		bool visible = true;
+	};
+	std::unordered_map< uint64_t, Visibility > visibility;
+};
@@ -2,27 +2,378 @@
 
 #include <array>
 #include <list>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
 #include <cassert>
 
 namespace {
-	std::array< std::list< std::function< void() > >, LoadTagCount > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, LoadTagCount > load_lists;
+	struct LoadFunction {
+		std::function< void() > decode; //(empty for single-phase loads)
+		std::function< void() > fn; //called on the main thread
+	};
+
+	std::array< std::list< LoadFunction >, LoadTagCount > &get_load_lists() {
+		static std::array< std::list< LoadFunction >, LoadTagCount > load_lists;
 		return load_lists;
 	}
+
+	std::vector< LazyLoadEntry * > &get_lazy_loads() {
+		static std::vector< LazyLoadEntry * > lazy_loads;
+		return lazy_loads;
+	}
+
+	//time spent in call_load_functions(), per tag:
+	std::array< float, LoadTagCount > startup_ms = {{0.0f, 0.0f, 0.0f}};
+	std::array< uint32_t, LoadTagCount > startup_count = {{0, 0, 0}};
+
+	//lazy load (if any) whose function is running on this thread; note_load_bytes() attributes memory to it:
+	thread_local LazyLoadEntry *current_lazy = nullptr;
+
+	//lazy loads being loaded on the main thread (innermost last), for tracking dependencies:
+	std::vector< LazyLoadEntry * > loading_stack;
+
+	//the thread allowed to use lazy loads (set by call_load_functions(); programs that
+	// don't call it, like the server, get whichever thread first uses a lazy load):
+	std::thread::id main_thread;
+
+	//(for asserts; lazy load bookkeeping is unsynchronized and upload functions may call OpenGL)
+	bool on_main_thread() {
+		if (main_thread == std::thread::id()) main_thread = std::this_thread::get_id();
+		return main_thread == std::this_thread::get_id();
+	}
+
+	float ms_since(std::chrono::high_resolution_clock::time_point const &before) {
+		return std::chrono::duration< float, std::milli >(std::chrono::high_resolution_clock::now() - before).count();
+	}
+
+	//runs all the decode functions of a tag on a few threads:
+	struct DecodePool {
+		struct Job {
+			std::function< void() > const *decode = nullptr;
+			bool done = false;
+			std::exception_ptr error;
+		};
+		std::vector< Job > jobs;
+		size_t next_job = 0; //next job to start
+		bool stop = false; //set to abandon remaining jobs (e.g. if the main thread hit an error)
+		std::mutex mutex;
+		std::condition_variable job_done;
+		std::vector< std::thread > threads;
+
+		void start() {
+			//(at least two threads, since decoding also waits on file reads)
+			uint32_t count = std::max(2U, std::thread::hardware_concurrency());
+			count = std::min< uint32_t >(count, uint32_t(jobs.size()));
+			for (uint32_t i = 0; i < count; ++i) {
+				threads.emplace_back([this](){ work(); });
+			}
+		}
+
+		void work() {
+			std::unique_lock< std::mutex > lock(mutex);
+			while (!stop && next_job < jobs.size()) {
+				Job &job = jobs[next_job];
+				next_job += 1;
+
+				lock.unlock();
+				std::exception_ptr error;
+				try {
+					(*job.decode)();
+				} catch (...) {
+					error = std::current_exception();
+				}
+				lock.lock();
+
+				job.error = error;
+				job.done = true;
+				job_done.notify_all();
+			}
+		}
+
+		//wait for a job to finish; rethrows anything its decode function threw:
+		void wait(size_t index) {
+			assert(index < jobs.size());
+			std::unique_lock< std::mutex > lock(mutex);
+			job_done.wait(lock, [&](){ return jobs[index].done; });
+			if (jobs[index].error) std::rethrow_exception(jobs[index].error);
+		}
+
+		~DecodePool() {
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				stop = true;
+			}
+			for (auto &thread : threads) {
+				thread.join();
+			}
+		}
+	};
 }
 
 void add_load_function(LoadTag tag, std::function< void() > const &fn) {
 	auto &load_lists = get_load_lists();
 	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	LoadFunction lf;
+	lf.fn = fn;
+	load_lists[tag].emplace_back(lf);
+}
+
+void add_load_function(LoadTag tag, std::function< void() > const &decode, std::function< void() > const &upload) {
+	auto &load_lists = get_load_lists();
+	assert(tag < load_lists.size());
+	LoadFunction lf;
+	lf.decode = decode;
+	lf.fn = upload;
+	load_lists[tag].emplace_back(lf);
 }
 
 void call_load_functions() {
+	main_thread = std::this_thread::get_id();
 	auto &load_lists = get_load_lists();
 	for (auto &fn_list : load_lists) {
+		auto before = std::chrono::high_resolution_clock::now();
+		uint32_t tag = uint32_t(&fn_list - &load_lists[0]);
+		startup_count[tag] += uint32_t(fn_list.size());
+
+		//start decoding everything in this tag:
+		DecodePool pool;
+		for (auto const &lf : fn_list) {
+			if (lf.decode) {
+				pool.jobs.emplace_back();
+				pool.jobs.back().decode = &lf.decode;
+			}
+		}
+		pool.start();
+
+		//meanwhile, run main-thread functions in order:
+		size_t job = 0;
 		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+			LoadFunction const &lf = *fn_list.begin();
+			if (lf.decode) {
+				pool.wait(job);
+				job += 1;
+			}
+			lf.fn(); //call first function in the list
+			fn_list.pop_front(); //remove from list (the decode function has already finished, so this is safe)
+		}
+		assert(job == pool.jobs.size());
+
+		startup_ms[tag] += ms_since(before);
+	}
+}
+
+//------ lazy loads ------
+
+uint32_t lazy_load_depth = 0;
+
+void add_lazy_load(LazyLoadEntry *entry) {
+	assert(entry);
+	assert(entry->tag < LoadTagCount);
+	get_lazy_loads().emplace_back(entry);
+}
+
+//note that the innermost loading lazy load (if any) depends on 'entry':
+static void record_dependency(LazyLoadEntry *entry) {
+	if (loading_stack.empty()) return;
+	LazyLoadEntry *parent = loading_stack.back();
+	if (parent == entry) return;
+	if (std::find(parent->dependencies.begin(), parent->dependencies.end(), entry) != parent->dependencies.end()) return;
+	parent->dependencies.emplace_back(entry);
+	entry->refs += 1;
+}
+
+//run a lazy load's (main-thread) functions; 'decoded' means its decode function has already run:
+static void finish_lazy(LazyLoadEntry *entry, bool decoded, float decode_ms) {
+	assert(!entry->loaded);
+	auto before = std::chrono::high_resolution_clock::now();
+
+	loading_stack.emplace_back(entry);
+	lazy_load_depth = uint32_t(loading_stack.size());
+	LazyLoadEntry *old_current = current_lazy;
+	current_lazy = entry;
+	try {
+		if (entry->load) {
+			entry->load();
+		} else {
+			if (!decoded) entry->decode();
+			entry->upload();
 		}
+	} catch (...) {
+		current_lazy = old_current;
+		loading_stack.pop_back();
+		lazy_load_depth = uint32_t(loading_stack.size());
+		throw;
+	}
+	current_lazy = old_current;
+	loading_stack.pop_back();
+	lazy_load_depth = uint32_t(loading_stack.size());
+
+	entry->loaded = true;
+	entry->load_count += 1;
+	entry->load_ms = decode_ms + ms_since(before);
+}
+
+//current prefetch_loads() decodes (so a load of an entry that is still decoding waits for it instead):
+struct Prefetch {
+	DecodePool *pool = nullptr;
+	std::vector< LazyLoadEntry * > entries; //entry for each pool job
+	std::vector< float > decode_ms; //decode time for each pool job
+};
+static Prefetch *prefetch = nullptr;
+
+void load_lazy(LazyLoadEntry *entry) {
+	assert(entry);
+	assert(on_main_thread() && "lazy loads may only be used on the main thread");
+	record_dependency(entry);
+	if (entry->loaded) return;
+
+	if (prefetch) {
+		auto f = std::find(prefetch->entries.begin(), prefetch->entries.end(), entry);
+		if (f != prefetch->entries.end()) {
+			size_t job = f - prefetch->entries.begin();
+			prefetch->pool->wait(job);
+			finish_lazy(entry, true, prefetch->decode_ms[job]);
+			return;
+		}
+	}
+
+	entry->bytes = 0;
+	finish_lazy(entry, false, 0.0f);
+}
+
+void acquire_lazy(LazyLoadEntry *entry) {
+	assert(entry);
+	assert(on_main_thread() && "lazy loads may only be used on the main thread");
+	entry->refs += 1;
+	load_lazy(entry);
+}
+
+static void unload_lazy(LazyLoadEntry *entry) {
+	assert(entry->loaded && entry->refs == 0);
+	entry->unload();
+	entry->loaded = false;
+	entry->bytes = 0;
+
+	//stop holding anything this load used:
+	std::vector< LazyLoadEntry * > dependencies;
+	std::swap(dependencies, entry->dependencies);
+	for (auto dep : dependencies) {
+		release_lazy(dep);
+	}
+}
+
+void release_lazy(LazyLoadEntry *entry) {
+	assert(entry);
+	assert(on_main_thread() && "lazy loads may only be used on the main thread");
+	if (entry->refs == 0) {
+		std::cerr << "WARNING: releasing lazy load '" << entry->name << "' more times than it was acquired." << std::endl;
+		return;
+	}
+	entry->refs -= 1;
+	if (entry->refs == 0 && entry->loaded) {
+		unload_lazy(entry);
+	}
+}
+
+void prefetch_loads(LoadTag tag) {
+	assert(tag < LoadTagCount);
+	assert(!prefetch && "prefetch_loads() shouldn't be called from inside a load function");
+	assert(on_main_thread() && "lazy loads may only be used on the main thread");
+
+	std::vector< LazyLoadEntry * > entries;
+	for (auto entry : get_lazy_loads()) {
+		if (entry->tag == tag && !entry->loaded) entries.emplace_back(entry);
+	}
+
+	Prefetch info;
+	std::vector< std::function< void() > > decodes; //(declared before the pool, so it outlives the pool's threads)
+	decodes.reserve(entries.size());
+	DecodePool pool;
+	info.pool = &pool;
+
+	//decode two-phase loads in parallel:
+	for (auto entry : entries) {
+		if (entry->load) continue;
+		entry->bytes = 0;
+		info.entries.emplace_back(entry);
+	}
+	info.decode_ms.assign(info.entries.size(), 0.0f);
+	for (size_t job = 0; job < info.entries.size(); ++job) {
+		LazyLoadEntry *entry = info.entries[job];
+		float *ms = &info.decode_ms[job];
+		//(wrapped so decode time + note_load_bytes calls are attributed to the entry)
+		decodes.emplace_back([entry,ms](){
+			auto before = std::chrono::high_resolution_clock::now();
+			current_lazy = entry;
+			try {
+				entry->decode();
+			} catch (...) {
+				current_lazy = nullptr;
+				throw;
+			}
+			current_lazy = nullptr;
+			*ms = ms_since(before);
+		});
+		pool.jobs.emplace_back();
+		pool.jobs.back().decode = &decodes.back();
+	}
+	pool.start();
+
+	//finish everything on the main thread, in registration order:
+	prefetch = &info;
+	try {
+		for (auto entry : entries) {
+			//(may have been loaded already, as a dependency of an earlier entry)
+			if (!entry->loaded) load_lazy(entry);
+		}
+	} catch (...) {
+		prefetch = nullptr;
+		throw;
+	}
+	prefetch = nullptr;
+}
+
+void evict_unused_loads() {
+	for (auto entry : get_lazy_loads()) {
+		if (entry->loaded && entry->refs == 0) {
+			unload_lazy(entry);
+		}
+	}
+}
+
+void note_load_bytes(size_t bytes) {
+	if (current_lazy) current_lazy->bytes += bytes;
+}
+
+void print_load_report(std::ostream &out) {
+	static char const *tag_names[LoadTagCount] = {"init", "default", "late"};
+
+	out << "---- loads ----\n";
+	for (uint32_t tag = 0; tag < LoadTagCount; ++tag) {
+		out << "startup " << std::setw(8) << tag_names[tag] << ": " << startup_count[tag] << " loads in " << std::fixed << std::setprecision(1) << startup_ms[tag] << " ms\n";
+	}
+
+	size_t total_bytes = 0;
+	out << std::left << std::setw(32) << "lazy load" << std::right
+		<< std::setw(9) << "tag" << std::setw(9) << "state" << std::setw(6) << "refs" << std::setw(7) << "loads"
+		<< std::setw(11) << "last ms" << std::setw(12) << "KiB" << "\n";
+	for (auto entry : get_lazy_loads()) {
+		out << std::left << std::setw(32) << entry->name << std::right
+			<< std::setw(9) << tag_names[entry->tag]
+			<< std::setw(9) << (entry->loaded ? "loaded" : "unloaded")
+			<< std::setw(6) << entry->refs
+			<< std::setw(7) << entry->load_count
+			<< std::setw(11) << std::fixed << std::setprecision(1) << entry->load_ms
+			<< std::setw(12) << std::fixed << std::setprecision(1) << (entry->bytes / 1024.0f)
+			<< "\n";
+		if (entry->loaded) total_bytes += entry->bytes;
 	}
+	out << "lazy loads resident: " << std::fixed << std::setprecision(1) << (total_bytes / 1024.0f) << " KiB" << std::endl;
 }
@@ -21,10 +21,48 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. "Meshes"] before looking up individual elements within them.)
  *
+ * A Load<> can also be split into two phases, so that slow CPU-side work (file parsing, image/audio decoding, ...)
+ * runs on a pool of loader threads while the main thread does the rest:
+ *
+ * Load< MeshBuffer > level_meshes(LoadTagDefault, []() {
+ *     return std::unique_ptr< MeshBuffer >(new MeshBuffer(data_path("level.pnc"), MeshBuffer::DeferUpload()));
+ * }, [](std::unique_ptr< MeshBuffer > &meshes) -> MeshBuffer const * {
+ *     meshes->upload();
+ *     return meshes.release();
+ * });
+ *
+ * For each tag, every decode function in the tag is started on the loader threads, then the main thread
+ * walks the tag's functions in registration order -- calling single-phase functions directly and
+ * waiting for each decode before calling its upload function -- so main-thread work keeps its usual order.
+ * Decode functions must not call OpenGL, and may only depend on loads from earlier tags.
+ *
+ * Finally, a Load<> can be lazy, so it isn't loaded at startup at all:
+ *
+ * Load< Scene > level(LoadTagDefault, Load< Scene >::Lazy("level scene"), []() -> Scene const * { ... });
+ *
+ * A lazy load runs (on the main thread) the first time it is dereferenced, acquire()'d, or prefetched with
+ * prefetch_loads(tag) -- which also decodes any two-phase lazy loads of that tag in parallel.
+ * Lazy loads are reference counted: a Mode (or level) acquire()s what it uses and release()s it when done,
+ * and the value is unloaded (deleted, or passed to Lazy's 'unload' function) once nothing holds it.
+ * Lazy loads dereferenced while another lazy load is loading count as held by that load, until it is unloaded.
+ * Lazy loads may only be used on the main thread; in particular, decode functions must not dereference
+ * (or acquire) a lazy Load<> -- have the upload function do it, or make it a non-lazy load of an earlier tag.
+ * Values that were loaded by dereference alone (never acquired) stay until evict_unused_loads().
+ *
+ * print_load_report() lists every lazy load with its state, reference count, load time, and memory
+ * (as reported by load functions through note_load_bytes()).
+ *
  */
 
 #include <functional>
+#include <memory>
 #include <stdexcept>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include <cstdint>
+#include <type_traits>
 
 enum LoadTag : uint32_t {
 	LoadTagInit = 0, //used for loading mesh and texture blobs before main
@@ -34,8 +72,42 @@ enum LoadTag : uint32_t {
 };
 
 void add_load_function(LoadTag tag, std::function< void() > const &fn);
+//two-phase version: 'decode' is called on a loader thread, 'upload' later on the main thread:
+void add_load_function(LoadTag tag, std::function< void() > const &decode, std::function< void() > const &upload);
 void call_load_functions(); //called by main() after GL context created.
 
+//bookkeeping for a lazy load (used through Load< T >):
+struct LazyLoadEntry {
+	std::string name;
+	LoadTag tag = LoadTagDefault;
+	std::function< void() > load; //single-phase; or...
+	std::function< void() > decode, upload; //...two-phase
+	std::function< void() > unload;
+
+	bool loaded = false;
+	uint32_t refs = 0; //acquire() count, plus one for each loaded lazy load that used this one
+	std::vector< LazyLoadEntry * > dependencies; //lazy loads this one used while loading
+
+	//stats:
+	uint32_t load_count = 0;
+	float load_ms = 0.0f; //duration of the most recent load
+	size_t bytes = 0; //memory of the current value (from note_load_bytes)
+};
+extern uint32_t lazy_load_depth; //number of lazy loads running (on the main thread) right now
+void add_lazy_load(LazyLoadEntry *entry);
+void load_lazy(LazyLoadEntry *entry); //load now, if not already loaded
+void acquire_lazy(LazyLoadEntry *entry);
+void release_lazy(LazyLoadEntry *entry);
+
+//load every lazy load with the given tag that isn't loaded yet (decoding two-phase loads in parallel):
+void prefetch_loads(LoadTag tag);
+//unload every lazy load that nothing holds:
+void evict_unused_loads();
+//called from a load, decode, or upload function to report the memory used by the value being loaded:
+void note_load_bytes(size_t bytes);
+//write a table of lazy loads (plus startup load times) to 'out':
+void print_load_report(std::ostream &out);
+
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
@@ -48,11 +120,93 @@ struct Load {
 		});
 	}
 
+	struct Lazy;
+
+	//Two-phase version: the result of 'decode_fn' (called on a loader thread) is passed to 'upload_fn' (called on the main thread):
+	// (the enable_if keeps this from matching the lazy constructor below)
+	template< typename DecodeFn, typename UploadFn, typename = typename std::enable_if< !std::is_same< DecodeFn, Lazy >::value >::type >
+	Load( LoadTag tag, DecodeFn decode_fn, UploadFn upload_fn ) : value(nullptr) {
+		typedef decltype(decode_fn()) Decoded;
+		std::shared_ptr< Decoded > decoded = std::make_shared< Decoded >();
+		add_load_function(tag, [decoded,decode_fn](){
+			*decoded = decode_fn();
+		}, [this,decoded,upload_fn](){
+			this->value = upload_fn(*decoded);
+			*decoded = Decoded(); //free anything upload_fn didn't take
+			if (!(this->value)) {
+				throw std::runtime_error("Loading failed.");
+			}
+		});
+	}
+
+	//Lazy versions, which load on first use (see above):
+	struct Lazy {
+		Lazy(std::string const &name_, std::function< void(T const *) > const &unload_ = nullptr) : name(name_), unload(unload_) { }
+		std::string name;
+		std::function< void(T const *) > unload; //releases the value (default: delete)
+	};
+
+	Load( LoadTag tag, Lazy const &lazy_, const std::function< T const *() > &load_fn ) : value(nullptr), lazy(new LazyLoadEntry) {
+		setup_lazy(tag, lazy_);
+		lazy->load = [this,load_fn](){
+			this->value = load_fn();
+			if (!(this->value)) {
+				throw std::runtime_error("Loading failed.");
+			}
+		};
+		add_lazy_load(lazy.get());
+	}
+
+	template< typename DecodeFn, typename UploadFn >
+	Load( LoadTag tag, Lazy const &lazy_, DecodeFn decode_fn, UploadFn upload_fn ) : value(nullptr), lazy(new LazyLoadEntry) {
+		setup_lazy(tag, lazy_);
+		typedef decltype(decode_fn()) Decoded;
+		std::shared_ptr< Decoded > decoded = std::make_shared< Decoded >();
+		lazy->decode = [decoded,decode_fn](){
+			*decoded = decode_fn();
+		};
+		lazy->upload = [this,decoded,upload_fn](){
+			this->value = upload_fn(*decoded);
+			*decoded = Decoded();
+			if (!(this->value)) {
+				throw std::runtime_error("Loading failed.");
+			}
+		};
+		add_lazy_load(lazy.get());
+	}
+
+	//hold / stop holding a lazy load (acquire also loads it):
+	void acquire() { assert(lazy); acquire_lazy(lazy.get()); }
+	void release() { assert(lazy); release_lazy(lazy.get()); }
+
 	//Make a "Load< T >" behave like a "T const *":
-	explicit operator bool() { return value != nullptr; }
-	T const &operator*() { return *value; }
-	T const *operator->() { return value; }
+	explicit operator bool() { return get() != nullptr; }
+	T const &operator*() { return *get(); }
+	T const *operator->() { return get(); }
+
+	T const *get() {
+		//(while another lazy load runs, go through load_lazy even if loaded, so the dependency is recorded)
+		if (lazy && (!value || lazy_load_depth > 0)) load_lazy(lazy.get());
+		return value;
+	}
 
 	T const *value;
+	std::unique_ptr< LazyLoadEntry > lazy; //(only for lazy loads)
+
+	void setup_lazy(LoadTag tag, Lazy const &lazy_) {
+		lazy->name = lazy_.name;
+		lazy->tag = tag;
+		std::function< void(T const *) > unload = lazy_.unload;
+		lazy->unload = [this,unload](){
+			if (unload) unload(this->value);
+			else delete this->value;
+			this->value = nullptr;
+		};
+	}
 };
 
+//upload function for two-phase loads whose decode function already built the finished value (i.e., no OpenGL work):
+template< typename T >
+T const *load_decoded(std::unique_ptr< T > &decoded) {
+	return decoded.release();
+}
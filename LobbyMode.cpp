@@ -7,12 +7,16 @@
 #include "compile_program.hpp"
 #include "MeshBuffer.hpp"
 #include "data_path.hpp"
+#include "AssetArchive.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <cmath>
 #include <iostream>
 #include <string>
 #include <iterator>
+#include <fstream>
+#include <sstream>
+#include <memory>
 #include <time.h>
 
 //---------- resources ------------
@@ -79,8 +83,14 @@ Load< GLuint > l_fade_program(LoadTagInit, [](){
 
 std::vector<std::string> read_file(std::string url) {
 	//from https://stackoverflow.com/a/15138839
-	std::ifstream is(url);
-	std::istream_iterator<std::string> start(is), end;
+	AssetArchive::Contents archived;
+	std::unique_ptr<std::istream> is;
+	if (find_data_file(url, &archived)) {
+		is.reset(new std::istringstream(std::string(reinterpret_cast<char const *>(archived.data), archived.size)));
+	} else {
+		is.reset(new std::ifstream(url));
+	}
+	std::istream_iterator<std::string> start(*is), end;
 	std::vector<std::string> result(start, end);
 	return result;
 }
@@ -185,6 +195,8 @@ void LobbyMode::change_nickname() {
 }
 
 void LobbyMode::start_game() {
+	//load the level's (lazy) assets, decoding in parallel, before GameMode starts using them:
+	prefetch_loads(LoadTagDefault);
 	std::shared_ptr<GameMode> game = std::make_shared<GameMode>(client, player_id, player_count, player_teams, nicknames);
 	Mode::set_current(game);
 }
@@ -0,0 +1,76 @@
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string const &filename_, Access access) : filename(filename_) {
+#ifdef _WIN32
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | (access == Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS);
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+	if (file != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER length;
+		if (GetFileSizeEx(file, &length) && length.QuadPart > 0) {
+			HANDLE map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (map != NULL) {
+				void *view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(map); //(view keeps the mapping alive)
+				if (view != NULL) {
+					mapping = view;
+					bytes = reinterpret_cast< uint8_t const * >(view);
+					size = size_t(length.QuadPart);
+				}
+			}
+		}
+		CloseHandle(file);
+	}
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd != -1) {
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void *view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (view != MAP_FAILED) {
+				madvise(view, size_t(info.st_size), (access == Sequential ? MADV_SEQUENTIAL : MADV_RANDOM));
+				mapping = view;
+				bytes = reinterpret_cast< uint8_t const * >(view);
+				size = size_t(info.st_size);
+			}
+		}
+		close(fd); //(mapping stays valid after close)
+	}
+#endif
+
+	if (!mapping) {
+		//couldn't map; read the whole thing instead:
+		std::ifstream file(filename, std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("Failed to open file '" + filename + "'");
+		}
+		fallback.assign(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+		bytes = fallback.data();
+		size = fallback.size();
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (mapping) {
+#ifdef _WIN32
+		UnmapViewOfFile(mapping);
+#else
+		munmap(mapping, size);
+#endif
+		mapping = nullptr;
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//"MappedFile" maps a whole file read-only into memory:
+// - falls back to reading the file into memory if it can't be mapped (e.g. empty file or unusual filesystem)
+// - 'bytes' stays valid as long as the MappedFile
+struct MappedFile {
+	//hint about how the contents will be read:
+	enum Access {
+		Sequential, //front-to-back, once (e.g. a single chunk file)
+		Random, //pieces at a time, in any order (e.g. an archive)
+	};
+
+	//note: will throw if file can't be opened
+	MappedFile(std::string const &filename, Access access = Sequential);
+	~MappedFile();
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	std::string filename;
+	uint8_t const *bytes = nullptr; //start of file contents
+	size_t size = 0; //length of file contents
+
+	//internals:
+	void *mapping = nullptr; //platform mapping handle (or nullptr if contents were read into 'fallback')
+	std::vector< uint8_t > fallback; //file contents, if mapping wasn't possible
+};
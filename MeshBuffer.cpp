@@ -1,38 +1,43 @@
 #include "MeshBuffer.hpp"
-#include "read_chunk.hpp"
+#include "ChunkFile.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <set>
 #include <cstddef>
+#include <cstring>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &vbo);
+MeshBuffer::MeshBuffer(std::string const &filename) : MeshBuffer(filename, DeferUpload()) {
+	upload();
+}
 
-	std::ifstream file(filename, std::ios::binary);
+MeshBuffer::MeshBuffer(std::string const &filename, DeferUpload) : pending_file(new ChunkFile(filename)) {
+	ChunkFile &file = *pending_file;
 
 	GLuint total = 0;
-	//read + upload data chunk:
+	//positions (within the mapped vertex data) are used to compute per-mesh bounds:
+	uint8_t const *positions = nullptr;
+	size_t position_stride = 0;
+	//read data chunk:
 	if (filename.size() >= 2 && filename.substr(filename.size()-2) == ".p") {
 		struct Vertex {
 			glm::vec3 Position;
 		};
 		static_assert(sizeof(Vertex) == 3*4, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "p...", &data);
+		ChunkFile::Span< Vertex > data = file.read< Vertex >("p...");
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//remember data for upload:
+		pending_data = data.data();
+		pending_size = data.size() * sizeof(Vertex);
 
 		total = GLuint(data.size()); //store total for later checks on index
+		positions = reinterpret_cast< uint8_t const * >(data.data()) + offsetof(Vertex, Position);
+		position_stride = sizeof(Vertex);
 
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, Attrib::AsFloat, sizeof(Vertex), offsetof(Vertex, Position));
@@ -44,15 +49,15 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(Vertex) == 3*4+3*4, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "pn..", &data);
+		ChunkFile::Span< Vertex > data = file.read< Vertex >("pn..");
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//remember data for upload:
+		pending_data = data.data();
+		pending_size = data.size() * sizeof(Vertex);
 
 		total = GLuint(data.size()); //store total for later checks on index
+		positions = reinterpret_cast< uint8_t const * >(data.data()) + offsetof(Vertex, Position);
+		position_stride = sizeof(Vertex);
 
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, Attrib::AsFloat, sizeof(Vertex), offsetof(Vertex, Position));
@@ -66,15 +71,15 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(Vertex) == 3*4+3*4+4*1, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "pnc.", &data);
+		ChunkFile::Span< Vertex > data = file.read< Vertex >("pnc.");
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//remember data for upload:
+		pending_data = data.data();
+		pending_size = data.size() * sizeof(Vertex);
 
 		total = GLuint(data.size()); //store total for later checks on index
+		positions = reinterpret_cast< uint8_t const * >(data.data()) + offsetof(Vertex, Position);
+		position_stride = sizeof(Vertex);
 
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, Attrib::AsFloat, sizeof(Vertex), offsetof(Vertex, Position));
@@ -90,15 +95,15 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
 
-		std::vector< Vertex > data;
-		read_chunk(file, "pnct", &data);
+		ChunkFile::Span< Vertex > data = file.read< Vertex >("pnct");
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//remember data for upload:
+		pending_data = data.data();
+		pending_size = data.size() * sizeof(Vertex);
 
 		total = GLuint(data.size()); //store total for later checks on index
+		positions = reinterpret_cast< uint8_t const * >(data.data()) + offsetof(Vertex, Position);
+		position_stride = sizeof(Vertex);
 
 		//store attrib locations:
 		Position = Attrib(3, GL_FLOAT, Attrib::AsFloat, sizeof(Vertex), offsetof(Vertex, Position));
@@ -110,8 +115,7 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	ChunkFile::Span< char > strings = file.read< char >("str0");
 
 	{ //read index chunk, add to meshes:
 		struct IndexEntry {
@@ -120,8 +124,7 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		};
 		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		ChunkFile::Span< IndexEntry > index = file.read< IndexEntry >("idx0");
 
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
@@ -130,10 +133,22 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			std::string name(strings.data() + entry.name_begin, strings.data() + entry.name_end);
 			Mesh mesh;
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
+			if (mesh.count) {
+				auto position = [&](uint32_t v) {
+					glm::vec3 ret;
+					std::memcpy(&ret, positions + v * position_stride, sizeof(ret));
+					return ret;
+				};
+				mesh.min = mesh.max = position(entry.vertex_begin);
+				for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+					mesh.min = glm::min(mesh.min, position(v));
+					mesh.max = glm::max(mesh.max, position(v));
+				}
+			}
 			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
 			if (!inserted) {
 				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
@@ -141,7 +156,42 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		}
 	}
 
-	if (file.peek() != EOF) {
+	if (file.next_magic() == "lod0") { //read (optional) level-of-detail chunk, add to meshes:
+		struct LODEntry {
+			uint32_t name_begin, name_end; //name of the full-detail mesh
+			uint32_t vertex_begin, vertex_end;
+			float screen_size;
+		};
+		static_assert(sizeof(LODEntry) == 20, "LOD entry should be packed");
+
+		ChunkFile::Span< LODEntry > lods = file.read< LODEntry >("lod0");
+
+		for (auto const &entry : lods) {
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("lod entry has out-of-range name begin/end");
+			}
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
+				throw std::runtime_error("lod entry has out-of-range vertex start/count");
+			}
+			std::string name(strings.data() + entry.name_begin, strings.data() + entry.name_end);
+			auto f = meshes.find(name);
+			if (f == meshes.end()) {
+				std::cerr << "WARNING: lod for unknown mesh '" + name + "' in filename '" + filename + "'." << std::endl;
+				continue;
+			}
+			Mesh::LOD lod;
+			lod.start = entry.vertex_begin;
+			lod.count = entry.vertex_end - entry.vertex_begin;
+			lod.screen_size = entry.screen_size;
+			if (!f->second.lods.empty() && !(lod.screen_size < f->second.lods.back().screen_size)) {
+				std::cerr << "WARNING: lods for mesh '" + name + "' in filename '" + filename + "' are not in coarsening order; ignoring extra level." << std::endl;
+				continue;
+			}
+			f->second.lods.emplace_back(lod);
+		}
+	}
+
+	if (!file.at_end()) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
@@ -156,6 +206,27 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 	*/
 }
 
+MeshBuffer::~MeshBuffer() {
+	if (vbo != 0) {
+		glDeleteBuffers(1, &vbo);
+		vbo = 0;
+	}
+}
+
+void MeshBuffer::upload() {
+	assert(pending_file && "MeshBuffer::upload() should be called exactly once, after constructing with DeferUpload.");
+
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, pending_size, pending_data, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//vertex data is in GL now, so the file can go:
+	pending_data = nullptr;
+	pending_size = 0;
+	pending_file.reset();
+}
+
 const MeshBuffer::Mesh &MeshBuffer::lookup(std::string const &name) const {
 	auto f = meshes.find(name);
 	if (f == meshes.end()) {
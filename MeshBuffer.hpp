@@ -1,7 +1,14 @@
 #pragma once
 
 #include "GL.hpp"
+#include "ChunkFile.hpp"
+
+#include <glm/glm.hpp>
+
 #include <map>
+#include <vector>
+#include <string>
+#include <memory>
 #include <assert.h>
 
 
@@ -54,11 +61,31 @@ struct MeshBuffer {
 	// note: will throw if file fails to read.
 	MeshBuffer(std::string const &filename);
 
+	//two-phase construction (e.g. for a loader thread): read + check the file without using OpenGL,
+	// then call upload() on the main thread to create the vbo:
+	struct DeferUpload { };
+	MeshBuffer(std::string const &filename, DeferUpload);
+	void upload();
+
+	//frees the vbo:
+	~MeshBuffer();
+
 	//look up a particular mesh in the DB:
 	// note: will throw if mesh not found.
 	struct Mesh {
 		GLuint start = 0;
 		GLuint count = 0;
+		//object-space bounding box of the mesh's vertices:
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+
+		//reduced-detail versions of the mesh (from the file's optional 'lod0' chunk), each coarser than the last:
+		struct LOD {
+			GLuint start = 0;
+			GLuint count = 0;
+			float screen_size = 0.0f; //use once the mesh's bounding sphere covers less than this fraction of the screen height
+		};
+		std::vector< LOD > lods;
 	};
 	const Mesh &lookup(std::string const &name) const;
 	
@@ -69,4 +96,9 @@ struct MeshBuffer {
 
 	//internals:
 	std::map< std::string, Mesh > meshes;
+
+	//file + vertex data waiting for upload():
+	std::unique_ptr< ChunkFile > pending_file;
+	void const *pending_data = nullptr;
+	size_t pending_size = 0;
 };
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cassert>
+#include <cstdint>
+
+//"Pool" stores objects of one type in fixed-size slabs:
+// - an object's address doesn't change until it is freed (slabs are never moved)
+// - freed slots go on a free list and are reused, so steady-state alloc/free doesn't hit the heap
+// - iterating the pool walks the slabs in order, skipping freed slots
+// - a Handle is a (slot index, generation) pair, so stale handles can be detected
+
+template< typename T, uint32_t SlabSize = 64 >
+struct Pool {
+	static_assert(SlabSize > 0, "Pool slabs must hold at least one object.");
+
+	struct Handle {
+		uint32_t index = -1U;
+		uint32_t generation = 0;
+		bool operator==(Handle const &other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(Handle const &other) const { return !(*this == other); }
+	};
+
+	Pool() = default;
+	Pool(Pool const &) = delete;
+	Pool &operator=(Pool const &) = delete;
+	~Pool() { clear(); }
+
+	//construct a new object in a free slot (allocating a new slab if needed):
+	template< typename... Args >
+	T *alloc(Args&&... args) {
+		if (free_head == -1U) add_slab();
+		Slot &slot = slot_at(free_head);
+		assert(!slot.alive);
+		T *t = new (&slot.storage) T(std::forward< Args >(args)...);
+		free_head = slot.next_free;
+		slot.next_free = -1U;
+		slot.alive = true;
+		live += 1;
+		return t;
+	}
+
+	//destroy an object and return its slot to the free list:
+	void free(T *t) {
+		assert(t && "Can't free a null pointer from a pool.");
+		Slot &slot = slot_of(t);
+		assert(slot.alive && "Object was already freed.");
+		t->~T();
+		slot.alive = false;
+		slot.generation += 1; //invalidates outstanding handles
+		slot.next_free = free_head;
+		free_head = slot.index;
+		live -= 1;
+	}
+
+	//destroy all objects (slabs are kept for reuse):
+	void clear() {
+		free_head = -1U;
+		for (uint32_t i = capacity(); i > 0; --i) {
+			Slot &slot = slot_at(i - 1);
+			if (slot.alive) {
+				reinterpret_cast< T * >(&slot.storage)->~T();
+				slot.alive = false;
+				slot.generation += 1;
+			}
+			slot.next_free = free_head;
+			free_head = slot.index;
+		}
+		live = 0;
+	}
+
+	//make sure at least 'count' objects fit without allocating more slabs:
+	void reserve(uint32_t count) {
+		while (capacity() < count) add_slab();
+	}
+
+	uint32_t size() const { return live; }
+	uint32_t capacity() const { return uint32_t(slabs.size()) * SlabSize; }
+
+	//handles:
+	Handle handle(T const *t) const {
+		Slot const &slot = slot_of(t);
+		assert(slot.alive);
+		Handle ret;
+		ret.index = slot.index;
+		ret.generation = slot.generation;
+		return ret;
+	}
+	//returns nullptr if the handle's object has since been freed:
+	T *lookup(Handle const &h) {
+		if (h.index >= capacity()) return nullptr;
+		Slot &slot = slot_at(h.index);
+		if (!slot.alive || slot.generation != h.generation) return nullptr;
+		return reinterpret_cast< T * >(&slot.storage);
+	}
+	T const *lookup(Handle const &h) const {
+		return const_cast< Pool * >(this)->lookup(h);
+	}
+
+	//iteration over live objects, in slot order:
+	template< typename P, typename V >
+	struct Iterator {
+		P *pool;
+		uint32_t index;
+		Iterator(P *pool_, uint32_t index_) : pool(pool_), index(index_) { skip_dead(); }
+		V &operator*() const { return *reinterpret_cast< V * >(&pool->slot_at(index).storage); }
+		V *operator->() const { return &**this; }
+		Iterator &operator++() { ++index; skip_dead(); return *this; }
+		bool operator==(Iterator const &other) const { return index == other.index; }
+		bool operator!=(Iterator const &other) const { return index != other.index; }
+		void skip_dead() {
+			while (index < pool->capacity() && !pool->slot_at(index).alive) ++index;
+		}
+	};
+	typedef Iterator< Pool, T > iterator;
+	typedef Iterator< Pool const, T const > const_iterator;
+
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, capacity()); }
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, capacity()); }
+
+	//internals:
+	struct Slot {
+		typename std::aligned_storage< sizeof(T), alignof(T) >::type storage; //must be first, see slot_of()
+		uint32_t index = 0;
+		uint32_t generation = 0;
+		uint32_t next_free = -1U;
+		bool alive = false;
+	};
+	static_assert(std::is_standard_layout< Slot >::value, "Slot must be standard layout so T * can be cast back to Slot *.");
+
+	std::vector< std::unique_ptr< Slot[] > > slabs;
+	uint32_t free_head = -1U;
+	uint32_t live = 0;
+
+	Slot &slot_at(uint32_t index) { return slabs[index / SlabSize][index % SlabSize]; }
+	Slot const &slot_at(uint32_t index) const { return slabs[index / SlabSize][index % SlabSize]; }
+
+	//storage is the first member of Slot, so the object's address is the slot's address:
+	static Slot &slot_of(T *t) { return *reinterpret_cast< Slot * >(t); }
+	static Slot const &slot_of(T const *t) { return *reinterpret_cast< Slot const * >(t); }
+
+	void add_slab() {
+		uint32_t base = capacity();
+		slabs.emplace_back(new Slot[SlabSize]);
+		Slot *slab = slabs.back().get();
+		//thread new slots onto the free list so that lower indices are handed out first:
+		for (uint32_t i = SlabSize; i > 0; --i) {
+			slab[i - 1].index = base + i - 1;
+			slab[i - 1].next_free = free_head;
+			free_head = base + i - 1;
+		}
+	}
+};
@@ -0,0 +1,272 @@
+#include "PostProcess.hpp"
+
+#include "Load.hpp"
+#include "compile_program.hpp"
+#include "check_fb.hpp"
+#include "gl_errors.hpp"
+
+#include <algorithm>
+
+//this draws a triangle that covers the entire screen:
+static char const *fullscreen_vertex_shader =
+	"#version 330\n"
+	"void main() {\n"
+	"	gl_Position = vec4(4 * (gl_VertexID & 1) - 1,  2 * (gl_VertexID & 2) - 1, 0.0, 1.0);\n"
+	"}\n"
+;
+
+//used for fullscreen passes:
+static Load< GLuint > post_empty_vao(LoadTagDefault, [](){
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glBindVertexArray(0);
+	return new GLuint(vao);
+});
+
+//box-filter a full-size texture down by 'factor' (2 or 4) using bilinear taps:
+struct DownsampleProgram {
+	GLuint program = 0;
+	GLuint factor_float = -1U;
+	DownsampleProgram() {
+		program = compile_program(fullscreen_vertex_shader,
+			"#version 330\n"
+			"uniform sampler2D src;\n"
+			"uniform float factor;\n"
+			"out vec4 fragColor;\n"
+			"void main() {\n"
+			"	vec2 texel = 1.0 / textureSize(src, 0);\n"
+			"	vec2 at = gl_FragCoord.xy * factor * texel;\n"
+			//each bilinear tap averages 2x2 source pixels, so four taps cover a 4x4 footprint:
+			"	float ofs = 0.5 * factor - 1.0;\n"
+			"	fragColor = 0.25 * (\n"
+			"		  texture(src, at + vec2(-ofs,-ofs) * texel)\n"
+			"		+ texture(src, at + vec2( ofs,-ofs) * texel)\n"
+			"		+ texture(src, at + vec2(-ofs, ofs) * texel)\n"
+			"		+ texture(src, at + vec2( ofs, ofs) * texel)\n"
+			"	);\n"
+			"}\n"
+		);
+		factor_float = glGetUniformLocation(program, "factor");
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "src"), 0);
+		glUseProgram(0);
+	}
+};
+static Load< DownsampleProgram > downsample_program(LoadTagInit, [](){
+	return new DownsampleProgram();
+});
+
+//one direction of a 9-tap gaussian, done as 5 bilinear taps:
+struct BlurProgram {
+	GLuint program = 0;
+	GLuint direction_vec2 = -1U;
+	GLuint uv_max_vec2 = -1U;
+	BlurProgram() {
+		program = compile_program(fullscreen_vertex_shader,
+			"#version 330\n"
+			"uniform sampler2D src;\n"
+			"uniform vec2 direction;\n" //one texel step, in uv
+			"uniform vec2 uv_max;\n" //don't read outside the in-use part of the target
+			"out vec4 fragColor;\n"
+			"vec4 tap(vec2 at) { return texture(src, min(at, uv_max)); }\n"
+			"void main() {\n"
+			"	vec2 at = gl_FragCoord.xy / textureSize(src, 0);\n"
+			"	fragColor = 0.2270270270 * tap(at)\n"
+			"		+ 0.3162162162 * (tap(at + 1.3846153846 * direction) + tap(max(at - 1.3846153846 * direction, vec2(0.0))))\n"
+			"		+ 0.0702702703 * (tap(at + 3.2307692308 * direction) + tap(max(at - 3.2307692308 * direction, vec2(0.0))))\n"
+			"	;\n"
+			"}\n"
+		);
+		direction_vec2 = glGetUniformLocation(program, "direction");
+		uv_max_vec2 = glGetUniformLocation(program, "uv_max");
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "src"), 0);
+		glUseProgram(0);
+	}
+};
+static Load< BlurProgram > blur_program(LoadTagInit, [](){
+	return new BlurProgram();
+});
+
+//mix sharp + blurred images, then tint:
+struct CompositeProgram {
+	GLuint program = 0;
+	GLuint blur_extent_vec2 = -1U;
+	GLuint dof_float = -1U;
+	GLuint hit_blur_float = -1U;
+	GLuint hit_tint_float = -1U;
+	GLuint vignette_float = -1U;
+	CompositeProgram() {
+		program = compile_program(fullscreen_vertex_shader,
+			"#version 330\n"
+			"uniform sampler2D color_tex;\n"
+			"uniform sampler2D depth_tex;\n"
+			"uniform sampler2D blur_tex;\n"
+			"uniform vec2 blur_extent;\n" //fraction of blur_tex in use
+			"uniform float dof;\n"
+			"uniform float hit_blur;\n"
+			"uniform float hit_tint;\n"
+			"uniform float vignette;\n"
+			"out vec4 fragColor;\n"
+			"void main() {\n"
+			"	ivec2 px = ivec2(gl_FragCoord.xy);\n"
+			"	vec2 uv = gl_FragCoord.xy / textureSize(color_tex, 0);\n"
+			"	vec3 sharp = texelFetch(color_tex, px, 0).rgb;\n"
+			"	float depth = texelFetch(depth_tex, px, 0).r;\n"
+			"	vec3 blurred = texture(blur_tex, uv * blur_extent).rgb;\n"
+			//Depth of field- blur when further away (or everything, when hit):
+			"	float blur_amt = max(hit_blur, dof * clamp((depth - 0.99) * 100.0, 0.0, 1.0));\n"
+			"	vec3 color = mix(sharp, blurred, blur_amt);\n"
+			"	vec2 at = uv - 0.5;\n"
+			"	if (hit_tint > 0.0) {\n"
+			//make red tint more near the edges and less in the middle:
+			"		float tint_col = clamp(1.0 - length(at), 0.0, 1.0);\n"
+			"		color *= vec3(1.0, tint_col, tint_col);\n"
+			"	} else if (vignette > 0.0 && depth >= 0.58) {\n" //don't vignette text
+			//Vignette effect (darken around edges)
+			"		color *= clamp(1.0 - length(at) * 0.6, 0.0, 1.0);\n"
+			"	}\n"
+			"	fragColor = vec4(color, 1.0);\n"
+			"}\n"
+		);
+		blur_extent_vec2 = glGetUniformLocation(program, "blur_extent");
+		dof_float = glGetUniformLocation(program, "dof");
+		hit_blur_float = glGetUniformLocation(program, "hit_blur");
+		hit_tint_float = glGetUniformLocation(program, "hit_tint");
+		vignette_float = glGetUniformLocation(program, "vignette");
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "color_tex"), 0);
+		glUniform1i(glGetUniformLocation(program, "depth_tex"), 1);
+		glUniform1i(glGetUniformLocation(program, "blur_tex"), 2);
+		glUseProgram(0);
+	}
+};
+static Load< CompositeProgram > composite_program(LoadTagInit, [](){
+	return new CompositeProgram();
+});
+
+//------------------------------------------------
+
+char const *PostProcess::quality_name(Quality quality) {
+	if (quality == Off) return "off";
+	if (quality == Quarter) return "quarter";
+	if (quality == Half) return "half";
+	return "unknown";
+}
+
+PostProcess::~PostProcess() {
+	for (Target *target : {&low, &low_temp}) {
+		if (target->fb) glDeleteFramebuffers(1, &target->fb);
+		if (target->tex) glDeleteTextures(1, &target->tex);
+		target->fb = target->tex = 0;
+	}
+}
+
+void PostProcess::ensure(Target &target, glm::uvec2 const &size) {
+	target.size = size;
+	if (target.tex != 0 && size.x <= target.capacity.x && size.y <= target.capacity.y) return;
+
+	//grow in 64-pixel steps (and never shrink) so window resizes rarely trigger reallocation:
+	target.capacity = glm::max(target.capacity, ((size + glm::uvec2(63)) / glm::uvec2(64)) * glm::uvec2(64));
+	reallocations += 1;
+
+	if (target.tex == 0) glGenTextures(1, &target.tex);
+	glBindTexture(GL_TEXTURE_2D, target.tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, target.capacity.x, target.capacity.y, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (target.fb == 0) glGenFramebuffers(1, &target.fb);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fb);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.tex, 0);
+	check_fb();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	GL_ERRORS();
+}
+
+void PostProcess::draw(GLuint color_tex, GLuint depth_tex, glm::uvec2 const &size, bool is_hit) {
+	//which blur (if any) is needed this frame:
+	Quality quality = (is_hit ? settings.hit_blur : settings.depth_of_field);
+
+	GLint output_fb = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &output_fb);
+
+	//(all passes write alpha = 1, so leaving blending on is harmless)
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(*post_empty_vao);
+
+	if (quality != Off) {
+		uint32_t factor = (quality == Quarter ? 4 : 2);
+		glm::uvec2 low_size = glm::max(glm::uvec2(1), size / factor);
+		ensure(low, low_size);
+		ensure(low_temp, low_size);
+
+		//downsample:
+		glBindFramebuffer(GL_FRAMEBUFFER, low.fb);
+		glViewport(0, 0, low_size.x, low_size.y);
+		glUseProgram(downsample_program->program);
+		glUniform1f(downsample_program->factor_float, float(factor));
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, color_tex);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		//blur (horizontal into temp, vertical back into low):
+		glm::vec2 texel = 1.0f / glm::vec2(low.capacity);
+		glm::vec2 uv_max = (glm::vec2(low_size) - 0.5f) * texel;
+		glUseProgram(blur_program->program);
+		glUniform2f(blur_program->uv_max_vec2, uv_max.x, uv_max.y);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, low_temp.fb);
+		glUniform2f(blur_program->direction_vec2, texel.x, 0.0f);
+		glBindTexture(GL_TEXTURE_2D, low.tex);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, low.fb);
+		glUniform2f(blur_program->direction_vec2, 0.0f, texel.y);
+		glBindTexture(GL_TEXTURE_2D, low_temp.tex);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	//composite at full resolution:
+	glBindFramebuffer(GL_FRAMEBUFFER, output_fb);
+	glViewport(0, 0, size.x, size.y);
+
+	glUseProgram(composite_program->program);
+	if (quality != Off) {
+		glm::vec2 extent = glm::vec2(low.size) / glm::vec2(low.capacity);
+		glUniform2f(composite_program->blur_extent_vec2, extent.x, extent.y);
+	} else {
+		glUniform2f(composite_program->blur_extent_vec2, 1.0f, 1.0f);
+	}
+	glUniform1f(composite_program->dof_float, (!is_hit && quality != Off) ? 1.0f : 0.0f);
+	glUniform1f(composite_program->hit_blur_float, (is_hit && quality != Off) ? 1.0f : 0.0f);
+	glUniform1f(composite_program->hit_tint_float, (is_hit && settings.hit_tint) ? 1.0f : 0.0f);
+	glUniform1f(composite_program->vignette_float, settings.vignette ? 1.0f : 0.0f);
+
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, (quality != Off ? low.tex : color_tex));
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, depth_tex);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, color_tex);
+
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	//clean up:
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindVertexArray(0);
+	glUseProgram(0);
+	glEnable(GL_DEPTH_TEST);
+
+	GL_ERRORS();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "GL.hpp"
+
+#include <glm/glm.hpp>
+
+//"PostProcess" runs the full-screen effects (depth-of-field, hit blur + tint, vignette):
+// - blurs are computed on a half- or quarter-resolution copy of the scene with a separable gaussian
+// - a single full-resolution composite pass mixes the sharp and blurred images
+// - low-resolution targets only grow (never shrink), so they are reused across frames and most resizes
+struct PostProcess {
+	PostProcess() = default;
+	~PostProcess();
+	PostProcess(PostProcess const &) = delete;
+	PostProcess &operator=(PostProcess const &) = delete;
+
+	//resolution used for each blur effect:
+	enum Quality : uint32_t {
+		Off = 0,
+		Quarter = 1,
+		Half = 2,
+		QualityCount //count of qualities
+	};
+	static char const *quality_name(Quality quality);
+
+	struct Settings {
+		Quality depth_of_field = Half; //blur distant geometry
+		Quality hit_blur = Half; //blur whole screen while stunned
+		bool hit_tint = true; //red edges while stunned
+		bool vignette = true; //darken edges
+	} settings;
+
+	//run the effects, reading from resolved (non-multisampled) color + depth textures of 'size',
+	// and writing to the currently bound framebuffer:
+	void draw(GLuint color_tex, GLuint depth_tex, glm::uvec2 const &size, bool is_hit);
+
+	//internals:
+	struct Target {
+		glm::uvec2 size = glm::uvec2(0); //region currently in use
+		glm::uvec2 capacity = glm::uvec2(0); //allocated texture size
+		GLuint tex = 0;
+		GLuint fb = 0;
+	};
+	Target low; //downsampled scene; also final blur result
+	Target low_temp; //intermediate for the separable blur
+
+	//number of times a target was (re)allocated (should stay small while resizing the window):
+	uint32_t reallocations = 0;
+
+	void ensure(Target &target, glm::uvec2 const &size);
+};
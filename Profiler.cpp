@@ -0,0 +1,227 @@
+#include "Profiler.hpp"
+
+#include "GL.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cassert>
+#include <algorithm>
+
+bool Profiler::enabled = false;
+
+namespace {
+	struct Section {
+		std::string name;
+		uint32_t depth = -1U; //assigned the first time the section runs
+
+		//queries + cpu time for one frame; two of these so results can be read two frames late:
+		struct Frame {
+			std::vector< GLuint > queries; //timestamp pairs (begin, end)
+			uint32_t used = 0;
+			double cpu_ms = 0.0;
+		} frames[2];
+
+		//rolling history:
+		float cpu_history[Profiler::RollingFrames];
+		float gpu_history[Profiler::RollingFrames];
+		uint32_t cpu_count = 0;
+		uint32_t gpu_count = 0;
+		uint32_t cpu_next = 0;
+		uint32_t gpu_next = 0;
+	};
+
+	//(function-local static so that sections can be registered during static initialization)
+	std::vector< Section > &get_sections() {
+		static std::vector< Section > sections;
+		return sections;
+	}
+
+	uint32_t frame = 0; //index of current frame; buffer is (frame & 1)
+	bool in_frame = false;
+	bool buffer_valid[2] = {false, false}; //does the buffer hold a finished frame?
+	uint32_t depth = 0;
+
+	std::ofstream csv;
+	uint32_t csv_columns = 0; //number of sections listed in last header
+
+	uint64_t now_ns() {
+		return std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+	}
+
+	void push(float *history, uint32_t &count, uint32_t &next, float value) {
+		history[next] = value;
+		next = (next + 1) % Profiler::RollingFrames;
+		count = std::min< uint32_t >(count + 1, Profiler::RollingFrames);
+	}
+
+	float average(float const *history, uint32_t count) {
+		if (count == 0) return -1.0f;
+		float sum = 0.0f;
+		for (uint32_t i = 0; i < count; ++i) sum += history[i];
+		return sum / count;
+	}
+
+	//collect results from the frame that last used buffer 'b':
+	void read_back(uint32_t b, uint32_t frame_number) {
+		auto &sections = get_sections();
+
+		if (csv.is_open() && csv_columns != sections.size()) {
+			csv << "frame";
+			for (auto const &s : sections) {
+				csv << "," << s.name << " cpu ms," << s.name << " gpu ms";
+			}
+			csv << "\n";
+			csv_columns = uint32_t(sections.size());
+		}
+		if (csv.is_open()) csv << frame_number;
+
+		for (auto &s : sections) {
+			Section::Frame &f = s.frames[b];
+			assert(f.used % 2 == 0);
+
+			float gpu_ms = 0.0f;
+			bool gpu_ok = true;
+			if (f.used > 0) {
+				//if the final timestamp is ready, all of the earlier ones are too:
+				GLint available = 0;
+				glGetQueryObjectiv(f.queries[f.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+				if (available) {
+					uint64_t total = 0;
+					for (uint32_t i = 0; i + 1 < f.used; i += 2) {
+						GLuint64 begin = 0, end = 0;
+						glGetQueryObjectui64v(f.queries[i], GL_QUERY_RESULT, &begin);
+						glGetQueryObjectui64v(f.queries[i + 1], GL_QUERY_RESULT, &end);
+						total += end - begin;
+					}
+					gpu_ms = float(total / 1.0e6);
+				} else {
+					gpu_ok = false;
+				}
+			}
+
+			push(s.cpu_history, s.cpu_count, s.cpu_next, float(f.cpu_ms));
+			if (gpu_ok) push(s.gpu_history, s.gpu_count, s.gpu_next, gpu_ms);
+
+			if (csv.is_open()) {
+				csv << "," << f.cpu_ms << ",";
+				if (gpu_ok) csv << gpu_ms;
+			}
+
+			f.used = 0;
+			f.cpu_ms = 0.0;
+		}
+
+		if (csv.is_open()) csv << "\n";
+	}
+}
+
+void Profiler::begin_frame() {
+	if (!enabled) {
+		buffer_valid[0] = buffer_valid[1] = false;
+		return;
+	}
+	assert(!in_frame && "begin_frame called twice without end_frame");
+
+	frame += 1;
+	uint32_t b = frame & 1;
+	//this buffer was last filled two frames ago; its results should be ready without stalling:
+	if (buffer_valid[b]) {
+		read_back(b, frame - 2);
+	} else {
+		for (auto &s : get_sections()) {
+			s.frames[b].used = 0;
+			s.frames[b].cpu_ms = 0.0;
+		}
+	}
+	buffer_valid[b] = false;
+
+	in_frame = true;
+	depth = 0;
+}
+
+void Profiler::end_frame() {
+	if (!in_frame) return;
+	buffer_valid[frame & 1] = true;
+	in_frame = false;
+}
+
+uint32_t Profiler::section(char const *name) {
+	auto &sections = get_sections();
+	for (uint32_t i = 0; i < sections.size(); ++i) {
+		if (sections[i].name == name) return i;
+	}
+	sections.emplace_back();
+	sections.back().name = name;
+	return uint32_t(sections.size() - 1);
+}
+
+Profiler::Scope::Scope(uint32_t section_) : section(section_), active(enabled && in_frame), cpu_start(0) {
+	if (!active) return;
+	Section &s = get_sections()[section];
+	if (s.depth == -1U) s.depth = depth;
+	depth += 1;
+
+	Section::Frame &f = s.frames[frame & 1];
+	if (f.used + 2 > f.queries.size()) {
+		f.queries.resize(f.used + 2, 0);
+		glGenQueries(2, &f.queries[f.used]);
+	}
+	glQueryCounter(f.queries[f.used], GL_TIMESTAMP);
+	f.used += 1;
+
+	cpu_start = now_ns();
+}
+
+Profiler::Scope::~Scope() {
+	if (!active) return;
+	//(a frame may have ended inside the scope, e.g. if end_frame() was called early; just drop the sample)
+	if (!in_frame) return;
+	Section &s = get_sections()[section];
+	Section::Frame &f = s.frames[frame & 1];
+	assert(f.used < f.queries.size());
+	glQueryCounter(f.queries[f.used], GL_TIMESTAMP);
+	f.used += 1;
+	f.cpu_ms += (now_ns() - cpu_start) / 1.0e6;
+	depth -= 1;
+}
+
+std::vector< Profiler::Average > Profiler::averages() {
+	std::vector< Average > ret;
+	for (auto const &s : get_sections()) {
+		if (s.depth == -1U) continue; //never ran
+		Average a;
+		a.name = s.name;
+		a.depth = s.depth;
+		a.cpu_ms = average(s.cpu_history, s.cpu_count);
+		a.gpu_ms = average(s.gpu_history, s.gpu_count);
+		ret.emplace_back(a);
+	}
+	return ret;
+}
+
+std::vector< std::string > Profiler::report() {
+	std::vector< std::string > ret;
+	ret.emplace_back("SECTION  CPU MS  GPU MS");
+	for (auto const &a : averages()) {
+		std::ostringstream line;
+		line << std::string(2 * a.depth, ' ') << a.name << "  ";
+		line << std::fixed << std::setprecision(2) << std::max(0.0f, a.cpu_ms) << "  ";
+		if (a.gpu_ms < 0.0f) line << "*"; //(no '-' glyph in the menu font)
+		else line << std::fixed << std::setprecision(2) << a.gpu_ms;
+		ret.emplace_back(line.str());
+	}
+	return ret;
+}
+
+void Profiler::log_csv(std::string const &filename) {
+	if (csv.is_open()) csv.close();
+	csv_columns = 0;
+	if (filename.empty()) return;
+	csv.open(filename);
+	if (!csv.is_open()) {
+		std::cerr << "WARNING: failed to open '" << filename << "' for profiler output." << std::endl;
+	}
+}
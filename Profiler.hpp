@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//"Profiler" measures named sections of each frame on both the CPU and the GPU:
+// - GPU times come from timestamp queries and are read back two frames late (from a two-entry ring, at the start of the frame that reuses the entry), so reading never stalls
+// - CPU times come from std::chrono::high_resolution_clock
+// - sections may nest and may run several times per frame (times are summed per frame)
+// - each section keeps a rolling average over the last RollingFrames frames
+//
+//Usage:
+//  Profiler::enabled = true;
+//  //once per frame:
+//  Profiler::begin_frame();
+//  { PROFILE_SCOPE("scene"); scene->draw(camera); }
+//  Profiler::end_frame();
+namespace Profiler {
+
+	//when disabled, scopes only cost a branch:
+	extern bool enabled;
+
+	enum : uint32_t { RollingFrames = 60 };
+
+	//call at the start/end of each rendered frame:
+	void begin_frame();
+	void end_frame();
+
+	//register a section (done once per PROFILE_SCOPE call site); returns a section index:
+	uint32_t section(char const *name);
+
+	//times a section from construction to destruction:
+	struct Scope {
+		Scope(uint32_t section);
+		~Scope();
+		Scope(Scope const &) = delete;
+		Scope &operator=(Scope const &) = delete;
+		uint32_t section;
+		bool active;
+		uint64_t cpu_start; //nanoseconds
+	};
+
+	//rolling averages, in milliseconds, one entry per section in registration order:
+	struct Average {
+		std::string name;
+		uint32_t depth; //nesting depth (for indenting)
+		float cpu_ms;
+		float gpu_ms; //negative if no GPU results yet
+	};
+	std::vector< Average > averages();
+
+	//one formatted line per section, e.g. for drawing with draw_text:
+	// (section names should stick to characters the menu font has -- letters, digits, and ':;,.')
+	std::vector< std::string > report();
+
+	//start appending one row per frame (frame, then cpu/gpu ms per section) to a CSV file;
+	// an empty filename stops logging:
+	void log_csv(std::string const &filename);
+}
+
+#define PROFILE_CONCAT2(A, B) A ## B
+#define PROFILE_CONCAT(A, B) PROFILE_CONCAT2(A, B)
+#define PROFILE_SCOPE(NAME) \
+	static uint32_t const PROFILE_CONCAT(profile_section_, __LINE__) = Profiler::section(NAME); \
+	Profiler::Scope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_section_, __LINE__))
@@ -0,0 +1,157 @@
+#include "Recording.hpp"
+
+#include "GameState.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+
+static constexpr uint32_t RecordingVersion = 1;
+
+//------ hashing ------
+
+namespace {
+	//FNV-1a, fed field-by-field (so struct padding never gets hashed):
+	struct Hasher {
+		uint64_t value = 0xcbf29ce484222325ULL;
+		void add_raw(void const *data, size_t size) {
+			uint8_t const *bytes = reinterpret_cast< uint8_t const * >(data);
+			for (size_t i = 0; i < size; ++i) {
+				value = (value ^ bytes[i]) * 0x100000001b3ULL;
+			}
+		}
+		template< typename T >
+		void add(T const &t) {
+			add_raw(&t, sizeof(T));
+		}
+	};
+}
+
+uint64_t hash_state(GameState const &state) {
+	Hasher hasher;
+	hasher.add(state.player_count);
+	for (uint32_t team = 0; team < GameState::num_teams; ++team) {
+		hasher.add(state.current_points[team]);
+		hasher.add(state.treasures[team].position);
+		hasher.add(state.treasures[team].rotation);
+		hasher.add(state.treasures[team].held_by);
+	}
+
+	//(unordered_map order isn't meaningful, so visit players by id)
+	std::vector< uint32_t > ids;
+	ids.reserve(state.players.size());
+	for (auto const &pair : state.players) {
+		ids.emplace_back(pair.first);
+	}
+	std::sort(ids.begin(), ids.end());
+	for (uint32_t id : ids) {
+		Player const &player = state.players.at(id);
+		hasher.add(id);
+		hasher.add(player.position);
+		hasher.add(player.velocity);
+		hasher.add(player.rotation);
+		hasher.add(player.team);
+		hasher.add(player.has_treasure_1);
+		hasher.add(player.has_treasure_2);
+		hasher.add(player.is_shot);
+		auto harpoon = state.harpoons.find(id);
+		if (harpoon != state.harpoons.end()) {
+			hasher.add(harpoon->second.state);
+			hasher.add(harpoon->second.position);
+			hasher.add(harpoon->second.rotation);
+			hasher.add(harpoon->second.velocity);
+		}
+	}
+	return hasher.value;
+}
+
+//------ writing ------
+
+RecordingWriter::RecordingWriter(std::string const &filename_, GameState const &initial) : filename(filename_) {
+	out.open(filename, std::ios::binary);
+	if (!out) throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+	uint64_t hash = hash_state(initial);
+	out.write("ppr0", 4);
+	out.write(reinterpret_cast< char const * >(&RecordingVersion), sizeof(RecordingVersion));
+	out.write(reinterpret_cast< char const * >(&hash), sizeof(hash));
+	out.flush();
+}
+
+void RecordingWriter::add_player(uint32_t id, uint32_t team, std::string const &nickname) {
+	std::string padded = nickname;
+	padded.resize(Player::NICKNAME_LENGTH, ' ');
+	out.put(Recording::Event::AddPlayer);
+	out.write(reinterpret_cast< char const * >(&id), sizeof(id));
+	out.write(reinterpret_cast< char const * >(&team), sizeof(team));
+	out.write(padded.data(), Player::NICKNAME_LENGTH);
+}
+
+void RecordingWriter::player_message(uint32_t id, char const *data) {
+	out.put(Recording::Event::PlayerMessage);
+	out.write(reinterpret_cast< char const * >(&id), sizeof(id));
+	out.write(data, GameState::player_message_size);
+}
+
+void RecordingWriter::update(float elapsed, GameState const &state) {
+	if (!out.is_open()) return;
+	uint64_t hash = hash_state(state);
+	out.put(Recording::Event::Update);
+	out.write(reinterpret_cast< char const * >(&elapsed), sizeof(elapsed));
+	out.write(reinterpret_cast< char const * >(&hash), sizeof(hash));
+	out.flush();
+	if (!out) {
+		std::cerr << "WARNING: failed to write to recording '" << filename << "'; recording stopped." << std::endl;
+		out.close(); //(later writes are no-ops)
+	}
+}
+
+//------ reading ------
+
+Recording::Recording(std::string const &filename) : file(filename) {
+	char const *at = reinterpret_cast< char const * >(file.bytes);
+	char const *end = at + file.size;
+
+	auto read = [&](void *dest, size_t size) {
+		if (size_t(end - at) < size) return false;
+		memcpy(dest, at, size);
+		at += size;
+		return true;
+	};
+
+	char magic[4];
+	uint32_t version = 0;
+	if (!read(magic, 4) || std::string(magic, 4) != "ppr0" || !read(&version, sizeof(version)) || !read(&initial_hash, sizeof(initial_hash))) {
+		throw std::runtime_error("'" + filename + "' isn't a recording.");
+	}
+	if (version != RecordingVersion) {
+		throw std::runtime_error("'" + filename + "' is a version " + std::to_string(version) + " recording; expected version " + std::to_string(RecordingVersion) + ".");
+	}
+
+	while (at < end) {
+		char const *event_begin = at;
+		Event event;
+		event.type = Event::Type(*at);
+		at += 1;
+		bool complete = false;
+		if (event.type == Event::AddPlayer) {
+			complete = read(&event.id, sizeof(event.id)) && read(&event.team, sizeof(event.team)) && size_t(end - at) >= size_t(Player::NICKNAME_LENGTH);
+			event.data = at;
+			if (complete) at += Player::NICKNAME_LENGTH;
+		} else if (event.type == Event::PlayerMessage) {
+			complete = read(&event.id, sizeof(event.id)) && size_t(end - at) >= GameState::player_message_size;
+			event.data = at;
+			if (complete) at += GameState::player_message_size;
+		} else if (event.type == Event::Update) {
+			complete = read(&event.elapsed, sizeof(event.elapsed)) && read(&event.hash, sizeof(event.hash));
+			if (complete) updates += 1;
+		} else {
+			throw std::runtime_error("'" + filename + "' has an unknown event type at byte " + std::to_string(event_begin - reinterpret_cast< char const * >(file.bytes)) + ".");
+		}
+		if (!complete) {
+			std::cerr << "WARNING: recording '" << filename << "' ends with a truncated event; ignoring it." << std::endl;
+			break;
+		}
+		events.emplace_back(event);
+	}
+}
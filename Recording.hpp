@@ -0,0 +1,61 @@
+#pragma once
+
+#include "MappedFile.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct GameState;
+
+//A "recording" logs everything the server's simulation was fed, so a match can be replayed without networking (see replay.cpp):
+// - a hash of the freshly-constructed GameState (so replay can tell if the level data differs)
+// - the players added when the game started
+// - every player message, in the order the server applied it
+// - every GameState::update, with its elapsed time and a hash of the resulting state
+//
+//File layout: "ppr0", uint32 version, uint64 initial hash, then a stream of events (a type byte + fixed-size payload):
+// 'a' add player: uint32 id, uint32 team, Player::NICKNAME_LENGTH chars
+// 'p' player message: uint32 id, GameState::player_message_size bytes
+// 'u' update: float elapsed, uint64 hash (of the state after the update)
+//Events are appended (and flushed every update) as they happen, so a server that crashes still leaves a usable log.
+
+//hash of the replicated parts of a GameState (players, harpoons, treasures, points):
+uint64_t hash_state(GameState const &state);
+
+struct RecordingWriter {
+	//note: will throw if file can't be opened
+	RecordingWriter(std::string const &filename, GameState const &initial);
+
+	void add_player(uint32_t id, uint32_t team, std::string const &nickname);
+	void player_message(uint32_t id, char const *data); //(GameState::player_message_size bytes)
+	void update(float elapsed, GameState const &state);
+
+	std::string filename;
+	std::ofstream out;
+};
+
+struct Recording {
+	//note: will throw if file can't be opened or isn't a recording; warns (and stops reading) if the last event is truncated
+	Recording(std::string const &filename);
+
+	uint64_t initial_hash = 0;
+
+	struct Event {
+		enum Type : char {
+			AddPlayer = 'a',
+			PlayerMessage = 'p',
+			Update = 'u',
+		} type;
+		uint32_t id = 0; //(AddPlayer, PlayerMessage)
+		uint32_t team = 0; //(AddPlayer)
+		float elapsed = 0.0f; //(Update)
+		uint64_t hash = 0; //(Update)
+		char const *data = nullptr; //nickname (AddPlayer) or message (PlayerMessage); points into 'file'
+	};
+	std::vector< Event > events;
+	uint32_t updates = 0; //number of Update events
+
+	MappedFile file;
+};
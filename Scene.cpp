@@ -1,5 +1,6 @@
 #include "Scene.hpp"
-#include "read_chunk.hpp"
+#include "ChunkFile.hpp"
+#include "Profiler.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -10,6 +11,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cmath>
 
 glm::mat4 Scene::Transform::make_local_to_parent() const {
 	return glm::mat4( //translate
@@ -132,8 +135,8 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 //templated helper functions to avoid having to write the same new/delete code three times:
 template< typename T, typename... Args >
-T *list_new(T * &first, Args&&... args) {
-	T *t = new T(std::forward< Args >(args)...); //"perfect forwarding"
+T *list_new(Pool< T > &pool, T * &first, Args&&... args) {
+	T *t = pool.alloc(std::forward< Args >(args)...); //"perfect forwarding"
 	if (first) {
 		t->alloc_next = first;
 		first->alloc_prev_next = &t->alloc_next;
@@ -144,7 +147,7 @@ T *list_new(T * &first, Args&&... args) {
 }
 
 template< typename T >
-void list_delete(T * t) {
+void list_delete(Pool< T > &pool, T * t) {
 	assert(t && "It is invalid to delete a null scene object [yes this is different than 'delete']");
 	assert(t->alloc_prev_next);
 	if (t->alloc_next) {
@@ -154,41 +157,49 @@ void list_delete(T * t) {
 	//PARANOIA:
 	t->alloc_next = nullptr;
 	t->alloc_prev_next = nullptr;
+	pool.free(t);
 }
 
 Scene::Transform *Scene::new_transform() {
-	return list_new< Scene::Transform >(first_transform);
+	return list_new< Scene::Transform >(transforms, first_transform);
 }
 
 void Scene::delete_transform(Scene::Transform *transform) {
-	list_delete< Scene::Transform >(transform);
+	list_delete< Scene::Transform >(transforms, transform);
 }
 
 Scene::Object *Scene::new_object(Scene::Transform *transform) {
 	assert(transform && "Scene::Object must be attached to a transform.");
-	return list_new< Scene::Object >(first_object, transform);
+	return list_new< Scene::Object >(objects, first_object, transform);
 }
 
 void Scene::delete_object(Scene::Object *object) {
-	list_delete< Scene::Object >(object);
+	list_delete< Scene::Object >(objects, object);
 }
 
 Scene::Lamp *Scene::new_lamp(Scene::Transform *transform) {
 	assert(transform && "Scene::Lamp must be attached to a transform.");
-	return list_new< Scene::Lamp >(first_lamp, transform);
+	return list_new< Scene::Lamp >(lamps, first_lamp, transform);
 }
 
 void Scene::delete_lamp(Scene::Lamp *object) {
-	list_delete< Scene::Lamp >(object);
+	list_delete< Scene::Lamp >(lamps, object);
 }
 
 Scene::Camera *Scene::new_camera(Scene::Transform *transform) {
 	assert(transform && "Scene::Camera must be attached to a transform.");
-	return list_new< Scene::Camera >(first_camera, transform);
+	return list_new< Scene::Camera >(cameras, first_camera, transform);
 }
 
 void Scene::delete_camera(Scene::Camera *object) {
-	list_delete< Scene::Camera >(object);
+	list_delete< Scene::Camera >(cameras, object);
+}
+
+void Scene::reserve(uint32_t transform_count, uint32_t object_count, uint32_t lamp_count, uint32_t camera_count) {
+	transforms.reserve(transform_count);
+	objects.reserve(object_count);
+	lamps.reserve(lamp_count);
+	cameras.reserve(camera_count);
 }
 
 void Scene::draw(Scene::Camera const *camera, Object::ProgramType program_type) const {
@@ -212,82 +223,138 @@ void Scene::draw(Scene::Lamp const *lamp, Object::ProgramType program_type) cons
 }
 
 
-void Scene::draw(glm::mat4 const &world_to_clip, Object::ProgramType program_type) const {
-	assert(program_type < Object::ProgramTypes);
+void Scene::update_lods(Camera const *camera, float hysteresis) {
+	assert(camera);
+	glm::vec3 eye = glm::vec3(camera->transform->make_local_to_world()[3]);
+	//screen height covered by a sphere of radius 1 at distance 1:
+	float scale = 1.0f / std::tan(0.5f * camera->fovy);
 
-	for (Scene::Object *object = first_object; object != nullptr; object = object->alloc_next) {
+	for (Object &object : objects) {
+		if (object.lod_count == 0) continue;
+		assert(object.lod_count <= Object::MaxLODs);
 
-		//don't draw if no program of this type attached to object:
-		if (object->programs[program_type].program == 0) continue;
+		glm::mat4 local_to_world = object.transform->make_local_to_world();
+		glm::vec3 center = glm::vec3(local_to_world * glm::vec4(object.bounds_center, 1.0f));
+		float radius = object.bounds_radius * std::sqrt(std::max(glm::dot(local_to_world[0], local_to_world[0]),
+			std::max(glm::dot(local_to_world[1], local_to_world[1]), glm::dot(local_to_world[2], local_to_world[2]))));
 
-		glm::mat4 local_to_world = object->transform->make_local_to_world();
+		float distance = glm::length(center - eye);
+		if (distance <= radius) {
+			object.lod = 0;
+			continue;
+		}
+		float size = radius / distance * scale;
 
-		//compute modelview+projection (object space to clip space) matrix for this object:
-		glm::mat4 mvp = world_to_clip * local_to_world;
+		uint32_t level = std::min(object.lod, object.lod_count);
+		while (level < object.lod_count && size < object.lods[level].screen_size * (1.0f - hysteresis)) ++level;
+		while (level > 0 && size > object.lods[level - 1].screen_size * (1.0f + hysteresis)) --level;
+		object.lod = level;
+	}
+}
 
-		//compute modelview (object space to camera local space) matrix for this object:
-		glm::mat4 mv = local_to_world;
+//shared by the draw() functions; sets up uniforms/textures and draws a single object:
+static void draw_object(Scene::Object const &object, glm::mat4 const &world_to_clip, Scene::Object::ProgramType program_type) {
+	//don't draw if no program of this type attached to object:
+	if (object.programs[program_type].program == 0) return;
 
-		//NOTE: inverse cancels out transpose unless there is scale involved
-		glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+	glm::mat4 local_to_world = object.transform->make_local_to_world();
 
-		//set up program uniforms:
-		Object::ProgramInfo const &info = object->programs[program_type];
-		glUseProgram(info.program);
-		if (info.mvp_mat4 != -1U) {
-			glUniformMatrix4fv(info.mvp_mat4, 1, GL_FALSE, glm::value_ptr(mvp));
-		}
-		if (info.mv_mat4 != -1U) {
-			glUniformMatrix4fv(info.mv_mat4, 1, GL_FALSE, glm::value_ptr(mv));
-		}
-		if (info.itmv_mat3 != -1U) {
-			glUniformMatrix3fv(info.itmv_mat3, 1, GL_FALSE, glm::value_ptr(itmv));
-		}
+	//compute modelview+projection (object space to clip space) matrix for this object:
+	glm::mat4 mvp = world_to_clip * local_to_world;
 
-		if (info.set_uniforms) info.set_uniforms();
+	//compute modelview (object space to camera local space) matrix for this object:
+	glm::mat4 mv = local_to_world;
 
-		//set up program textures:
-		for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
-			if (info.textures[i] != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(GL_TEXTURE_2D, info.textures[i]);
-			}
+	//NOTE: inverse cancels out transpose unless there is scale involved
+	glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+
+	//set up program uniforms:
+	Scene::Object::ProgramInfo const &info = object.programs[program_type];
+	glUseProgram(info.program);
+	if (info.mvp_mat4 != -1U) {
+		glUniformMatrix4fv(info.mvp_mat4, 1, GL_FALSE, glm::value_ptr(mvp));
+	}
+	if (info.mv_mat4 != -1U) {
+		glUniformMatrix4fv(info.mv_mat4, 1, GL_FALSE, glm::value_ptr(mv));
+	}
+	if (info.itmv_mat3 != -1U) {
+		glUniformMatrix3fv(info.itmv_mat3, 1, GL_FALSE, glm::value_ptr(itmv));
+	}
+
+	if (info.set_uniforms) info.set_uniforms();
+
+	//set up program textures:
+	for (uint32_t i = 0; i < Scene::Object::ProgramInfo::TextureCount; ++i) {
+		if (info.textures[i] != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, info.textures[i]);
 		}
+	}
 
-		glBindVertexArray(info.vao);
+	glBindVertexArray(info.vao);
 
-		//draw the object:
+	//draw the object (at its current level of detail):
+	if (object.lod > 0) {
+		assert(object.lod <= object.lod_count);
+		Scene::Object::LOD const &lod = object.lods[object.lod - 1];
+		glDrawArrays(GL_TRIANGLES, lod.start, lod.count);
+	} else {
 		glDrawArrays(GL_TRIANGLES, info.start, info.count);
 	}
+}
 
-	//unbind any still bound textures and go back to active texture unit zero:
-	for (uint32_t i = 0; i < Object::ProgramInfo::TextureCount; ++i) {
+//unbind any still bound textures and go back to active texture unit zero:
+static void unbind_object_textures() {
+	for (uint32_t i = 0; i < Scene::Object::ProgramInfo::TextureCount; ++i) {
 		glActiveTexture(GL_TEXTURE0 + i);
 		glBindTexture(GL_TEXTURE_2D, 0);
 	}
 	glActiveTexture(GL_TEXTURE0);
 }
 
+void Scene::draw(glm::mat4 const &world_to_clip, Object::ProgramType program_type) const {
+	assert(program_type < Object::ProgramTypes);
+	PROFILE_SCOPE("Scene::draw");
 
-Scene::~Scene() {
-	while (first_camera) {
-		delete_camera(first_camera);
-	}
-	while (first_object) {
-		delete_object(first_object);
+	//walk the object pool directly (rather than the alloc list) so objects are visited in memory order:
+	for (Scene::Object const &object : objects) {
+		draw_object(object, world_to_clip, program_type);
 	}
-	while (first_transform) {
-		delete_transform(first_transform);
+
+	unbind_object_textures();
+}
+
+void Scene::draw(std::vector< Object const * > const &list, glm::mat4 const &world_to_clip, Object::ProgramType program_type) const {
+	assert(program_type < Object::ProgramTypes);
+	PROFILE_SCOPE("Scene::draw");
+
+	for (Scene::Object const *object : list) {
+		assert(object);
+		draw_object(*object, world_to_clip, program_type);
 	}
+
+	unbind_object_textures();
+}
+
+
+Scene::~Scene() {
+	//attachments first, since they point at transforms:
+	cameras.clear();
+	lamps.clear();
+	objects.clear();
+	transforms.clear();
+	first_camera = nullptr;
+	first_lamp = nullptr;
+	first_object = nullptr;
+	first_transform = nullptr;
 }
 
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_object) {
 
-	std::ifstream file(filename, std::ios::binary);
+	ChunkFile file(filename);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	ChunkFile::Span< char > names = file.read< char >("str0");
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -298,8 +365,7 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	ChunkFile::Span< HierarchyEntry > hierarchy = file.read< HierarchyEntry >("xfh0");
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -307,8 +373,7 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	ChunkFile::Span< MeshEntry > meshes = file.read< MeshEntry >("msh0");
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -317,8 +382,7 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
+	ChunkFile::Span< CameraEntry > cameras = file.read< CameraEntry >("cam0");
 
 	struct LightEntry {
 		uint32_t transform;
@@ -329,10 +393,9 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lamps;
-	read_chunk(file, "lmp0", &lamps);
+	ChunkFile::Span< LightEntry > lamps = file.read< LightEntry >("lmp0");
 
-	if (file.peek() != EOF) {
+	if (!file.at_end()) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "GL.hpp"
+#include "Pool.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -93,6 +94,21 @@ struct Scene {
 			GLuint textures[TextureCount] = {0,0,0,0}; //textures to bind
 		} programs[ProgramTypes];
 
+		//level of detail (optional): reduced-detail vertex ranges used in place of programs[].start/count
+		// (so every program's vao must come from the same mesh file):
+		enum : uint32_t { MaxLODs = 4 };
+		struct LOD {
+			GLuint start = 0;
+			GLuint count = 0;
+			float screen_size = 0.0f; //use once the bounding sphere covers less than this fraction of the screen height
+		} lods[MaxLODs]; //each coarser than the last
+		uint32_t lod_count = 0;
+		uint32_t lod = 0; //0 is full detail, otherwise lods[lod-1]; chosen by Scene::update_lods
+
+		//object-space bounding sphere (used for picking a level of detail):
+		glm::vec3 bounds_center = glm::vec3(0.0f);
+		float bounds_radius = 0.0f;
+
 		//used by Scene to manage allocation:
 		Object **alloc_prev_next = nullptr;
 		Object *alloc_next = nullptr;
@@ -174,7 +190,16 @@ struct Scene {
 	//Delete a camera:
 	void delete_camera(Camera *);
 
-	//used to manage allocated objects:
+	//Make room for at least this many of each type without further allocation:
+	void reserve(uint32_t transform_count, uint32_t object_count, uint32_t lamp_count = 0, uint32_t camera_count = 0);
+
+	//storage for scene things (addresses are stable; iterating a pool visits live entries in memory order):
+	Pool< Transform > transforms;
+	Pool< Object > objects;
+	Pool< Lamp > lamps;
+	Pool< Camera > cameras;
+
+	//used to manage allocated objects (linked lists through the pools, kept for existing traversal code):
 	Transform *first_transform = nullptr;
 	Object *first_object = nullptr;
 	Lamp *first_lamp = nullptr;
@@ -183,6 +208,10 @@ struct Scene {
 
 	//------ functions to traverse the scene ------
 
+	//Pick a level of detail for every object with lods from its size on screen as seen from 'camera':
+	// (objects only change level once they are 'hysteresis' past a threshold, so they don't flicker at the boundary)
+	void update_lods(Camera const *camera, float hysteresis = 0.15f);
+
 	//Draw the scene from a given camera by computing appropriate matrices and sending all objects to OpenGL:
 	//"camera" must be non-null!
 	void draw(Camera const *camera, Object::ProgramType = Object::ProgramTypeDefault ) const;
@@ -194,7 +223,10 @@ struct Scene {
 	//More general draw function. Will render with a specified projection transformation and use programs in the given slot of all objects:
     void draw(glm::mat4 const &world_to_clip, Object::ProgramType program_type) const;
 
-	~Scene(); //destructor deallocates transforms, objects, cameras
+	//Draw only the listed objects (e.g., a caster list for a shadow pass) with a specified projection transformation:
+	void draw(std::vector< Object const * > const &list, glm::mat4 const &world_to_clip, Object::ProgramType program_type) const;
+
+	~Scene(); //destructor deallocates transforms, objects, lamps, cameras
 
 	//add transforms/objects/cameras from a scene file:
 	// the 'on_object' callback gives you a chance to look up a mesh by name and make an object.
@@ -0,0 +1,92 @@
+#include "SkinnedBatch.hpp"
+
+#include "bone_vertex_color_program.hpp"
+#include "gl_errors.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cassert>
+
+SkinnedBatch::SkinnedBatch(BoneAnimation const &banims_, GLuint vao_) : banims(banims_), vao(vao_) {
+	for (auto &slot : ring) {
+		glGenBuffers(1, &slot.buffer);
+		glGenTextures(1, &slot.tex);
+	}
+	GL_ERRORS();
+}
+
+SkinnedBatch::~SkinnedBatch() {
+	for (auto &slot : ring) {
+		glDeleteTextures(1, &slot.tex);
+		glDeleteBuffers(1, &slot.buffer);
+	}
+}
+
+void SkinnedBatch::clear() {
+	instances = 0;
+}
+
+void SkinnedBatch::add(glm::mat4 const &object_to_world, glm::mat4x3 const *palette, glm::vec3 const &suit_color) {
+	assert(palette);
+	size_t at = size_t(instances) * instance_stride();
+	if (staging.size() < at + instance_stride()) staging.resize(at + instance_stride());
+	glm::vec4 *out = staging.data() + at;
+
+	//(matrices are stored as rows, so each 4x3 matrix is three texels)
+	for (uint32_t r = 0; r < 3; ++r) {
+		*(out++) = glm::vec4(object_to_world[0][r], object_to_world[1][r], object_to_world[2][r], object_to_world[3][r]);
+	}
+	glm::mat3 normal_to_world = glm::inverse(glm::transpose(glm::mat3(object_to_world)));
+	for (uint32_t c = 0; c < 3; ++c) {
+		*(out++) = glm::vec4(normal_to_world[c], 0.0f);
+	}
+	*(out++) = glm::vec4(suit_color, 1.0f);
+	for (uint32_t b = 0; b < banims.bones.size(); ++b) {
+		glm::mat4x3 const &m = palette[b];
+		for (uint32_t r = 0; r < 3; ++r) {
+			*(out++) = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+		}
+	}
+	assert(out == staging.data() + at + instance_stride());
+
+	instances += 1;
+}
+
+void SkinnedBatch::draw(glm::mat4 const &world_to_clip) {
+	if (instances == 0) return;
+
+	//upload this frame's instances into the next buffer in the ring:
+	Slot &slot = ring[next_slot];
+	next_slot = (next_slot + 1) % RingSize;
+
+	size_t texels = size_t(instances) * instance_stride();
+	glBindBuffer(GL_TEXTURE_BUFFER, slot.buffer);
+	if (slot.capacity < texels) {
+		slot.capacity = std::max(texels, 2 * slot.capacity);
+		glBufferData(GL_TEXTURE_BUFFER, slot.capacity * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, slot.tex);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, slot.buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, texels * sizeof(glm::vec4), staging.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	//one draw call for all of them:
+	glUseProgram(bone_vertex_color_program->program);
+	glUniformMatrix4fv(bone_vertex_color_program->world_to_clip_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+	glUniform1i(bone_vertex_color_program->instance_stride_int, GLint(instance_stride()));
+
+	glActiveTexture(GL_TEXTURE0 + BoneVertexColorProgram::InstancesUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, slot.tex);
+
+	glBindVertexArray(vao);
+	glDrawArraysInstanced(GL_TRIANGLES, banims.mesh.start, banims.mesh.count, GLsizei(instances));
+	glBindVertexArray(0);
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glUseProgram(0);
+
+	GL_ERRORS();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "GL.hpp"
+#include "BoneAnimation.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+//"SkinnedBatch" draws every instance of one skinned mesh with a single instanced draw call:
+// - each frame, add() each instance's transform, bone palette, and suit color
+// - draw() copies them into a texture buffer, which bone_vertex_color_program reads by gl_InstanceID
+// - texture buffers are used round-robin from a small ring, so writing this frame's data doesn't wait
+//   on the GPU to finish drawing with last frame's
+struct SkinnedBatch {
+	//'vao' should link the mesh to bone_vertex_color_program:
+	SkinnedBatch(BoneAnimation const &banims, GLuint vao);
+	~SkinnedBatch();
+	SkinnedBatch(SkinnedBatch const &) = delete;
+	SkinnedBatch &operator=(SkinnedBatch const &) = delete;
+
+	BoneAnimation const &banims;
+	GLuint vao = 0;
+
+	//start a new frame's worth of instances:
+	void clear();
+
+	//add an instance ('palette' holds banims.bones.size() skinning matrices, e.g. from BoneAnimationMixer::palette()):
+	void add(glm::mat4 const &object_to_world, glm::mat4x3 const *palette, glm::vec3 const &suit_color);
+
+	//draw all instances (lighting uniforms -- see set_lighting in GameMode -- should already be set):
+	void draw(glm::mat4 const &world_to_clip);
+
+	uint32_t instances = 0;
+
+	//internals:
+	//per-instance texels: object_to_world (3 rows), normal_to_world (3 columns), suit color, then 3 rows per bone:
+	uint32_t instance_stride() const { return 7 + 3 * uint32_t(banims.bones.size()); }
+	std::vector< glm::vec4 > staging; //(only grows, so steady-state frames don't allocate)
+
+	enum : uint32_t { RingSize = 3 };
+	struct Slot {
+		GLuint buffer = 0;
+		GLuint tex = 0;
+		size_t capacity = 0; //in texels
+	} ring[RingSize];
+	uint32_t next_slot = 0;
+};
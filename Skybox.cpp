@@ -3,11 +3,11 @@
 //
 
 #include "Skybox.hpp"
-#include "load_save_png.hpp"
 #include "Load.hpp"
 #include "data_path.hpp"
 
 #include "compile_program.hpp"
+#include "Profiler.hpp"
 
 #include <array>
 
@@ -41,31 +41,29 @@ static const GLfloat skyboxVertices[108] = {
     -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, 1.0f,  1.0f,  -1.0f, -1.0f,
     1.0f, -1.0f, -1.0f, -1.0f, -1.0f, 1.0f, 1.0f, -1.0f, 1.0f};
 
-GLuint load_cube_map(std::string const &file_prefix)
+TextureData decode_cube_map(std::string const &file_prefix)
 {
     static std::array<std::string, 6> faces = {"_right", "_left", "_top", "_bottom", "_front", "_back"};
     static std::string png = ".png";
 
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    for (uint32_t i = 0; i < faces.size(); i++)
+    std::vector<std::string> pngs;
+    for (auto const &face : faces)
     {
-        glm::uvec2 size;
-        std::vector<glm::u8vec4> data;
-        load_png(file_prefix + faces[i] + png, &size, &data, UpperLeftOrigin);
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB,
-                     size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+        pngs.emplace_back(file_prefix + face + png);
     }
+    TextureOptions options;
+    options.upper_left_origin = true;
+    return decode_texture(pngs, GL_TEXTURE_CUBE_MAP, options);
+}
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+GLuint upload_cube_map(TextureData const &faces)
+{
+    return upload_texture(faces);
+}
 
-    return textureID;
+GLuint load_cube_map(std::string const &file_prefix)
+{
+    return upload_cube_map(decode_cube_map(file_prefix));
 }
 
 Skybox::SkyboxProgram::SkyboxProgram()
@@ -111,7 +109,11 @@ Load<Skybox::SkyboxProgram> skybox_program(LoadTagInit, [](){
     return new Skybox::SkyboxProgram();
 });
 
-Skybox::Skybox(std::string const &name)
+Skybox::Skybox(std::string const &name) : Skybox(load_cube_map(data_path(name)))
+{
+}
+
+Skybox::Skybox(GLuint cube_map) : skybox(cube_map)
 {
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
@@ -123,12 +125,11 @@ Skybox::Skybox(std::string const &name)
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), nullptr);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
-
-    skybox = load_cube_map(data_path(name));
 }
 
 void Skybox::draw(Scene::Camera const *camera)
 {
+    PROFILE_SCOPE("Skybox::draw");
     // Draw skybox as last
     glDepthFunc(GL_LEQUAL);  // Change depth function so depth test passes when
     // values are equal to depth buffer's content
@@ -7,9 +7,18 @@
 
 #include "GL.hpp"
 #include "Scene.hpp"
+#include "TextureCache.hpp"
 #include <glm/glm.hpp>
 #include <math.h>
 #include <iostream>
+#include <array>
+#include <vector>
+#include <string>
+
+//six faces ("_right", "_left", "_top", "_bottom", "_front", "_back") of a cube map, read through the texture cache:
+//decode doesn't use OpenGL (so may run on a loader thread); upload does:
+TextureData decode_cube_map(std::string const &file_prefix);
+GLuint upload_cube_map(TextureData const &faces);
 
 GLuint load_cube_map(std::string const &file_prefix);
 
@@ -30,6 +39,7 @@ public:
     };
 
     explicit Skybox(std::string const &name);
+    explicit Skybox(GLuint cube_map); //(takes an already-loaded cube map texture)
 
     void draw(Scene::Camera const *camera);
 
@@ -1,17 +1,99 @@
 #include "Sound.hpp"
 
+#include "AssetArchive.hpp"
+#include "MappedFile.hpp"
+
 #include <SDL.h>
 
 #include <algorithm>
 #include <iostream>
-#include <list>
 #include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOUND_SSE
+#include <emmintrin.h>
+#endif
 
 namespace Sound {
 
 Ramp< float > volume = Ramp< float >(1.0f);
 struct Listener listener;
 
+//------ streaming ------
+
+//a ".wav" file's sample data, left where it is (in the data archive, or a mapped file):
+struct StreamSource {
+	std::string filename;
+	AssetArchive::Contents archived;
+	std::unique_ptr< MappedFile > file;
+
+	uint8_t const *pcm = nullptr; //start of 'data' chunk
+	size_t frames = 0;
+	uint32_t channels = 0;
+	uint32_t rate = 0;
+	uint32_t bits = 0; //per channel value
+	bool is_float = false;
+
+	//value of frame 'f', mixed down to mono:
+	float frame(size_t f) const {
+		uint32_t bytes = bits / 8;
+		uint8_t const *at = pcm + f * channels * bytes;
+		float sum = 0.0f;
+		for (uint32_t c = 0; c < channels; ++c, at += bytes) {
+			if (is_float) {
+				float v;
+				std::memcpy(&v, at, 4);
+				sum += v;
+			} else if (bits == 8) {
+				sum += (int32_t(at[0]) - 128) / 128.0f;
+			} else if (bits == 16) {
+				int16_t v;
+				std::memcpy(&v, at, 2);
+				sum += v / 32768.0f;
+			} else if (bits == 24) {
+				int32_t v = int32_t(uint32_t(at[0]) << 8 | uint32_t(at[1]) << 16 | uint32_t(at[2]) << 24) >> 8;
+				sum += v / 8388608.0f;
+			} else {
+				int32_t v;
+				std::memcpy(&v, at, 4);
+				sum += v / 2147483648.0f;
+			}
+		}
+		return sum / channels;
+	}
+};
+
+//decoded audio for one playing streamed sample; filled by the stream thread, drained by mix_audio:
+// state goes Free -> Playing (Sample::play, game thread) -> Finished (mix_audio) -> Free (stream thread),
+// so each thread only ever touches a stream while it is in 'its' state
+struct Stream {
+	static constexpr uint32_t RingSize = 8 * MixSamples; //(power of two, so positions can wrap freely)
+	enum State : uint32_t {
+		Free,
+		Playing,
+		Finished
+	};
+	std::atomic< uint32_t > state;
+	std::atomic< uint32_t > write; //ring positions; only the stream thread advances 'write', only mix_audio advances 'read'
+	std::atomic< uint32_t > read;
+	std::atomic< bool > ended; //set (after the final write) once a non-looping source runs out
+
+	//decoder state:
+	StreamSource const *source = nullptr;
+	bool loop = false;
+	double cursor = 0.0; //position in source, in (fractional) source frames
+
+	float ring[RingSize];
+};
+constexpr uint32_t Stream::RingSize;
+
 namespace {
 //local functions + data:
 
@@ -98,8 +180,288 @@ void compute_pan_from_listener_and_position(
 	}
 }
 
-//list of all currently playing samples:
-std::list< std::shared_ptr< PlayingSample > > playing_samples;
+//streams are preallocated, so starting/finishing a streamed sample doesn't allocate:
+constexpr uint32_t MaxStreams = 4;
+Stream streams[MaxStreams];
+
+//decode + resample (linearly) into a stream's ring until it is full or the source runs out:
+// (called from the stream thread, or from Sample::play before a stream starts playing)
+void fill_stream(Stream &stream) {
+	if (stream.ended.load(std::memory_order_relaxed)) return;
+	StreamSource const &source = *stream.source;
+
+	uint32_t write = stream.write.load(std::memory_order_relaxed);
+	uint32_t read = stream.read.load(std::memory_order_acquire);
+	uint32_t space = Stream::RingSize - (write - read);
+
+	double step = double(source.rate) / double(AudioRate);
+	bool ended = false;
+	uint32_t n = 0;
+	for (; n < space; ++n) {
+		if (stream.cursor >= double(source.frames)) {
+			if (stream.loop && source.frames > 0) {
+				stream.cursor = std::fmod(stream.cursor, double(source.frames));
+			} else {
+				ended = true;
+				break;
+			}
+		}
+		size_t f = size_t(stream.cursor);
+		float amt = float(stream.cursor - double(f));
+		size_t next = f + 1;
+		if (next == source.frames) next = (stream.loop ? 0 : f);
+		stream.ring[(write + n) & (Stream::RingSize - 1)] = glm::mix(source.frame(f), source.frame(next), amt);
+		stream.cursor += step;
+	}
+	stream.write.store(write + n, std::memory_order_release);
+	if (ended) stream.ended.store(true, std::memory_order_release);
+}
+
+//decoded values that can be read from a stream without wrapping around the ring (returns how many):
+uint32_t stream_segment(Stream const &stream, float const **values) {
+	uint32_t read = stream.read.load(std::memory_order_relaxed);
+	uint32_t write = stream.write.load(std::memory_order_acquire);
+	uint32_t at = read & (Stream::RingSize - 1);
+	*values = stream.ring + at;
+	return std::min(write - read, Stream::RingSize - at);
+}
+
+//mark values as read (so the stream thread can reuse their space):
+void consume_stream(Stream &stream, uint32_t count) {
+	stream.read.store(stream.read.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+//has a stream played everything it will ever have?
+bool stream_done(Stream const &stream) {
+	if (!stream.ended.load(std::memory_order_acquire)) return false;
+	return stream.read.load(std::memory_order_relaxed) == stream.write.load(std::memory_order_relaxed);
+}
+
+//background thread that keeps playing streams' rings full:
+struct StreamThread {
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool quit = false;
+
+	void start() {
+		std::unique_lock< std::mutex > lock(mutex);
+		if (thread.joinable()) return;
+		thread = std::thread([this](){ run(); });
+	}
+
+	void run() {
+		std::unique_lock< std::mutex > lock(mutex);
+		while (!quit) {
+			lock.unlock();
+			for (auto &stream : streams) {
+				uint32_t state = stream.state.load(std::memory_order_acquire);
+				if (state == Stream::Playing) {
+					fill_stream(stream);
+				} else if (state == Stream::Finished) {
+					stream.state.store(Stream::Free, std::memory_order_release);
+				}
+			}
+			lock.lock();
+			//a ring holds several mix periods (each ~20ms), so refilling every few ms is plenty:
+			wake.wait_for(lock, std::chrono::milliseconds(5));
+		}
+	}
+
+	~StreamThread() {
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		if (thread.joinable()) thread.join();
+	}
+} stream_thread;
+
+//------ voices ------
+
+//mixer state for one playing sample; preallocated so starting and finishing samples doesn't allocate:
+struct Voice {
+	Sample const *sample = nullptr;
+	Stream *stream = nullptr; //(for streamed samples)
+	uint32_t generation = 0;
+	uint32_t i = 0; //next data value to read
+	bool active = false; //is this voice playing?
+	bool loop = false; //should playback loop after data runs out?
+	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
+	bool audible = false; //was this voice mixed last period? (otherwise it is 'virtual': only its cursor advances)
+	bool fresh = true; //has not been through a mix period yet
+
+	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(0.0f);
+	Ramp< float > volume = Ramp< float >(1.0f);
+
+	//left/right gains at start and end of the current mix period:
+	glm::vec2 start_gain = glm::vec2(0.0f);
+	glm::vec2 end_gain = glm::vec2(0.0f);
+};
+
+constexpr uint32_t MaxVoices = 64; //voices that can play at once (audible or not)
+Voice voices[MaxVoices]; //(audio thread only)
+
+//only the loudest (highest-priority) few voices are actually mixed; the rest are virtual until they become audible again:
+constexpr uint32_t MaxAudibleVoices = 16;
+constexpr float AudibleGain = 0.001f; //(-60dB) voices quieter than this are virtual no matter what
+
+//indices of active voices, so mix_audio only visits those (unordered; finished voices are swapped out):
+uint32_t active_voices[MaxVoices];
+uint32_t active_count = 0;
+
+//which voices are taken; set by Sample::play (game thread), cleared by mix_audio once a voice finishes:
+std::atomic< bool > voice_in_use[MaxVoices];
+//number of times each voice has been started (game thread only):
+uint32_t voice_generation[MaxVoices];
+//what each voice was last started with, for per-sample limits (game thread only):
+Sample const *voice_sample[MaxVoices];
+uint32_t voice_started[MaxVoices]; //(value of play_count at start, so older instances can be found)
+bool voice_released[MaxVoices]; //stop() was called (so it doesn't count against the sample's limit)
+uint32_t play_count = 0;
+
+//------ commands ------
+
+//changes from the game thread, applied by mix_audio at the start of its next mix period:
+struct Command {
+	enum Type : uint32_t {
+		Play,
+		SetPosition,
+		SetVolume,
+		Stop,
+		StopAll,
+		SetListenerPosition,
+		SetListenerRight,
+		SetMasterVolume,
+	} type = Play;
+	uint32_t voice = 0;
+	uint32_t generation = 0;
+	glm::vec3 vec = glm::vec3(0.0f); //position / direction
+	float value = 0.0f; //volume
+	float ramp = 0.0f;
+	Sample const *sample = nullptr; //(Play only)
+	Stream *stream = nullptr; //(Play only)
+	bool loop = false; //(Play only)
+};
+
+//single-producer, single-consumer queue; neither side ever waits on the other:
+template< typename T, uint32_t Size >
+struct SPSCQueue {
+	static_assert((Size & (Size - 1)) == 0, "queue size should be a power of two");
+	T items[Size];
+	std::atomic< uint32_t > head{0}; //next item to pop (only the consumer advances this)
+	std::atomic< uint32_t > tail{0}; //next item to push (only the producer advances this)
+
+	//returns false if the queue is full:
+	bool push(T const &item) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == Size) return false;
+		items[t & (Size - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	//returns false if the queue is empty:
+	bool pop(T *item) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		*item = items[h & (Size - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+SPSCQueue< Command, 1024 > commands;
+
+bool mixing = false; //is mix_audio being called? (if not, commands are dropped rather than queued forever)
+
+//queue a command; returns false if it was dropped:
+bool send(Command const &command) {
+	if (!mixing) return false;
+	if (!commands.push(command)) {
+		static bool warned = false;
+		if (!warned) {
+			std::cerr << "WARNING: Sound command queue is full; dropping commands." << std::endl;
+			warned = true;
+		}
+		return false;
+	}
+	return true;
+}
+
+void stop_voice(Voice &voice, float ramp) {
+	if (!voice.stopped) {
+		voice.stopped = true;
+		voice.volume.target = 0.0f;
+		voice.volume.ramp = ramp;
+	} else {
+		voice.volume.ramp = std::min(voice.volume.ramp, ramp);
+	}
+}
+
+//(audio thread)
+void apply(Command const &command) {
+	if (command.type == Command::Play) {
+		Voice &voice = voices[command.voice];
+		voice = Voice();
+		voice.sample = command.sample;
+		voice.stream = command.stream;
+		voice.generation = command.generation;
+		voice.loop = command.loop;
+		voice.position.set(command.vec, 0.0f);
+		voice.volume.set(command.value, 0.0f);
+		voice.active = true;
+		assert(active_count < MaxVoices);
+		active_voices[active_count++] = command.voice;
+	} else if (command.type == Command::SetPosition || command.type == Command::SetVolume || command.type == Command::Stop) {
+		Voice &voice = voices[command.voice];
+		if (!voice.active || voice.generation != command.generation) return; //(sample already finished)
+		if (command.type == Command::SetPosition) voice.position.set(command.vec, command.ramp);
+		else if (command.type == Command::SetVolume) voice.volume.set(command.value, command.ramp);
+		else stop_voice(voice, command.ramp);
+	} else if (command.type == Command::StopAll) {
+		for (uint32_t a = 0; a < active_count; ++a) {
+			stop_voice(voices[active_voices[a]], command.ramp);
+		}
+	} else if (command.type == Command::SetListenerPosition) {
+		listener.position.set(command.vec, command.ramp);
+	} else if (command.type == Command::SetListenerRight) {
+		listener.right.set(command.vec, command.ramp);
+	} else if (command.type == Command::SetMasterVolume) {
+		volume.set(command.value, command.ramp);
+	}
+}
+
+//add 'count' mono values into interleaved stereo 'out', with left/right gains of
+// (pan + (first + i) * step) for value i; segments of one mix period share 'pan' and 'step',
+// so the gains come out the same no matter where the period was split:
+void mix_block(float *out, float const *in, uint32_t count, uint32_t first, float pan_l, float pan_r, float step_l, float step_r) {
+	uint32_t i = 0;
+#ifdef SOUND_SSE
+	//two input values (four output floats) per vector, two vectors per step:
+	__m128 pan = _mm_setr_ps(pan_l, pan_r, pan_l, pan_r);
+	__m128 step = _mm_setr_ps(step_l, step_r, step_l, step_r);
+	__m128 index = _mm_setr_ps(float(first), float(first), float(first + 1), float(first + 1));
+	__m128 const two = _mm_set1_ps(2.0f);
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(in + i);
+		__m128 x01 = _mm_unpacklo_ps(x, x); //x0 x0 x1 x1
+		__m128 x23 = _mm_unpackhi_ps(x, x); //x2 x2 x3 x3
+		__m128 gain01 = _mm_add_ps(pan, _mm_mul_ps(index, step));
+		index = _mm_add_ps(index, two);
+		__m128 gain23 = _mm_add_ps(pan, _mm_mul_ps(index, step));
+		index = _mm_add_ps(index, two);
+		_mm_storeu_ps(out + 2 * i, _mm_add_ps(_mm_loadu_ps(out + 2 * i), _mm_mul_ps(x01, gain01)));
+		_mm_storeu_ps(out + 2 * i + 4, _mm_add_ps(_mm_loadu_ps(out + 2 * i + 4), _mm_mul_ps(x23, gain23)));
+	}
+#endif
+	for (; i < count; ++i) {
+		float f = float(first + i);
+		out[2 * i + 0] += in[i] * (pan_l + f * step_l);
+		out[2 * i + 1] += in[i] * (pan_r + f * step_r);
+	}
+}
 
 void mix_audio(void *, Uint8 *stream, int len) {
 	assert(stream); //should always have some audio buffer
@@ -112,13 +474,17 @@ void mix_audio(void *, Uint8 *stream, int len) {
 	assert(len == MixSamples * sizeof(LR)); //should always have the expected number of samples
 
 	LR *buffer = reinterpret_cast< LR * >(stream);
+	float *out = reinterpret_cast< float * >(stream);
 
-	//zero the output buffer:
-	for (uint32_t s = 0; s < MixSamples; ++s) {
-		buffer[s].l = 0.0f;
-		buffer[s].r = 0.0f;
+	//apply everything the game thread has asked for since the last mix:
+	Command command;
+	while (commands.pop(&command)) {
+		apply(command);
 	}
-	
+
+	//zero the output buffer:
+	std::memset(buffer, 0, MixSamples * sizeof(LR));
+
 	//Figure out global info (listener position, volume) at start and end of mix period:
 	glm::vec3 start_position = listener.position.value;
 	glm::vec3 start_right = listener.right.value;
@@ -132,68 +498,111 @@ void mix_audio(void *, Uint8 *stream, int len) {
 	glm::vec3 end_right = listener.right.value;
 	float end_volume = volume.value;
 
-	//now add audio for each playing sample:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		PlayingSample &source = **si; //iterator over shared pointers
+	//figure out each voice's panning/volume at start and end of the mix period:
+	struct Candidate {
+		uint32_t v;
+		int32_t priority;
+		float loudness;
+	};
+	Candidate candidates[MaxVoices];
+	uint32_t candidate_count = 0;
+	for (uint32_t a = 0; a < active_count; ++a) {
+		uint32_t v = active_voices[a];
+		Voice &source = voices[v];
+		assert(source.active);
 
-		//Figure out sample panning/volume at start and end of the mix period:
-		LR start_pan;
-		compute_pan_from_listener_and_position(start_position, start_right, source.position.value, &start_pan.l, &start_pan.r);
-		start_pan.l *= start_volume * source.volume.value;
-		start_pan.r *= start_volume * source.volume.value;
+		compute_pan_from_listener_and_position(start_position, start_right, source.position.value, &source.start_gain.x, &source.start_gain.y);
+		source.start_gain *= start_volume * source.volume.value;
 
 		step_position_ramp(source.position);
 		step_value_ramp(source.volume);
 
-		LR end_pan;
-		compute_pan_from_listener_and_position(end_position, end_right, source.position.value, &end_pan.l, &end_pan.r);
-		end_pan.l *= end_volume * source.volume.value;
-		end_pan.r *= end_volume * source.volume.value;
-
-		LR pan = start_pan;
-		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MixSamples;
-		pan_step.r = (end_pan.r - start_pan.r) / MixSamples;
+		compute_pan_from_listener_and_position(end_position, end_right, source.position.value, &source.end_gain.x, &source.end_gain.y);
+		source.end_gain *= end_volume * source.volume.value;
 
-		assert(source.i < source.data.size());
+		float loudness = std::max(std::max(source.start_gain.x, source.start_gain.y), std::max(source.end_gain.x, source.end_gain.y));
+		if (loudness >= AudibleGain) {
+			candidates[candidate_count++] = Candidate{v, source.sample->priority, loudness};
+		}
+	}
 
-		for (uint32_t i = 0; i < MixSamples; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * source.data[source.i];
-			buffer[i].r += pan.r * source.data[source.i];
+	//pick which voices are audible this period (highest priority first, then loudest):
+	if (candidate_count > MaxAudibleVoices) {
+		std::nth_element(candidates, candidates + MaxAudibleVoices, candidates + candidate_count, [](Candidate const &x, Candidate const &y) {
+			if (x.priority != y.priority) return x.priority > y.priority;
+			return x.loudness > y.loudness;
+		});
+		candidate_count = MaxAudibleVoices;
+	}
+	bool audible[MaxVoices] = {false};
+	for (uint32_t c = 0; c < candidate_count; ++c) {
+		audible[candidates[c].v] = true;
+	}
 
-			//update position in sample:
-			source.i += 1;
-			if (source.i == source.data.size()) {
-				if (source.loop) source.i = 0;
-				else break;
+	//now add audio for each playing sample:
+	for (uint32_t a = 0; a < active_count; /* later */) {
+		uint32_t v = active_voices[a];
+		Voice &source = voices[v];
+
+		//voices fade in over a period when they become audible and out over a period when they go virtual,
+		// so that switching doesn't click (new voices start at their real volume, though, so attacks stay sharp):
+		bool mix = audible[v] || (source.audible && !source.fresh);
+		glm::vec2 start_gain = (source.audible || source.fresh ? source.start_gain : glm::vec2(0.0f));
+		glm::vec2 end_gain = (audible[v] ? source.end_gain : glm::vec2(0.0f));
+		glm::vec2 gain_step = (end_gain - start_gain) / float(MixSamples);
+		source.audible = audible[v];
+		source.fresh = false;
+
+		//mix in contiguous runs of source data (split where a sample loops or a stream's ring wraps):
+		// (virtual voices take the same path, just without mixing)
+		bool finished = false;
+		uint32_t mixed = 0;
+		if (source.stream) {
+			//(if the stream thread fell behind, the rest of the period is silent)
+			while (mixed < MixSamples) {
+				float const *values = nullptr;
+				uint32_t count = std::min(stream_segment(*source.stream, &values), MixSamples - mixed);
+				if (count == 0) break;
+				if (mix) mix_block(out + 2 * mixed, values, count, mixed, start_gain.x, start_gain.y, gain_step.x, gain_step.y);
+				consume_stream(*source.stream, count);
+				mixed += count;
 			}
-
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+			finished = stream_done(*source.stream);
+		} else {
+			std::vector< float > const &data = source.sample->data;
+			assert(source.i < data.size());
+			while (mixed < MixSamples) {
+				uint32_t count = std::min(uint32_t(data.size()) - source.i, MixSamples - mixed);
+				if (mix) mix_block(out + 2 * mixed, data.data() + source.i, count, mixed, start_gain.x, start_gain.y, gain_step.x, gain_step.y);
+				source.i += count;
+				mixed += count;
+				if (source.i == data.size()) {
+					if (!source.loop) break;
+					source.i = 0;
+				}
+			}
+			finished = (source.i >= data.size());
 		}
 
-		if (source.i >= source.data.size() //non-looping sample has finished
+		if (finished //non-looping sample has finished
 		 || (source.stopped && source.volume.ramp == 0.0f) //sample has finished stopping
 		 ) {
 		 	source.stopped = true;
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+			source.active = false;
+			if (source.stream) {
+				//hand the stream back to the stream thread:
+				source.stream->state.store(Stream::Finished, std::memory_order_release);
+			}
+			//let Sample::play reuse the voice:
+			voice_in_use[v].store(false, std::memory_order_release);
+			//(swap the last active voice into this spot, and mix it next)
+			active_count -= 1;
+			active_voices[a] = active_voices[active_count];
 		} else {
-			++si;
+			++a;
 		}
 	}
-
-	//DEBUG: report output power:
-	float max_power = 0.0f;
-	for (uint32_t s = 0; s < MixSamples; ++s) {
-		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
-	}
-	//std::cout << "Max Power: " << std::sqrt(max_power) << std::endl; //DEBUG
-
-};
+}
 
 SDL_AudioDeviceID device = 0;
 
@@ -206,7 +615,15 @@ Sample::Sample(std::string const &filename) {
 	Uint8 *audio_buf = nullptr;
 	Uint32 audio_len = 0;
 
-	SDL_AudioSpec *have = SDL_LoadWAV(filename.c_str(), &audio_spec, &audio_buf, &audio_len);
+	//(read from the data archive, if the file is there)
+	AssetArchive::Contents archived;
+	SDL_RWops *rw = nullptr;
+	if (find_data_file(filename, &archived)) {
+		rw = SDL_RWFromConstMem(archived.data, int(archived.size));
+	} else {
+		rw = SDL_RWFromFile(filename.c_str(), "rb");
+	}
+	SDL_AudioSpec *have = SDL_LoadWAV_RW(rw, 1, &audio_spec, &audio_buf, &audio_len);
 	if (!have) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
@@ -236,57 +653,202 @@ Sample::Sample(std::string const &filename) {
 	std::cout << "Range: " << min << ", " << max << std::endl;
 }
 
+Sample::Sample(std::vector< float > const &data_) : data(data_) {
+}
+
+Sample::Sample(std::string const &filename, StreamFlag) : stream_source(new StreamSource) {
+	StreamSource &source = *stream_source;
+	source.filename = filename;
+
+	uint8_t const *bytes = nullptr;
+	size_t size = 0;
+	if (find_data_file(filename, &source.archived)) {
+		bytes = source.archived.data;
+		size = source.archived.size;
+	} else {
+		source.file.reset(new MappedFile(filename, MappedFile::Sequential));
+		bytes = source.file->bytes;
+		size = source.file->size;
+	}
+
+	//walk the RIFF chunks for the format and the data (see http://soundfile.sapp.org/doc/WaveFormat/):
+	auto u16 = [](uint8_t const *at) { uint16_t v; std::memcpy(&v, at, 2); return v; };
+	auto u32 = [](uint8_t const *at) { uint32_t v; std::memcpy(&v, at, 4); return v; };
+	if (size < 12 || std::memcmp(bytes, "RIFF", 4) != 0 || std::memcmp(bytes + 8, "WAVE", 4) != 0) {
+		throw std::runtime_error("Streamed sample '" + filename + "' isn't a WAV file.");
+	}
+	uint32_t format = 0;
+	size_t data_size = 0;
+	for (size_t at = 12; at + 8 <= size; ) {
+		uint8_t const *body = bytes + at + 8;
+		size_t length = std::min< size_t >(u32(bytes + at + 4), size - (at + 8)); //(some writers leave the size wrong)
+		if (std::memcmp(bytes + at, "fmt ", 4) == 0 && length >= 16) {
+			format = u16(body);
+			source.channels = u16(body + 2);
+			source.rate = u32(body + 4);
+			source.bits = u16(body + 14);
+			if (format == 0xfffe && length >= 26) format = u16(body + 24); //WAVE_FORMAT_EXTENSIBLE: use subformat
+		} else if (std::memcmp(bytes + at, "data", 4) == 0) {
+			source.pcm = body;
+			data_size = length;
+		}
+		at += 8 + length + (length & 1);
+	}
+	source.is_float = (format == 3);
+	if (!source.pcm || source.channels == 0 || source.rate == 0
+	 || !((format == 1 && (source.bits == 8 || source.bits == 16 || source.bits == 24 || source.bits == 32)) || (format == 3 && source.bits == 32))) {
+		throw std::runtime_error("Streamed sample '" + filename + "' isn't an 8/16/24/32-bit PCM or 32-bit float WAV file.");
+	}
+	source.frames = data_size / (source.channels * (source.bits / 8));
+
+	if (source.rate != AudioRate || source.channels != 1) {
+		std::cout << "WAV file '" + filename + "' will be streamed as " + std::to_string(AudioRate) + " Hz mono from " << source.rate << " Hz, " << source.channels << " channel(s)." << std::endl;
+	}
+
+	stream_thread.start();
+}
+
+Sample::~Sample() {
+}
+
 std::shared_ptr< PlayingSample > Sample::play(glm::vec3 const &position, float volume, LoopOrOnce loop_or_once) const {
-	lock();
-	playing_samples.emplace_back(std::make_shared< PlayingSample >(this, position, volume, loop_or_once == Loop));
-	unlock();
-	return playing_samples.back();
+	if (!mixing) {
+		return std::make_shared< PlayingSample >(-1U, 0); //(no audio output)
+	}
+
+	//find a free voice (and check this sample's limit while at it):
+	uint32_t voice = -1U;
+	uint32_t instances = 0;
+	uint32_t oldest = -1U;
+	for (uint32_t v = 0; v < MaxVoices; ++v) {
+		if (!voice_in_use[v].load(std::memory_order_acquire)) {
+			if (voice == -1U) voice = v;
+		} else if (voice_sample[v] == this && !voice_released[v]) {
+			instances += 1;
+			if (oldest == -1U || int32_t(voice_started[v] - voice_started[oldest]) < 0) oldest = v;
+		}
+	}
+	if (max_voices != 0 && instances >= max_voices) {
+		if (!replace_oldest) {
+			return std::make_shared< PlayingSample >(-1U, 0);
+		}
+		//make room by quickly fading out the oldest instance:
+		PlayingSample(oldest, voice_generation[oldest]).stop();
+	}
+	if (voice == -1U) {
+		static bool warned = false;
+		if (!warned) {
+			std::cerr << "WARNING: all " << MaxVoices << " voices are playing; not playing more." << std::endl;
+			warned = true;
+		}
+		return std::make_shared< PlayingSample >(-1U, 0);
+	}
+
+	Stream *stream = nullptr;
+	if (stream_source) {
+		//claim a stream and decode its first few mix periods here, so playback starts right away:
+		for (auto &s : streams) {
+			if (s.state.load(std::memory_order_acquire) == Stream::Free) {
+				s.source = stream_source.get();
+				s.loop = (loop_or_once == Loop);
+				s.cursor = 0.0;
+				s.read.store(0, std::memory_order_relaxed);
+				s.write.store(0, std::memory_order_relaxed);
+				s.ended.store(false, std::memory_order_relaxed);
+				fill_stream(s);
+				s.state.store(Stream::Playing, std::memory_order_release);
+				stream = &s;
+				break;
+			}
+		}
+		if (!stream) {
+			std::cerr << "WARNING: no free streams to play '" << stream_source->filename << "'." << std::endl;
+			return std::make_shared< PlayingSample >(-1U, 0);
+		}
+	}
+
+	voice_in_use[voice].store(true, std::memory_order_relaxed);
+	voice_generation[voice] += 1;
+	voice_sample[voice] = this;
+	voice_started[voice] = play_count++;
+	voice_released[voice] = false;
+
+	Command command;
+	command.type = Command::Play;
+	command.voice = voice;
+	command.generation = voice_generation[voice];
+	command.vec = position;
+	command.value = volume;
+	command.sample = this;
+	command.stream = stream;
+	command.loop = (loop_or_once == Loop);
+	if (!send(command)) {
+		voice_in_use[voice].store(false, std::memory_order_relaxed);
+		if (stream) stream->state.store(Stream::Finished, std::memory_order_release);
+		return std::make_shared< PlayingSample >(-1U, 0);
+	}
+
+	return std::make_shared< PlayingSample >(voice, voice_generation[voice]);
 }
 
 
 //------------------
 
 void PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	lock();
-	position.set(new_position, ramp);
-	unlock();
+	if (voice == -1U) return;
+	Command command;
+	command.type = Command::SetPosition;
+	command.voice = voice;
+	command.generation = generation;
+	command.vec = new_position;
+	command.ramp = ramp;
+	send(command);
 }
 
 void PlayingSample::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	if (voice == -1U) return;
+	Command command;
+	command.type = Command::SetVolume;
+	command.voice = voice;
+	command.generation = generation;
+	command.value = new_volume;
+	command.ramp = ramp;
+	send(command);
 }
 
 void PlayingSample::stop(float ramp) {
-	lock();
-	if (!stopped) {
-		stopped = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	unlock();
+	if (voice == -1U) return;
+	stopped = true;
+	if (voice_generation[voice] == generation) voice_released[voice] = true;
+	Command command;
+	command.type = Command::Stop;
+	command.voice = voice;
+	command.generation = generation;
+	command.ramp = ramp;
+	send(command);
 }
 
 //------------------
 
 void Listener::set_position(glm::vec3 const &new_position, float ramp) {
-	lock();
-	position.set(new_position, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetListenerPosition;
+	command.vec = new_position;
+	command.ramp = ramp;
+	send(command);
 }
 
 void Listener::set_right(glm::vec3 const &new_right, float ramp) {
-	lock();
+	Command command;
+	command.type = Command::SetListenerRight;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.vec = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.vec = glm::normalize(new_right);
 	}
-	unlock();
+	command.ramp = ramp;
+	send(command);
 }
 
 //------------------
@@ -311,11 +873,21 @@ void init() {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
 	} else {
 		//start audio playback:
+		mixing = true;
 		SDL_PauseAudioDevice(device, 0);
 		std::cout << "Audio output initialized." << std::endl;
 	}
 }
 
+void init_offline() {
+	mixing = true;
+}
+
+void render(float *out) {
+	assert(mixing && !device); //(only for offline rendering)
+	mix_audio(nullptr, reinterpret_cast< Uint8 * >(out), int(MixSamples * 2 * sizeof(float)));
+}
+
 void lock() {
 	if (device) SDL_LockAudioDevice(device);
 }
@@ -325,17 +897,18 @@ void unlock() {
 }
 
 void stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
-	}
-	unlock();
+	Command command;
+	command.type = Command::StopAll;
+	command.ramp = 1.0f / 60.0f;
+	send(command);
 }
 
 void set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetMasterVolume;
+	command.value = new_volume;
+	command.ramp = ramp;
+	send(command);
 }
 
 } //namespace Sound
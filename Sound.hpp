@@ -10,6 +10,8 @@
 namespace Sound {
 
 struct PlayingSample;
+struct StreamSource;
+struct Stream;
 
 enum LoopOrOnce {
 	Once,
@@ -23,15 +25,37 @@ struct Sample {
 	// will warn and perform not-very-good interpolation if file is not Sound::AudioRate
 	Sample(std::string const &filename);
 
+	//...or from values that are already mono and at Sound::AudioRate (e.g. synthesized):
+	Sample(std::vector< float > const &data);
+
+	//...or keep the file mapped and decode it a chunk at a time while playing:
+	// (for long music tracks; memory use stays flat no matter the track length)
+	// at most a few streamed samples can play at once, and a streamed Sample must outlive its playback
+	// will throw if the file isn't a PCM or float ".wav"
+	enum StreamFlag { Streamed };
+	Sample(std::string const &filename, StreamFlag);
+	~Sample();
+
 	//start playing an instance of this sample at a given initial position and volume:
 	// the returned 'PlayingSample' handle can be used to change position, fade volume, or cancel playback.
+	// (like the rest of the Sound interface, call this from one thread -- the game thread)
 	std::shared_ptr< PlayingSample > play(
 		glm::vec3 const &position,
 		float volume = 1.0f,
 		LoopOrOnce loop_or_once = Once
 	) const;
 
-	std::vector< float > data;
+	//limits on playback (set these right after loading):
+	// at most 'max_voices' instances play at once (0 means no limit); when another is started, either
+	// the oldest instance is quickly faded out to make room, or (if !replace_oldest) the new one doesn't play
+	uint32_t max_voices = 0;
+	bool replace_oldest = true;
+	// when more samples are audible than the mixer will mix, higher priorities (then louder samples) win;
+	// the others keep their place in the sample but are silent until they win again
+	int32_t priority = 0;
+
+	std::vector< float > data; //(empty for streamed samples)
+	std::unique_ptr< StreamSource > stream_source; //(only for streamed samples)
 };
 
 //Ramp<> is a template to help with managing values that should be smoothly
@@ -57,28 +81,24 @@ struct Ramp {
 struct PlayingSample {
 	//change the position or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
+	// (these only queue a command for the mixer, so they never wait on the audio thread)
 	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
 	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 	void stop(float ramp = 1.0f / 60.0f);
 
 	//internals:
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(0.0f);
-	Ramp< float > volume = Ramp< float >(1.0f);
+	uint32_t voice = -1U; //mixer voice slot playing this sample (-1U if playback couldn't start)
+	uint32_t generation = 0; //voice slot's generation when playback started (so commands can't reach a later sample in the same slot)
+	bool stopped = false; //was stop() called (or did playback never start)?
 
-	PlayingSample(Sample const *sample_, glm::vec3 const &position_, float volume_, bool loop_)
-		: data(sample_->data), loop(loop_), position(position_), volume(volume_) { }
+	PlayingSample(uint32_t voice_, uint32_t generation_) : voice(voice_), generation(generation_), stopped(voice_ == -1U) { }
 };
 
 struct Listener {
 	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
 	void set_right(glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
 
-	//internals:
+	//internals (owned by the mixer; change them with the functions above):
 	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(0.0f); //listener's location
 	Ramp< glm::vec3 > right = Ramp< glm::vec3 >(1.0f, 0.0f, 0.0f); //unit vector pointing to listener's right
 };
@@ -91,15 +111,20 @@ constexpr const uint32_t MixSamples = 1024; //samples to mix at once; SDL requir
 
 void init(); //should call Sound::init() from main.cpp before using any member functions
 
+//for tools (e.g. mix_bench) that mix without an audio device:
+// call init_offline() instead of init(), then each render() mixes the next MixSamples samples
+void init_offline();
+void render(float *out); //'out' is MixSamples interleaved (left, right) pairs
+
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly
+// the set_*/stop/play/... functions don't use these (they queue commands that the mixer
+// applies at the start of its next mix period), so you shouldn't need to call them
 void lock();
 void unlock();
 
 void stop_all_samples(); //sort of a 'panic button' to stop all playing samples
 
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
-extern Ramp< float > volume;
+extern Ramp< float > volume; //(owned by the mixer)
 
 }; //namespace Sound
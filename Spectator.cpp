@@ -0,0 +1,111 @@
+#include "Spectator.hpp"
+
+#include "Connection.hpp"
+#include "GameState.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <cstring>
+
+static constexpr size_t HeaderSize = 1 + sizeof(uint32_t);
+
+size_t Spectator::message_size(std::vector< char > const &buffer) {
+	if (buffer.size() < HeaderSize) return 0;
+	uint32_t payload = 0;
+	memcpy(&payload, buffer.data() + 1, sizeof(payload));
+	if (buffer.size() < HeaderSize + payload) return 0;
+	return HeaderSize + payload;
+}
+
+template< typename T >
+static void append(std::vector< char > &message, T const &t) {
+	message.insert(message.end(), reinterpret_cast< char const * >(&t), reinterpret_cast< char const * >(&t) + sizeof(T));
+}
+
+//start a framed message (payload size is filled in by end_message):
+static void begin_message(std::vector< char > &message, char type) {
+	message.clear();
+	message.emplace_back(type);
+	append(message, uint32_t(0));
+}
+
+static void end_message(std::vector< char > &message) {
+	uint32_t payload = uint32_t(message.size() - HeaderSize);
+	memcpy(message.data() + 1, &payload, sizeof(payload));
+}
+
+std::vector< char > Spectator::roster(GameState const &state) {
+	std::vector< char > message;
+	begin_message(message, 'r');
+	append(message, uint32_t(state.player_count));
+	for (int i = 0; i < state.player_count; i++) {
+		auto f = state.players.find(i);
+		int team = (f != state.players.end() ? f->second.team : -1);
+		std::string nickname = (f != state.players.end() ? f->second.nickname : std::string());
+		nickname.resize(Player::NICKNAME_LENGTH, ' ');
+		append(message, team);
+		message.insert(message.end(), nickname.begin(), nickname.end());
+	}
+	end_message(message);
+	return message;
+}
+
+bool Spectator::send(Connection *c, std::vector< char > const &message) {
+	if (!*c) return false;
+	if (c->send_buffer.size() + message.size() > MaxBacklog) {
+		std::cerr << "WARNING: spectator on " << c->socket << " fell too far behind; disconnecting it." << std::endl;
+		c->close();
+		return false;
+	}
+	c->send_raw(message.data(), message.size());
+	return true;
+}
+
+SpectatorFeed::SpectatorFeed(float delay_, float rate) : delay(delay_), period(1.0f / rate) {
+}
+
+void SpectatorFeed::update(GameState const &state, float elapsed, std::vector< char > *out) {
+	time += elapsed;
+
+	if (time >= next_snapshot) {
+		//(skip ahead rather than bunching snapshots up after a long tick)
+		next_snapshot = std::max(next_snapshot + period, time);
+
+		pending.emplace_back();
+		pending.back().time = time;
+		std::vector< char > &message = pending.back().message;
+		begin_message(message, 'v');
+		append(message, time);
+		append(message, uint32_t(state.player_count));
+		for (uint32_t team = 0; team < GameState::num_teams; team++) {
+			append(message, state.current_points[team]);
+		}
+		for (int i = 0; i < state.player_count; i++) {
+			Player player = Player();
+			Harpoon harpoon = Harpoon();
+			auto p = state.players.find(i);
+			if (p != state.players.end()) player = p->second;
+			auto h = state.harpoons.find(i);
+			if (h != state.harpoons.end()) harpoon = h->second;
+			append(message, player.position);
+			append(message, player.velocity);
+			append(message, player.rotation);
+			append(message, uint8_t(player.is_shot ? 1 : 0));
+			append(message, harpoon.state);
+			append(message, harpoon.position);
+			append(message, harpoon.velocity);
+			append(message, harpoon.rotation);
+		}
+		for (uint32_t team = 0; team < GameState::num_teams; team++) {
+			append(message, state.treasures[team].position);
+			append(message, state.treasures[team].held_by);
+		}
+		end_message(message);
+	}
+
+	while (!pending.empty() && pending.front().time + delay <= time) {
+		if (out) out->insert(out->end(), pending.front().message.begin(), pending.front().message.end());
+		pending.pop_front();
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+struct GameState;
+struct Connection;
+
+//Spectator protocol (see server.cpp and relay.cpp):
+// spectator -> server: 'w' ("watch"), sent instead of any lobby message; the connection never becomes a player
+// server -> spectator: 'r' roster and 'v' snapshots, each framed as: type char, uint32 payload size, payload
+//  'r': uint32 player count, then per player: int team, Player::NICKNAME_LENGTH chars
+//  'v': float match time, uint32 player count, uint32 points[GameState::num_teams], then per player:
+//       position, velocity, rotation, uint8 is_shot, int harpoon state, harpoon position, velocity, rotation;
+//       then per treasure: position, int held_by
+//Because every message is framed, a relay can forward them without understanding them.
+
+namespace Spectator {
+	//spectators that fall this far behind (bytes queued) are dropped rather than buffering forever:
+	constexpr size_t MaxBacklog = 1 << 20;
+
+	//size of the complete framed message at the front of 'buffer' (header included), or 0 if it hasn't all arrived:
+	size_t message_size(std::vector< char > const &buffer);
+
+	//framed 'r' message for the state's current players:
+	std::vector< char > roster(GameState const &state);
+
+	//append 'message' to a spectator's send buffer; if it has fallen too far behind, closes the
+	// connection instead and returns false (so the caller can forget it before poll() reaps it):
+	bool send(Connection *c, std::vector< char > const &message);
+}
+
+//"SpectatorFeed" turns the server's ticks into the spectator stream:
+// - snapshots are encoded once (not per spectator) at 'rate' per second of match time
+// - each is held back until it is 'delay' seconds old, so spectators can't be used to scout for players
+struct SpectatorFeed {
+	SpectatorFeed(float delay, float rate);
+
+	float delay;
+	float period; //seconds between snapshots
+
+	//call after every GameState::update; records a snapshot if one is due and
+	// appends any snapshots that are now old enough to 'out' (as framed 'v' messages):
+	void update(GameState const &state, float elapsed, std::vector< char > *out);
+
+	float time = 0.0f; //match time
+	float next_snapshot = 0.0f;
+	struct Snapshot {
+		float time;
+		std::vector< char > message;
+	};
+	std::deque< Snapshot > pending;
+};
@@ -0,0 +1,158 @@
+#include "SunShadow.hpp"
+
+#include "gl_errors.hpp"
+#include "check_fb.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <limits>
+
+//maps clip space [-1,1] to texture space [0,1]:
+static glm::mat4 const clip_to_texture = glm::mat4(
+	glm::vec4(0.5f, 0.0f, 0.0f, 0.0f),
+	glm::vec4(0.0f, 0.5f, 0.0f, 0.0f),
+	glm::vec4(0.0f, 0.0f, 0.5f, 0.0f),
+	glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)
+);
+
+static void allocate_target(SunShadow::DepthTarget &target, uint32_t size) {
+	target.size = size;
+
+	glGenTextures(1, &target.tex);
+	glBindTexture(GL_TEXTURE_2D, target.tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	//linear filtering + compare mode gives hardware 2x2 PCF:
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	//anything outside the map is lit:
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	GLfloat border[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &target.fb);
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fb);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, target.tex, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	check_fb();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	GL_ERRORS();
+}
+
+static void free_target(SunShadow::DepthTarget &target) {
+	if (target.fb) glDeleteFramebuffers(1, &target.fb);
+	if (target.tex) glDeleteTextures(1, &target.tex);
+	target.fb = target.tex = 0;
+}
+
+//render a caster list into a depth target:
+static void render_target(SunShadow::DepthTarget const &target, Scene const &scene, std::vector< Scene::Object const * > const &casters, glm::mat4 const &world_to_clip) {
+	glBindFramebuffer(GL_FRAMEBUFFER, target.fb);
+	glViewport(0, 0, target.size, target.size);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	if (!casters.empty()) {
+		glEnable(GL_DEPTH_TEST);
+		//push depths back a bit to avoid self-shadowing ("shadow acne"):
+		glEnable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(2.0f, 4.0f);
+
+		scene.draw(casters, world_to_clip, Scene::Object::ProgramTypeShadow);
+
+		glDisable(GL_POLYGON_OFFSET_FILL);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+SunShadow::SunShadow(uint32_t static_size, uint32_t dynamic_size) {
+	allocate_target(static_target, static_size);
+	allocate_target(dynamic_target, dynamic_size);
+}
+
+SunShadow::~SunShadow() {
+	free_target(static_target);
+	free_target(dynamic_target);
+}
+
+void SunShadow::set_static_bounds(glm::vec3 const &min, glm::vec3 const &max) {
+	if (min != static_min || max != static_max) {
+		static_min = min;
+		static_max = max;
+		static_dirty = true;
+	}
+}
+
+void SunShadow::update(Scene const &scene, Scene::Lamp const *sun) {
+	assert(sun && "Must have a lamp to cast shadows from.");
+
+	glm::mat4 world_to_light = sun->transform->make_world_to_local();
+
+	//static map: only when something it depends on has changed:
+	if (static_dirty || world_to_light != static_world_to_light) {
+		static_world_to_light = world_to_light;
+
+		//fit an orthographic projection to the static bounds, as seen from the lamp:
+		glm::vec3 lo = glm::vec3(std::numeric_limits< float >::infinity());
+		glm::vec3 hi = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (uint32_t c = 0; c < 8; ++c) {
+			glm::vec3 corner = glm::vec3(
+				(c & 1 ? static_max.x : static_min.x),
+				(c & 2 ? static_max.y : static_min.y),
+				(c & 4 ? static_max.z : static_min.z)
+			);
+			glm::vec3 at = glm::vec3(world_to_light * glm::vec4(corner, 1.0f));
+			lo = glm::min(lo, at);
+			hi = glm::max(hi, at);
+		}
+		//(small margin so that nothing sits exactly on the edge; also keeps the projection valid for empty bounds)
+		lo -= glm::vec3(0.5f);
+		hi += glm::vec3(0.5f);
+
+		//NOTE: lamps look along -z, so near/far are negated z:
+		static_light_to_clip = glm::ortho(lo.x, hi.x, lo.y, hi.y, -hi.z, -lo.z);
+		world_to_static_shadow = clip_to_texture * static_light_to_clip * world_to_light;
+
+		render_target(static_target, scene, static_casters, static_light_to_clip * world_to_light);
+		static_dirty = false;
+		static_renders += 1;
+	}
+
+	//dynamic map: fit tightly around the current casters (every frame):
+	glm::mat4 dynamic_light_to_clip = static_light_to_clip;
+	if (!dynamic_casters.empty()) {
+		glm::vec3 lo = glm::vec3(std::numeric_limits< float >::infinity());
+		glm::vec3 hi = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (auto const &object : dynamic_casters) {
+			glm::vec3 at = glm::vec3(world_to_light * object->transform->make_local_to_world()[3]);
+			lo = glm::min(lo, at - glm::vec3(caster_radius));
+			hi = glm::max(hi, at + glm::vec3(caster_radius));
+		}
+		//depth range reaches from the nearest caster to the far side of the level (so shadows land on everything behind):
+		glm::mat4 static_clip_to_light = glm::inverse(static_light_to_clip);
+		float static_near = glm::vec3(static_clip_to_light * glm::vec4(0.0f, 0.0f,-1.0f, 1.0f)).z;
+		float static_far = glm::vec3(static_clip_to_light * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)).z;
+		hi.z = std::max(hi.z, static_near);
+		lo.z = std::min(lo.z, static_far);
+		dynamic_light_to_clip = glm::ortho(lo.x, hi.x, lo.y, hi.y, -hi.z, -lo.z);
+	}
+	world_to_dynamic_shadow = clip_to_texture * dynamic_light_to_clip * world_to_light;
+
+	render_target(dynamic_target, scene, dynamic_casters, dynamic_light_to_clip * world_to_light);
+
+	GL_ERRORS();
+}
+
+void SunShadow::bind(GLuint static_unit, GLuint dynamic_unit) const {
+	glActiveTexture(GL_TEXTURE0 + static_unit);
+	glBindTexture(GL_TEXTURE_2D, static_target.tex);
+	glActiveTexture(GL_TEXTURE0 + dynamic_unit);
+	glBindTexture(GL_TEXTURE_2D, dynamic_target.tex);
+	glActiveTexture(GL_TEXTURE0);
+}
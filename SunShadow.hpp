@@ -0,0 +1,61 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+//"SunShadow" renders shadow maps for a directional lamp as two layers:
+// - a static map of the level, cached until the lamp or static geometry changes
+// - a small dynamic map, re-rendered every frame from a short list of moving casters
+// Lighting shaders sample both (see vertex_color_program) and take the darker result.
+struct SunShadow {
+	SunShadow(uint32_t static_size = 2048, uint32_t dynamic_size = 1024);
+	~SunShadow();
+	SunShadow(SunShadow const &) = delete;
+	SunShadow &operator=(SunShadow const &) = delete;
+
+	//objects drawn into each map (using their ProgramTypeShadow slot):
+	std::vector< Scene::Object const * > static_casters;
+	std::vector< Scene::Object const * > dynamic_casters;
+
+	//world-space box that the static map must cover (generally, the whole level):
+	void set_static_bounds(glm::vec3 const &min, glm::vec3 const &max);
+	//force the static map to be re-rendered (call if static geometry moves or changes):
+	void invalidate_static() { static_dirty = true; }
+
+	//dynamic casters are treated as spheres of this radius around their transform's origin:
+	float caster_radius = 2.0f;
+
+	//re-render the static map if needed and the dynamic map always:
+	// (changes the current framebuffer + viewport; caller should re-bind its own)
+	void update(Scene const &scene, Scene::Lamp const *sun);
+
+	//bind the shadow maps to texture units (to match samplers in the lighting program):
+	void bind(GLuint static_unit, GLuint dynamic_unit) const;
+
+	//world-to-shadow-texture-space matrices (for use with textureProj on a sampler2DShadow):
+	glm::mat4 world_to_static_shadow = glm::mat4(1.0f);
+	glm::mat4 world_to_dynamic_shadow = glm::mat4(1.0f);
+
+	//number of times the static map has been rendered (handy for checking that caching works):
+	uint32_t static_renders = 0;
+
+	//internals:
+	struct DepthTarget {
+		uint32_t size = 0;
+		GLuint tex = 0;
+		GLuint fb = 0;
+	};
+	DepthTarget static_target;
+	DepthTarget dynamic_target;
+
+	glm::vec3 static_min = glm::vec3(0.0f);
+	glm::vec3 static_max = glm::vec3(0.0f);
+
+	bool static_dirty = true;
+	glm::mat4 static_world_to_light = glm::mat4(1.0f); //light view that the static map was rendered with
+	glm::mat4 static_light_to_clip = glm::mat4(1.0f);
+};
@@ -0,0 +1,467 @@
+#include "TextureCache.hpp"
+
+#include "AssetArchive.hpp"
+#include "load_save_png.hpp"
+#include "data_path.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <cassert>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+	//bump when the cache file layout or encoders change, so old cache files are ignored:
+	const uint32_t CacheVersion = 1;
+
+	//set by init_texture_cache(); read by decode_texture() on loader threads:
+	std::atomic< bool > s3tc_supported(false);
+
+	//cache file chunks:
+	struct CacheHeader {
+		uint64_t key = 0;
+		uint32_t target = 0;
+		uint32_t internal_format = 0;
+		uint32_t format = 0;
+		uint32_t type = 0;
+		uint32_t faces = 0;
+		uint32_t levels = 0;
+	};
+	static_assert(sizeof(CacheHeader) == 32, "cache header is packed");
+
+	struct CacheImage {
+		uint32_t face = 0;
+		uint32_t level = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint64_t offset = 0; //in the "dat0" chunk
+		uint64_t bytes = 0;
+	};
+	static_assert(sizeof(CacheImage) == 32, "cache image is packed");
+
+	//contents of a data file (from the data archive or from disk):
+	struct SourceFile {
+		AssetArchive::Contents archived;
+		std::vector< uint8_t > loaded;
+		uint8_t const *data = nullptr;
+		size_t size = 0;
+	};
+
+	void read_source(std::string const &filename, SourceFile *source) {
+		if (find_data_file(filename, &source->archived)) {
+			source->data = source->archived.data;
+			source->size = source->archived.size;
+			return;
+		}
+		std::ifstream file(filename, std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("Failed to open PNG image file '" + filename + "'.");
+		}
+		source->loaded.assign(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+		source->data = source->loaded.data();
+		source->size = source->loaded.size();
+	}
+
+	//------ mip maps ------
+
+	//2x2 box filter (odd edges reuse the last row/column):
+	void downsample(glm::uvec2 size, std::vector< glm::u8vec4 > const &src, glm::uvec2 *out_size, std::vector< glm::u8vec4 > *out) {
+		glm::uvec2 half = glm::max(glm::uvec2(1), size / 2U);
+		out->resize(half.x * half.y);
+		for (uint32_t y = 0; y < half.y; ++y) {
+			uint32_t y0 = std::min(2 * y, size.y - 1);
+			uint32_t y1 = std::min(2 * y + 1, size.y - 1);
+			for (uint32_t x = 0; x < half.x; ++x) {
+				uint32_t x0 = std::min(2 * x, size.x - 1);
+				uint32_t x1 = std::min(2 * x + 1, size.x - 1);
+				glm::uvec4 sum = glm::uvec4(src[y0 * size.x + x0]) + glm::uvec4(src[y0 * size.x + x1])
+				               + glm::uvec4(src[y1 * size.x + x0]) + glm::uvec4(src[y1 * size.x + x1]);
+				(*out)[y * half.x + x] = glm::u8vec4((sum + glm::uvec4(2)) / 4U);
+			}
+		}
+		*out_size = half;
+	}
+
+	//------ BC1 / BC3 encoding ------
+	// see https://docs.microsoft.com/en-us/windows/win32/direct3d10/d3d10-graphics-programming-guide-resources-block-compression
+	// (simple bounding-box endpoints; quality is fine for smooth sky/terrain textures, not tuned for detailed ones)
+
+	uint16_t to_565(glm::ivec3 c) {
+		return uint16_t(((c.x >> 3) << 11) | ((c.y >> 2) << 5) | (c.z >> 3));
+	}
+
+	glm::ivec3 from_565(uint16_t v) {
+		int r = (v >> 11) & 0x1f;
+		int g = (v >> 5) & 0x3f;
+		int b = v & 0x1f;
+		return glm::ivec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+	}
+
+	void put_u16(uint8_t *at, uint16_t v) {
+		at[0] = uint8_t(v & 0xff);
+		at[1] = uint8_t(v >> 8);
+	}
+
+	//8-byte color block; always uses four-color mode (required for BC3's color block):
+	void encode_color_block(glm::u8vec4 const (&px)[16], uint8_t *out) {
+		glm::ivec3 lo(255), hi(0);
+		for (auto const &p : px) {
+			lo = glm::min(lo, glm::ivec3(p));
+			hi = glm::max(hi, glm::ivec3(p));
+		}
+		//inset the box a bit, so endpoints aren't pulled toward outliers:
+		glm::ivec3 inset = (hi - lo) / 16;
+		lo = glm::min(lo + inset, glm::ivec3(255));
+		hi = glm::max(hi - inset, glm::ivec3(0));
+
+		uint16_t c0 = to_565(hi);
+		uint16_t c1 = to_565(lo);
+		if (c0 < c1) std::swap(c0, c1);
+		put_u16(out + 0, c0);
+		put_u16(out + 2, c1);
+
+		uint32_t indices = 0;
+		if (c0 != c1) {
+			glm::ivec3 palette[4];
+			palette[0] = from_565(c0);
+			palette[1] = from_565(c1);
+			palette[2] = (2 * palette[0] + palette[1]) / 3;
+			palette[3] = (palette[0] + 2 * palette[1]) / 3;
+			for (uint32_t i = 0; i < 16; ++i) {
+				uint32_t best = 0;
+				int best_dis = 0x7fffffff;
+				for (uint32_t j = 0; j < 4; ++j) {
+					glm::ivec3 d = glm::ivec3(px[i]) - palette[j];
+					int dis = d.x * d.x + d.y * d.y + d.z * d.z;
+					if (dis < best_dis) {
+						best = j;
+						best_dis = dis;
+					}
+				}
+				indices |= best << (2 * i);
+			}
+		}
+		for (uint32_t b = 0; b < 4; ++b) {
+			out[4 + b] = uint8_t(indices >> (8 * b));
+		}
+	}
+
+	//8-byte alpha block (BC3), eight-value mode:
+	void encode_alpha_block(glm::u8vec4 const (&px)[16], uint8_t *out) {
+		int a0 = 0, a1 = 255;
+		for (auto const &p : px) {
+			a0 = std::max(a0, int(p.w));
+			a1 = std::min(a1, int(p.w));
+		}
+		out[0] = uint8_t(a0);
+		out[1] = uint8_t(a1);
+
+		uint64_t indices = 0;
+		if (a0 != a1) {
+			int palette[8];
+			palette[0] = a0;
+			palette[1] = a1;
+			for (int j = 1; j < 7; ++j) {
+				palette[j + 1] = ((7 - j) * a0 + j * a1) / 7;
+			}
+			for (uint32_t i = 0; i < 16; ++i) {
+				uint64_t best = 0;
+				int best_dis = 256;
+				for (uint32_t j = 0; j < 8; ++j) {
+					int dis = std::abs(int(px[i].w) - palette[j]);
+					if (dis < best_dis) {
+						best = j;
+						best_dis = dis;
+					}
+				}
+				indices |= best << (3 * i);
+			}
+		}
+		for (uint32_t b = 0; b < 6; ++b) {
+			out[2 + b] = uint8_t(indices >> (8 * b));
+		}
+	}
+
+	//compress a whole image (edge blocks repeat the last row/column):
+	void encode_bc(glm::uvec2 size, std::vector< glm::u8vec4 > const &src, bool alpha, std::vector< uint8_t > *out) {
+		uint32_t block_bytes = (alpha ? 16 : 8);
+		glm::uvec2 blocks = (size + glm::uvec2(3)) / 4U;
+		size_t start = out->size();
+		out->resize(start + blocks.x * blocks.y * block_bytes);
+		uint8_t *at = out->data() + start;
+		for (uint32_t by = 0; by < blocks.y; ++by) {
+			for (uint32_t bx = 0; bx < blocks.x; ++bx) {
+				glm::u8vec4 px[16];
+				for (uint32_t y = 0; y < 4; ++y) {
+					for (uint32_t x = 0; x < 4; ++x) {
+						uint32_t sx = std::min(bx * 4 + x, size.x - 1);
+						uint32_t sy = std::min(by * 4 + y, size.y - 1);
+						px[y * 4 + x] = src[sy * size.x + sx];
+					}
+				}
+				if (alpha) {
+					encode_alpha_block(px, at);
+					at += 8;
+				}
+				encode_color_block(px, at);
+				at += 8;
+			}
+		}
+	}
+
+	//------ cache files ------
+
+	void ensure_directory(std::string const &path) {
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+
+	template< typename T >
+	void write_chunk(std::ostream &out, char const *magic, T const *data, size_t count) {
+		uint32_t size = uint32_t(count * sizeof(T));
+		out.write(magic, 4);
+		out.write(reinterpret_cast< char const * >(&size), 4);
+		out.write(reinterpret_cast< char const * >(data), size);
+	}
+
+	void write_cache(std::string const &filename, CacheHeader const &header, TextureData const &data) {
+		std::vector< CacheImage > images;
+		std::vector< uint8_t > bytes;
+		for (auto const &image : data.images) {
+			CacheImage ci;
+			ci.face = image.face;
+			ci.level = image.level;
+			ci.width = image.size.x;
+			ci.height = image.size.y;
+			ci.offset = bytes.size();
+			ci.bytes = image.bytes;
+			images.emplace_back(ci);
+			bytes.insert(bytes.end(), image.data, image.data + image.bytes);
+		}
+
+		ensure_directory(data_path("texture_cache"));
+		//(written to a temporary name first, so a half-written cache file is never read)
+		std::string temp = filename + ".tmp";
+		{
+			std::ofstream out(temp, std::ios::binary);
+			write_chunk(out, "tex0", &header, 1);
+			write_chunk(out, "img0", images.data(), images.size());
+			write_chunk(out, "dat0", bytes.data(), bytes.size());
+			if (!out) {
+				std::cerr << "WARNING: failed to write texture cache file '" << temp << "'." << std::endl;
+				return;
+			}
+		}
+		std::remove(filename.c_str());
+		if (std::rename(temp.c_str(), filename.c_str()) != 0) {
+			std::cerr << "WARNING: failed to rename texture cache file to '" << filename << "'." << std::endl;
+			std::remove(temp.c_str());
+		}
+	}
+
+	//read a cache file; returns false if it doesn't exist or doesn't match 'key':
+	bool read_cache(std::string const &filename, uint64_t key, TextureData *data) {
+		std::unique_ptr< ChunkFile > file;
+		try {
+			file.reset(new ChunkFile(filename));
+		} catch (std::exception &) {
+			return false; //(not cached yet)
+		}
+		try {
+			auto header = file->read< CacheHeader >("tex0");
+			if (header.size() != 1 || header[0].key != key) return false;
+			auto images = file->read< CacheImage >("img0");
+			auto bytes = file->read< uint8_t >("dat0");
+
+			data->target = header[0].target;
+			data->internal_format = header[0].internal_format;
+			data->format = header[0].format;
+			data->type = header[0].type;
+			data->faces = header[0].faces;
+			data->levels = header[0].levels;
+			data->images.clear();
+			for (auto const &ci : images) {
+				if (ci.offset > bytes.size() || bytes.size() - ci.offset < ci.bytes) {
+					throw std::runtime_error("image data out of range");
+				}
+				TextureData::Image image;
+				image.face = ci.face;
+				image.level = ci.level;
+				image.size = glm::uvec2(ci.width, ci.height);
+				image.data = bytes.data() + ci.offset;
+				image.bytes = size_t(ci.bytes);
+				data->images.emplace_back(image);
+			}
+		} catch (std::exception &e) {
+			std::cerr << "WARNING: ignoring texture cache file '" << filename << "': " << e.what() << std::endl;
+			return false;
+		}
+		data->file = std::move(file);
+		data->storage.clear();
+		data->from_cache = true;
+		return true;
+	}
+}
+
+size_t TextureData::total_bytes() const {
+	size_t total = 0;
+	for (auto const &image : images) {
+		total += image.bytes;
+	}
+	return total;
+}
+
+void init_texture_cache() {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i) {
+		char const *name = reinterpret_cast< char const * >(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+		if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0) {
+			s3tc_supported = true;
+		}
+	}
+	if (!s3tc_supported) {
+		std::cout << "NOTE: S3TC texture compression not supported; textures will be uncompressed." << std::endl;
+	}
+}
+
+TextureData decode_texture(std::vector< std::string > const &pngs, GLenum target, TextureOptions const &options) {
+	assert((target == GL_TEXTURE_2D && pngs.size() == 1) || (target == GL_TEXTURE_CUBE_MAP && pngs.size() == 6));
+
+	bool compress = options.compress && s3tc_supported;
+
+	//key is a hash of the source contents + everything that changes the output:
+	std::vector< SourceFile > sources(pngs.size());
+	std::vector< uint64_t > key_data;
+	key_data.emplace_back(CacheVersion);
+	key_data.emplace_back(target);
+	key_data.emplace_back((options.mipmaps ? 1 : 0) | (compress ? 2 : 0) | (options.upper_left_origin ? 4 : 0));
+	for (uint32_t i = 0; i < pngs.size(); ++i) {
+		read_source(pngs[i], &sources[i]);
+		key_data.emplace_back(asset_hash(sources[i].data, sources[i].size));
+	}
+	uint64_t key = asset_hash(key_data.data(), key_data.size() * sizeof(uint64_t));
+
+	std::ostringstream cache_name;
+	cache_name << "texture_cache/" << std::hex << std::setw(16) << std::setfill('0') << key << ".tex";
+	std::string cache_filename = data_path(cache_name.str());
+
+	TextureData data;
+	if (read_cache(cache_filename, key, &data)) {
+		return data;
+	}
+
+	//not cached; decode pngs:
+	std::vector< glm::uvec2 > sizes(pngs.size());
+	std::vector< std::vector< glm::u8vec4 > > pixels(pngs.size());
+	bool alpha = false;
+	for (uint32_t i = 0; i < pngs.size(); ++i) {
+		load_png(sources[i].data, sources[i].size, pngs[i], &sizes[i], &pixels[i], (options.upper_left_origin ? UpperLeftOrigin : LowerLeftOrigin));
+		for (auto const &p : pixels[i]) {
+			if (p.w != 0xff) alpha = true;
+		}
+		if (sizes[i] != sizes[0]) {
+			throw std::runtime_error("Texture '" + pngs[i] + "' isn't the same size as '" + pngs[0] + "'.");
+		}
+	}
+
+	data.target = target;
+	data.faces = uint32_t(pngs.size());
+	data.type = GL_UNSIGNED_BYTE;
+	if (compress) {
+		data.internal_format = (alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT);
+		data.format = 0;
+	} else {
+		data.internal_format = (alpha ? GL_RGBA8 : GL_RGB8);
+		data.format = GL_RGBA;
+	}
+
+	//build each face's mip chain, recording (offset, size) in 'storage' (pointers are filled in once it stops growing):
+	std::vector< size_t > offsets;
+	data.levels = 0;
+	for (uint32_t face = 0; face < pngs.size(); ++face) {
+		glm::uvec2 size = sizes[face];
+		std::vector< glm::u8vec4 > level_pixels = std::move(pixels[face]);
+		uint32_t level = 0;
+		while (true) {
+			TextureData::Image image;
+			image.face = face;
+			image.level = level;
+			image.size = size;
+			offsets.emplace_back(data.storage.size());
+			if (compress) {
+				encode_bc(size, level_pixels, alpha, &data.storage);
+			} else {
+				uint8_t const *begin = reinterpret_cast< uint8_t const * >(level_pixels.data());
+				data.storage.insert(data.storage.end(), begin, begin + level_pixels.size() * sizeof(glm::u8vec4));
+			}
+			image.bytes = data.storage.size() - offsets.back();
+			data.images.emplace_back(image);
+
+			level += 1;
+			if (!options.mipmaps || (size.x == 1 && size.y == 1)) break;
+			std::vector< glm::u8vec4 > next;
+			downsample(size, level_pixels, &size, &next);
+			level_pixels = std::move(next);
+		}
+		data.levels = level;
+	}
+	for (size_t i = 0; i < data.images.size(); ++i) {
+		data.images[i].data = data.storage.data() + offsets[i];
+	}
+
+	CacheHeader header;
+	header.key = key;
+	header.target = data.target;
+	header.internal_format = data.internal_format;
+	header.format = data.format;
+	header.type = data.type;
+	header.faces = data.faces;
+	header.levels = data.levels;
+	write_cache(cache_filename, header, data);
+
+	return data;
+}
+
+GLuint upload_texture(TextureData const &data) {
+	GLuint tex = 0;
+	glGenTextures(1, &tex);
+	glBindTexture(data.target, tex);
+
+	for (auto const &image : data.images) {
+		GLenum face_target = (data.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + image.face : data.target);
+		if (data.format == 0) {
+			glCompressedTexImage2D(face_target, image.level, data.internal_format, image.size.x, image.size.y, 0, GLsizei(image.bytes), image.data);
+		} else {
+			glTexImage2D(face_target, image.level, data.internal_format, image.size.x, image.size.y, 0, data.format, data.type, image.data);
+		}
+	}
+
+	glTexParameteri(data.target, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(data.target, GL_TEXTURE_MAX_LEVEL, GLint(data.levels) - 1);
+	glTexParameteri(data.target, GL_TEXTURE_MIN_FILTER, (data.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR));
+	glTexParameteri(data.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (data.target == GL_TEXTURE_CUBE_MAP) {
+		glTexParameteri(data.target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(data.target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(data.target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+
+	glBindTexture(data.target, 0);
+
+	return tex;
+}
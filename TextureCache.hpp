@@ -0,0 +1,64 @@
+#pragma once
+
+#include "GL.hpp"
+#include "ChunkFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+//"TextureCache" keeps GPU-ready copies of png textures, so they don't need to be decoded on every launch:
+// - the first time a texture is loaded, its pngs are decoded, mip-mapped, and (optionally) block-compressed,
+//   and the result is written to data_path("texture_cache/<key>.tex")
+// - later loads read that file (through ChunkFile, so it may also come from the data archive) and upload it as-is
+// - the key is a hash of the source pngs' contents + the load options, so edited pngs are rebuilt automatically
+//
+//Usage:
+//  TextureData data = decode_texture({data_path("textures/sand.png")}, GL_TEXTURE_2D); //(any thread)
+//  GLuint tex = upload_texture(data); //(main thread)
+
+struct TextureOptions {
+	bool mipmaps = true; //build a full mip chain
+	bool compress = true; //BC1 (opaque) or BC3 (with alpha), if the GL supports S3TC
+	bool upper_left_origin = false; //row order of the uploaded image (see OriginLocation)
+};
+
+//decoded (or cached) contents of a texture, ready to upload:
+struct TextureData {
+	GLenum target = GL_TEXTURE_2D; //GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+	GLenum internal_format = GL_RGBA8;
+	GLenum format = GL_RGBA; //pixel format for glTexImage2D (0 if compressed)
+	GLenum type = GL_UNSIGNED_BYTE;
+	uint32_t faces = 0;
+	uint32_t levels = 0;
+
+	struct Image {
+		uint32_t face = 0;
+		uint32_t level = 0;
+		glm::uvec2 size = glm::uvec2(0);
+		uint8_t const *data = nullptr;
+		size_t bytes = 0;
+	};
+	std::vector< Image > images;
+
+	bool from_cache = false; //read from a cache file, rather than decoded from png
+
+	size_t total_bytes() const;
+
+	//storage for image data (one or the other is used):
+	std::unique_ptr< ChunkFile > file;
+	std::vector< uint8_t > storage;
+};
+
+//call once the GL context exists (before anything is decoded), to check for texture compression support:
+void init_texture_cache();
+
+//decode 'pngs' (one for GL_TEXTURE_2D, six -- +x,-x,+y,-y,+z,-z -- for GL_TEXTURE_CUBE_MAP), using the cache if possible:
+// doesn't use OpenGL (so may be called from a loader thread); will throw if a png can't be read
+TextureData decode_texture(std::vector< std::string > const &pngs, GLenum target, TextureOptions const &options = TextureOptions());
+
+//create a texture from decoded data (sets linear / trilinear filtering; cube maps also clamp to edge):
+GLuint upload_texture(TextureData const &data);
@@ -1,27 +1,122 @@
 #include "WalkMesh.hpp"
 
-#include "read_chunk.hpp"
+#include "ChunkFile.hpp"
 
+#define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/norm.hpp>
 
 #include <iostream>
 #include <fstream>
 #include <algorithm>
 #include <string>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WALKMESH_SSE
+#include <emmintrin.h>
+#endif
+
+//triangles per BVH leaf:
+static constexpr uint32_t LeafTriangles = 4;
+
+//build BVH node 'n' over node_triangles[begin,end):
+static void build_node(WalkMesh &wm, std::vector< glm::vec3 > const &centroids, uint32_t n, uint32_t begin, uint32_t end) {
+	glm::vec3 min = glm::vec3(std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	glm::vec3 centroid_min = min;
+	glm::vec3 centroid_max = max;
+	for (uint32_t i = begin; i < end; ++i) {
+		uint32_t t = wm.node_triangles[i];
+		for (uint32_t v = 0; v < 3; ++v) {
+			min = glm::min(min, wm.vertices[wm.triangles[t][v]]);
+			max = glm::max(max, wm.vertices[wm.triangles[t][v]]);
+		}
+		centroid_min = glm::min(centroid_min, centroids[t]);
+		centroid_max = glm::max(centroid_max, centroids[t]);
+	}
+	wm.nodes[n].min = min;
+	wm.nodes[n].max = max;
+
+	//split at the median centroid along the longest axis (unless few enough triangles remain):
+	glm::vec3 extent = centroid_max - centroid_min;
+	uint32_t axis = (extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2));
+	if (end - begin <= LeafTriangles || extent[axis] == 0.0f) {
+		wm.nodes[n].first = begin;
+		wm.nodes[n].count = end - begin;
+		return;
+	}
+	uint32_t mid = (begin + end) / 2;
+	std::nth_element(wm.node_triangles.begin() + begin, wm.node_triangles.begin() + mid, wm.node_triangles.begin() + end,
+		[&centroids, axis](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+
+	uint32_t children = uint32_t(wm.nodes.size());
+	wm.nodes[n].first = children;
+	wm.nodes[n].count = 0;
+	wm.nodes.resize(wm.nodes.size() + 2); //(children are adjacent; note: invalidates references into 'nodes')
+	build_node(wm, centroids, children, begin, mid);
+	build_node(wm, centroids, children + 1, mid, end);
+}
 
-WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_)
-	: vertices(vertices_), normals(normals_), triangles(triangles_) {
+WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_, std::vector< uint32_t > const &adjacency_)
+	: vertices(vertices_), normals(normals_), triangles(triangles_), adjacency(adjacency_) {
+
+	if (adjacency.empty()) {
+		//build adjacency by matching each (directed) edge with its reverse:
+		struct HalfEdge {
+			uint32_t a, b; //edge goes from vertex a to vertex b
+			uint32_t at; //3*triangle+edge
+		};
+		auto before = [](HalfEdge const &x, HalfEdge const &y) {
+			return x.a < y.a || (x.a == y.a && x.b < y.b);
+		};
+		std::vector< HalfEdge > edges;
+		edges.reserve(triangles.size() * 3);
+		for (uint32_t t = 0; t < triangles.size(); ++t) {
+			for (uint32_t i = 0; i < 3; ++i) {
+				edges.emplace_back(HalfEdge{triangles[t][i], triangles[t][(i+1)%3], 3*t+i});
+			}
+		}
+		std::sort(edges.begin(), edges.end(), before);
+
+		adjacency.assign(triangles.size() * 3, -1U);
+		for (uint32_t e = 0; e < edges.size(); ++e) {
+			assert((e == 0 || before(edges[e-1], edges[e])) && "each directed edge belongs to one triangle");
+			HalfEdge reverse{edges[e].b, edges[e].a, 0};
+			auto f = std::lower_bound(edges.begin(), edges.end(), reverse, before);
+			if (f != edges.end() && f->a == reverse.a && f->b == reverse.b) {
+				adjacency[edges[e].at] = f->at;
+			}
+		}
+	} else if (adjacency.size() != triangles.size() * 3) {
+		throw std::runtime_error("WalkMesh adjacency doesn't match triangle count.");
+	}
 
-	//construct next_vertex map (maps each edge to the next vertex in the triangle):
-	next_vertex.reserve(triangles.size()*3);
-	auto do_next = [this](uint32_t a, uint32_t b, uint32_t c) {
-		auto ret = next_vertex.insert(std::make_pair(glm::uvec2(a,b), c));
-		assert(ret.second);
-	};
+	//precompute barycentric gradients:
+	// (weight i changes by dot(cross(out, opposite edge), step) / |out|^2, and the out-of-plane part of the step doesn't matter)
+	gradients.reserve(triangles.size() * 3);
 	for (auto const &tri : triangles) {
-		do_next(tri.x, tri.y, tri.z);
-		do_next(tri.y, tri.z, tri.x);
-		do_next(tri.z, tri.x, tri.y);
+		glm::vec3 const &a = vertices[tri.x];
+		glm::vec3 const &b = vertices[tri.y];
+		glm::vec3 const &c = vertices[tri.z];
+		glm::vec3 out = glm::cross(b-a, c-a);
+		float inv_out2 = 1.0f / glm::dot(out, out);
+		gradients.emplace_back(glm::cross(out, c-b) * inv_out2);
+		gradients.emplace_back(glm::cross(out, a-c) * inv_out2);
+		gradients.emplace_back(glm::cross(out, b-a) * inv_out2);
+	}
+
+	//build BVH:
+	if (!triangles.empty()) {
+		std::vector< glm::vec3 > centroids;
+		centroids.reserve(triangles.size());
+		node_triangles.reserve(triangles.size());
+		for (uint32_t t = 0; t < triangles.size(); ++t) {
+			centroids.emplace_back((vertices[triangles[t].x] + vertices[triangles[t].y] + vertices[triangles[t].z]) / 3.0f);
+			node_triangles.emplace_back(t);
+		}
+		nodes.reserve(2 * (triangles.size() / LeafTriangles + 1));
+		nodes.emplace_back();
+		build_node(*this, centroids, 0, 0, uint32_t(triangles.size()));
 	}
 
 	//DEBUG: are vertex normals consistent with geometric normals?
@@ -39,73 +134,180 @@ WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::
 	}
 }
 
-WalkMesh::WalkPoint WalkMesh::start(glm::vec3 const &world_point) const {
-	WalkPoint closest;
-	float closest_dis2 = std::numeric_limits< float >::infinity();
-	for (auto const &tri : triangles) {
-		glm::vec3 const &a = vertices[tri.x];
-		glm::vec3 const &b = vertices[tri.y];
-		glm::vec3 const &c = vertices[tri.z];
+//closest point to 'world_point' on triangle 't' (if closer than 'closest_dis2'):
+static void check_triangle(WalkMesh const &wm, uint32_t t, glm::vec3 const &world_point, WalkMesh::WalkPoint &closest, float &closest_dis2) {
+	glm::uvec3 const &tri = wm.triangles[t];
+	glm::vec3 const &a = wm.vertices[tri.x];
+	glm::vec3 const &b = wm.vertices[tri.y];
+	glm::vec3 const &c = wm.vertices[tri.z];
+
+	//figure out barycentric coordinates for point:
+	//project to plane of triangle:
+	glm::vec3 out = glm::cross(b-a, c-a);
+	glm::vec3 pt = world_point - out * (glm::dot(out, world_point - a) / glm::dot(out, out));
+
+	//figure out barycentric coordinates using signed triangle areas:
+	glm::vec3 coords = glm::vec3(
+		glm::dot(out, glm::cross(c-b, pt-b)),
+		glm::dot(out, glm::cross(a-c, pt-c)),
+		glm::dot(out, glm::cross(b-a, pt-a))
+	) / glm::dot(out, glm::cross(b-a, c-a));
+
+	//is point inside triangle?
+	if (coords.x >= 0.0f && coords.y >= 0.0f && coords.z >= 0.0f) {
+		//yes, point is inside triangle.
+		float dis2 = glm::length2(world_point - pt);
+		if (dis2 < closest_dis2) {
+			closest_dis2 = dis2;
+			closest.triangle = tri;
+			closest.index = t;
+			closest.weights = coords;
+		}
+	} else {
+		//check triangle vertices and edges:
+		auto check_edge = [&](uint32_t ai, uint32_t bi, uint32_t ci) {
+			glm::vec3 const &a = wm.vertices[ai];
+			glm::vec3 const &b = wm.vertices[bi];
+
+			//find closest point on line segment ab:
+			float along = glm::dot(world_point-a, b-a);
+			float max = glm::dot(b-a, b-a);
+			glm::vec3 pt;
+			glm::vec3 coords;
+			if (along < 0.0f) {
+				pt = a;
+				coords = glm::vec3(1.0f, 0.0f, 0.0f);
+			} else if (along > max) {
+				pt = b;
+				coords = glm::vec3(0.0f, 1.0f, 0.0f);
+			} else {
+				float amt = along / max;
+				pt = glm::mix(a, b, amt);
+				coords = glm::vec3(1.0f - amt, amt, 0.0f);
+			}
 
-		//figure out barycentric coordinates for point:
-		//project to plane of triangle:
-		glm::vec3 out = glm::cross(b-a, c-a);
-		glm::vec3 pt = world_point - out * (glm::dot(out, world_point) / glm::dot(out, out));
-
-		//figure out barycentric coordinates using signed triangle areas:
-		glm::vec3 coords = glm::vec3(
-			glm::dot(out, glm::cross(c-b, pt-b)),
-			glm::dot(out, glm::cross(a-c, pt-c)),
-			glm::dot(out, glm::cross(b-a, pt-a))
-		) / glm::dot(out, glm::cross(b-a, c-a));
-
-		//is point inside triangle?
-		if (coords.x >= 0.0f && coords.y >= 0.0f && coords.z >= 0.0f) {
-			//yes, point is inside triangle.
 			float dis2 = glm::length2(world_point - pt);
 			if (dis2 < closest_dis2) {
 				closest_dis2 = dis2;
-				closest.triangle = tri;
+				closest.triangle = glm::uvec3(ai, bi, ci);
+				closest.index = t;
 				closest.weights = coords;
 			}
-		} else {
-			//check triangle vertices and edges:
-			auto check_edge = [&world_point, &closest, &closest_dis2, this](uint32_t ai, uint32_t bi, uint32_t ci) {
-				glm::vec3 const &a = vertices[ai];
-				glm::vec3 const &b = vertices[bi];
-
-				//find closest point on line segment ab:
-				float along = glm::dot(world_point-a, b-a);
-				float max = glm::dot(b-a, b-a);
-				glm::vec3 pt;
-				glm::vec3 coords;
-				if (along < 0.0f) {
-					pt = a;
-					coords = glm::vec3(1.0f, 0.0f, 0.0f);
-				} else if (along > max) {
-					pt = b;
-					coords = glm::vec3(0.0f, 1.0f, 0.0f);
-				} else {
-					float amt = along / max;
-					pt = glm::mix(a, b, amt);
-					coords = glm::vec3(1.0f - amt, amt, 0.0f);
-				}
+		};
+		check_edge(tri.x, tri.y, tri.z);
+		check_edge(tri.y, tri.z, tri.x);
+		check_edge(tri.z, tri.x, tri.y);
+	}
+}
 
-				float dis2 = glm::length2(world_point - pt);
-				if (dis2 < closest_dis2) {
-					closest_dis2 = dis2;
-					closest.triangle = glm::uvec3(ai, bi, ci);
-					closest.weights = coords;
-				}
-			};
-			check_edge(tri.x, tri.y, tri.z);
-			check_edge(tri.y, tri.z, tri.x);
-			check_edge(tri.z, tri.x, tri.y);
+//squared distance from a point to a BVH node's box:
+static float box_dis2(WalkMesh::Node const &node, glm::vec3 const &pt) {
+	return glm::length2(pt - glm::clamp(pt, node.min, node.max));
+}
+
+//BVH traversal stack size (median splits keep depth near log2(triangles / LeafTriangles)):
+static constexpr uint32_t MaxDepth = 64;
+
+WalkMesh::WalkPoint WalkMesh::start(glm::vec3 const &world_point) const {
+	WalkPoint closest;
+	float closest_dis2 = std::numeric_limits< float >::infinity();
+	if (nodes.empty()) return closest;
+
+	//visit nodes nearest-first, skipping any farther away than the closest point so far:
+	uint32_t stack[MaxDepth];
+	uint32_t depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0) {
+		Node const &node = nodes[stack[--depth]];
+		if (box_dis2(node, world_point) >= closest_dis2) continue;
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				check_triangle(*this, node_triangles[i], world_point, closest, closest_dis2);
+			}
+		} else {
+			assert(depth + 2 <= MaxDepth);
+			bool second_nearer = box_dis2(nodes[node.first + 1], world_point) < box_dis2(nodes[node.first], world_point);
+			stack[depth++] = node.first + (second_nearer ? 0 : 1);
+			stack[depth++] = node.first + (second_nearer ? 1 : 0);
 		}
 	}
 	return closest;
 }
 
+bool WalkMesh::ray_cast(glm::vec3 const &from, glm::vec3 const &dir, WalkPoint *hit, float *t_, float max_t) const {
+	assert(hit);
+	if (nodes.empty()) return false;
+
+	glm::vec3 inv_dir = 1.0f / dir;
+	float best_t = max_t;
+	bool found = false;
+
+	//distance along the ray at which it enters a node's box (infinity if it misses):
+	auto enter = [&](Node const &node) {
+		glm::vec3 t0 = (node.min - from) * inv_dir;
+		glm::vec3 t1 = (node.max - from) * inv_dir;
+		glm::vec3 near = glm::min(t0, t1);
+		glm::vec3 far = glm::max(t0, t1);
+		float t_near = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+		float t_far = std::min(std::min(far.x, far.y), std::min(far.z, best_t));
+		return (t_near <= t_far ? t_near : std::numeric_limits< float >::infinity());
+	};
+
+	uint32_t stack[MaxDepth];
+	uint32_t depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0) {
+		Node const &node = nodes[stack[--depth]];
+		if (enter(node) > best_t) continue;
+		if (node.count) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				uint32_t t = node_triangles[i];
+				glm::uvec3 const &tri = triangles[t];
+				glm::vec3 const &a = vertices[tri.x];
+				glm::vec3 ab = vertices[tri.y] - a;
+				glm::vec3 ac = vertices[tri.z] - a;
+
+				//(Moller-Trumbore; hits either side of the triangle)
+				glm::vec3 p = glm::cross(dir, ac);
+				float det = glm::dot(ab, p);
+				if (det == 0.0f) continue;
+				glm::vec3 to_from = from - a;
+				float u = glm::dot(to_from, p) / det;
+				if (u < 0.0f || u > 1.0f) continue;
+				glm::vec3 q = glm::cross(to_from, ab);
+				float v = glm::dot(dir, q) / det;
+				if (v < 0.0f || u + v > 1.0f) continue;
+				float along = glm::dot(ac, q) / det;
+				if (along < 0.0f || along > best_t) continue;
+
+				best_t = along;
+				found = true;
+				hit->triangle = tri;
+				hit->index = t;
+				hit->weights = glm::vec3(1.0f - u - v, u, v);
+			}
+		} else {
+			assert(depth + 2 <= MaxDepth);
+			float enter_first = enter(nodes[node.first]);
+			float enter_second = enter(nodes[node.first + 1]);
+			bool second_nearer = enter_second < enter_first;
+			stack[depth++] = node.first + (second_nearer ? 0 : 1);
+			stack[depth++] = node.first + (second_nearer ? 1 : 0);
+		}
+	}
+
+	if (found && t_) *t_ = best_t;
+	return found;
+}
+
+//how far triangles[wp.index] is rotated to get wp.triangle:
+static uint32_t rotation_of(WalkMesh const &wm, WalkMesh::WalkPoint const &wp) {
+	glm::uvec3 const &tri = wm.triangles[wp.index];
+	uint32_t r = (tri.x == wp.triangle.x ? 0 : (tri.y == wp.triangle.x ? 1 : 2));
+	assert(tri[r] == wp.triangle.x && tri[(r+1)%3] == wp.triangle.y && tri[(r+2)%3] == wp.triangle.z);
+	return r;
+}
+
 void WalkMesh::walk(WalkMesh::WalkPoint &wp, glm::vec3 const &step) const {
 
 	glm::vec3 remain = step;
@@ -119,27 +321,14 @@ void WalkMesh::walk(WalkMesh::WalkPoint &wp, glm::vec3 const &step) const {
 		iter += 1;
 
 		glm::vec3 remain_coords;
-		{ //project 'remain' to current triangle:
-			glm::vec3 const &a = vertices[wp.triangle.x];
-			glm::vec3 const &b = vertices[wp.triangle.y];
-			glm::vec3 const &c = vertices[wp.triangle.z];
-
-			//project to plane of triangle:
-			glm::vec3 out = glm::cross(b-a, c-a);
-			glm::vec3 pt = remain - out * (glm::dot(out, remain) / glm::dot(out, out));
-
-			assert(pt == pt); //pt isn't NaN, right?
-
-			//figure out barycentric coordinates for remain:
-			glm::vec3 coords = glm::vec3(
-				glm::dot(out, glm::cross(c-b, pt)),
-				glm::dot(out, glm::cross(a-c, pt)),
-				glm::dot(out, glm::cross(b-a, pt))
-			) / glm::dot(out, glm::cross(b-a, c-a));
-
-			assert(coords.x == coords.x && coords.y == coords.y && coords.z == coords.z); //riiiight?
-
-			remain_coords = coords;
+		{ //figure out barycentric coordinates for remain (projected to current triangle):
+			uint32_t r = rotation_of(*this, wp);
+			glm::vec3 const *g = &gradients[3 * wp.index];
+			remain_coords = glm::vec3(
+				glm::dot(g[r], remain),
+				glm::dot(g[(r+1)%3], remain),
+				glm::dot(g[(r+2)%3], remain)
+			);
 
 			assert(remain_coords.x == remain_coords.x); //remain_coords shouldn't be NaN
 		}
@@ -178,8 +367,14 @@ void WalkMesh::walk(WalkMesh::WalkPoint &wp, glm::vec3 const &step) const {
 		remain *= (1.0f - t);
 
 		//is edge solid?
-		auto f = next_vertex.find(glm::uvec2(edge.y, edge.x));
-		if (f == next_vertex.end()) {
+		uint32_t across = -1U;
+		{
+			glm::uvec3 const &tri = triangles[wp.index];
+			for (uint32_t i = 0; i < 3; ++i) {
+				if (tri[i] == edge.x && tri[(i+1)%3] == edge.y) across = adjacency[3*wp.index + i];
+			}
+		}
+		if (across == -1U) {
 			//if yes, move remain to point (slightly) inward:
 			glm::vec3 along = glm::normalize(vertices[edge.y] - vertices[edge.x]);
 			glm::vec3 in = vertices[other] - vertices[edge.x];
@@ -192,10 +387,13 @@ void WalkMesh::walk(WalkMesh::WalkPoint &wp, glm::vec3 const &step) const {
 			//NOTE: this probably results in an infinite loop when walking into a corner.
 		} else {
 			//if no, move to new triangle:
-			assert(f->second != other);
+			uint32_t next_index = across / 3;
+			uint32_t next = triangles[next_index][(across % 3 + 2) % 3];
+			assert(next != other);
 
 			//update triangle and weights:
-			wp.triangle = glm::uvec3(edge.y, edge.x, f->second);
+			wp.triangle = glm::uvec3(edge.y, edge.x, next);
+			wp.index = next_index;
 			wp.weights = glm::vec3(edge_coords.y, edge_coords.x, 0.0f);
 
 			//rotate 'remain' around edge:
@@ -203,7 +401,7 @@ void WalkMesh::walk(WalkMesh::WalkPoint &wp, glm::vec3 const &step) const {
 			glm::vec3 to_old_other = vertices[other] - vertices[edge.x];
 			to_old_other = glm::normalize(to_old_other - along * glm::dot(along, to_old_other));
 
-			glm::vec3 to_new_other = vertices[f->second] - vertices[edge.y];
+			glm::vec3 to_new_other = vertices[next] - vertices[edge.y];
 			to_new_other = glm::normalize(to_new_other - along * glm::dot(along, to_new_other));
 
 			float d = glm::dot(remain, -to_old_other); //amount of 'remain' sticking out of old triangle
@@ -214,21 +412,104 @@ void WalkMesh::walk(WalkMesh::WalkPoint &wp, glm::vec3 const &step) const {
 	}
 }
 
+void WalkMesh::WalkPoints::resize(size_t size) {
+	index.resize(size, -1U);
+	rotation.resize(size, 0);
+	weight_x.resize(size, std::numeric_limits< float >::quiet_NaN());
+	weight_y.resize(size, std::numeric_limits< float >::quiet_NaN());
+	weight_z.resize(size, std::numeric_limits< float >::quiet_NaN());
+}
+
+WalkMesh::WalkPoint WalkMesh::get(WalkPoints const &wps, size_t i) const {
+	assert(i < wps.size());
+	WalkPoint wp;
+	wp.index = wps.index[i];
+	glm::uvec3 const &tri = triangles[wp.index];
+	uint32_t r = wps.rotation[i];
+	wp.triangle = glm::uvec3(tri[r], tri[(r+1)%3], tri[(r+2)%3]);
+	wp.weights = glm::vec3(wps.weight_x[i], wps.weight_y[i], wps.weight_z[i]);
+	return wp;
+}
+
+void WalkMesh::set(WalkPoints &wps, size_t i, WalkPoint const &wp) const {
+	assert(i < wps.size());
+	wps.index[i] = wp.index;
+	wps.rotation[i] = uint8_t(rotation_of(*this, wp));
+	wps.weight_x[i] = wp.weights.x;
+	wps.weight_y[i] = wp.weights.y;
+	wps.weight_z[i] = wp.weights.z;
+}
+
+void WalkMesh::walk(WalkPoints &wps, float const *step_x, float const *step_y, float const *step_z) const {
+	size_t i = 0;
+#ifdef WALKMESH_SSE
+	//four points at a time: compute new weights, keep them for points that stayed inside their triangles:
+	static uint32_t const Wrap[5] = { 0, 1, 2, 0, 1 }; //(r+w)%3
+	for (; i + 4 <= wps.size(); i += 4) {
+		//gather each point's gradients (in the order of its weights):
+		alignas(16) float g[3][3][4]; //[weight][axis][point]
+		for (uint32_t p = 0; p < 4; ++p) {
+			glm::vec3 const *tri_g = &gradients[3 * wps.index[i+p]];
+			uint32_t r = wps.rotation[i+p];
+			for (uint32_t w = 0; w < 3; ++w) {
+				glm::vec3 const &gw = tri_g[Wrap[r+w]];
+				g[w][0][p] = gw.x;
+				g[w][1][p] = gw.y;
+				g[w][2][p] = gw.z;
+			}
+		}
+		__m128 sx = _mm_loadu_ps(step_x + i);
+		__m128 sy = _mm_loadu_ps(step_y + i);
+		__m128 sz = _mm_loadu_ps(step_z + i);
+		__m128 const zero = _mm_setzero_ps();
+		__m128 weights[3];
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		float *wp_weights[3] = { &wps.weight_x[i], &wps.weight_y[i], &wps.weight_z[i] };
+		for (uint32_t w = 0; w < 3; ++w) {
+			//(same order of operations as glm::dot in walk(), so results match it exactly)
+			__m128 d = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_load_ps(g[w][0]), sx),
+				_mm_mul_ps(_mm_load_ps(g[w][1]), sy)),
+				_mm_mul_ps(_mm_load_ps(g[w][2]), sz));
+			weights[w] = _mm_add_ps(_mm_loadu_ps(wp_weights[w]), d);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(weights[w], zero));
+		}
+		int mask = _mm_movemask_ps(inside);
+		if (mask == 0xf) {
+			for (uint32_t w = 0; w < 3; ++w) _mm_storeu_ps(wp_weights[w], weights[w]);
+			continue;
+		}
+		alignas(16) float new_weights[3][4];
+		for (uint32_t w = 0; w < 3; ++w) _mm_store_ps(new_weights[w], weights[w]);
+		for (uint32_t p = 0; p < 4; ++p) {
+			if (mask & (1 << p)) {
+				for (uint32_t w = 0; w < 3; ++w) wp_weights[w][p] = new_weights[w][p];
+			} else {
+				//crossed (or touched) an edge:
+				WalkPoint wp = get(wps, i+p);
+				walk(wp, glm::vec3(step_x[i+p], step_y[i+p], step_z[i+p]));
+				set(wps, i+p, wp);
+			}
+		}
+	}
+#endif
+	for (; i < wps.size(); ++i) {
+		WalkPoint wp = get(wps, i);
+		walk(wp, glm::vec3(step_x[i], step_y[i], step_z[i]));
+		set(wps, i, wp);
+	}
+}
 
 WalkMeshes::WalkMeshes(std::string const &filename) {
-	std::ifstream file(filename, std::ios::binary);
+	ChunkFile file(filename);
 
-	std::vector< glm::vec3 > vertices;
-	read_chunk(file, "p...", &vertices);
+	ChunkFile::Span< glm::vec3 > vertices = file.read< glm::vec3 >("p...");
 
-	std::vector< glm::vec3 > normals;
-	read_chunk(file, "n...", &normals);
+	ChunkFile::Span< glm::vec3 > normals = file.read< glm::vec3 >("n...");
 
-	std::vector< glm::uvec3 > triangles;
-	read_chunk(file, "tri0", &triangles);
+	ChunkFile::Span< glm::uvec3 > triangles = file.read< glm::uvec3 >("tri0");
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	ChunkFile::Span< char > names = file.read< char >("str0");
 
 	struct IndexEntry {
 		uint32_t name_begin, name_end;
@@ -236,10 +517,18 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 		uint32_t triangle_begin, triangle_end;
 	};
 
-	std::vector< IndexEntry > index;
-	read_chunk(file, "idxA", &index);
+	ChunkFile::Span< IndexEntry > index = file.read< IndexEntry >("idxA");
+
+	//what's over each edge, as in WalkMesh::adjacency (computed at load for files exported without it):
+	ChunkFile::Span< uint32_t > adjacency;
+	if (file.next_magic() == "adj0") {
+		adjacency = file.read< uint32_t >("adj0");
+		if (adjacency.size() != triangles.size() * 3) {
+			throw std::runtime_error("Mis-matched adjacency and triangle sizes in '" + filename + "'");
+		}
+	}
 
-	if (file.peek() != EOF) {
+	if (!file.at_end()) {
 		std::cerr << "WARNING: trailing data in walkmesh file '" << filename << "'" << std::endl;
 	}
 
@@ -279,9 +568,20 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 			);
 		}
 		
+		//copy adjacency (already relative to the mesh's first triangle):
+		std::vector< uint32_t > wm_adjacency;
+		if (!adjacency.empty()) {
+			wm_adjacency.assign(adjacency.begin() + 3 * e.triangle_begin, adjacency.begin() + 3 * e.triangle_end);
+			for (uint32_t a : wm_adjacency) {
+				if (!(a == -1U || a < wm_adjacency.size())) {
+					throw std::runtime_error("Invalid adjacency in '" + filename + "'");
+				}
+			}
+		}
+
 		std::string name(names.begin() + e.name_begin, names.begin() + e.name_end);
 
-		auto ret = meshes.emplace(name, WalkMesh(wm_vertices, wm_normals, wm_triangles));
+		auto ret = meshes.emplace(name, WalkMesh(wm_vertices, wm_normals, wm_triangles, wm_adjacency));
 		if (!ret.second) {
 			throw std::runtime_error("WalkMesh with duplicated name '" + name + "' in '" + filename + "'");
 		}
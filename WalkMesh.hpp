@@ -1,11 +1,11 @@
 #pragma once
 
+#include <glm/glm.hpp>
+
 #include <vector>
-#include <unordered_map>
 #include <map>
-
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp> //allows the use of 'uvec2' as an unordered_map key
+#include <string>
+#include <limits>
 
 struct WalkMesh {
 	//Walk mesh will keep track of triangles, vertices:
@@ -13,25 +13,64 @@ struct WalkMesh {
 	std::vector< glm::vec3 > normals; //normals for interpolated 'up' direction
 	std::vector< glm::uvec3 > triangles; //CCW-oriented
 
-	//This "next vertex" map includes [a,b]->c, [b,c]->a, and [c,a]->b for each triangle, and is useful for checking what's over an edge from a given point:
-	std::unordered_map< glm::uvec2, uint32_t > next_vertex;
-
+	//What's over each edge: adjacency[3*t+i] describes the triangle across edge i of triangle t
+	// (the edge from vertex i to vertex (i+1)%3), as 3*(neighbor triangle)+(matching edge in neighbor),
+	// or -1U if the edge is solid:
+	std::vector< uint32_t > adjacency;
+
+	//How each barycentric weight changes per unit step (in the plane of the triangle):
+	// gradients[3*t+i] is for vertex i of triangle t, so a step's change in weights is three dot products:
+	std::vector< glm::vec3 > gradients;
+
+	//Bounding volume hierarchy over the triangles (for start() and ray_cast()):
+	struct Node {
+		glm::vec3 min = glm::vec3(std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		uint32_t first = 0; //leaf: first entry in node_triangles; otherwise: index of first child (second child follows it)
+		uint32_t count = 0; //leaf: number of triangles; otherwise: 0
+	};
+	std::vector< Node > nodes; //nodes[0] is the root
+	std::vector< uint32_t > node_triangles; //triangle indices, in leaf order
 
-	//Construct new WalkMesh and build next_vertex structure:
-	WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_);
+	//Construct new WalkMesh, build BVH, and build adjacency (if not supplied, e.g. from the file):
+	WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_, std::vector< uint32_t > const &adjacency_ = std::vector< uint32_t >());
 
 	struct WalkPoint {
-		glm::uvec3 triangle = glm::uvec3(-1U); //indices of current triangle
+		glm::uvec3 triangle = glm::uvec3(-1U); //indices of current triangle (rotated so that they match 'weights')
+		uint32_t index = -1U; //index of current triangle in 'triangles'
 		glm::vec3 weights = glm::vec3(std::numeric_limits< float >::quiet_NaN()); //barycentric coordinates for current point
 	};
 
 	//used to initialize walking -- finds the closest point on the walk mesh:
-	// (should only need to call this at the start of a level)
+	// (uses the BVH, so is cheap enough to use for respawns and teleports)
 	WalkPoint start(glm::vec3 const &world_point) const;
 
+	//finds the first point on the walk mesh along the ray 'from + t * dir' with 0 <= t <= 'max_t':
+	// returns false if there isn't one; otherwise sets 'hit' (and 't', if not null)
+	bool ray_cast(glm::vec3 const &from, glm::vec3 const &dir, WalkPoint *hit, float *t = nullptr, float max_t = std::numeric_limits< float >::infinity()) const;
+
 	//used to update walk point:
 	void walk(WalkPoint &wp, glm::vec3 const &step) const;
 
+	//Many walk points (e.g. server-side bots, or NPCs walking the seafloor) stored as parallel arrays,
+	// so they can all be moved in one call:
+	struct WalkPoints {
+		std::vector< uint32_t > index; //index of current triangle in 'triangles'
+		std::vector< uint8_t > rotation; //WalkPoint::triangle is triangles[index] rotated left this many places
+		std::vector< float > weight_x, weight_y, weight_z; //barycentric coordinates (in rotated order)
+
+		size_t size() const { return index.size(); }
+		void resize(size_t size);
+	};
+
+	//convert between WalkPoint and entries of WalkPoints:
+	WalkPoint get(WalkPoints const &wps, size_t i) const;
+	void set(WalkPoints &wps, size_t i, WalkPoint const &wp) const;
+
+	//take step (step_x[i], step_y[i], step_z[i]) from each walk point:
+	// (steps that stay within their triangle are done four-at-a-time; the rest go through walk() above)
+	void walk(WalkPoints &wps, float const *step_x, float const *step_y, float const *step_z) const;
+
 	//used to read back results of walking:
 	glm::vec3 world_point(WalkPoint const &wp) const {
 		return wp.weights.x * vertices[wp.triangle.x]
@@ -1,81 +1,75 @@
 #include "bone_vertex_color_program.hpp"
 
 #include "compile_program.hpp"
-
-#ifndef STR
-#define STR2(X) #X
-#define STR(X) STR2(X)
-#endif
+#include "vertex_color_program.hpp"
 
 BoneVertexColorProgram::BoneVertexColorProgram() {
 	program = compile_program(
 		"#version 330\n"
-		"uniform mat4 object_to_clip;\n"
-		"uniform mat4x3 object_to_light;\n"
-		"uniform mat3 normal_to_light;\n"
-		"uniform mat4x3 bones[" STR( BONE_LIMIT ) "];\n"
+		"uniform mat4 world_to_clip;\n"
+		"uniform samplerBuffer instances;\n"
+		"uniform int instance_stride;\n"
 		"layout(location=0) in vec4 Position;\n" //note: layout keyword used to make sure that the location-0 attribute is always bound to something
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
 		"in vec4 BoneWeights;\n"
 		"in uvec4 BoneIndices;\n"
-		"out vec3 position;\n"
+		"out vec4 position;\n"
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
+		"const vec3 ExportedSuitColor = vec3(13.0, 27.0, 88.0) / 255.0;\n"
+		//per-instance data (see SkinnedBatch.hpp): 4x3 matrices are stored as three row texels:
+		"mat4x3 fetch_mat4x3(int at) {\n"
+		"	return transpose(mat3x4(texelFetch(instances, at), texelFetch(instances, at+1), texelFetch(instances, at+2)));\n"
+		"}\n"
 		"void main() {\n"
+		"	int base = gl_InstanceID * instance_stride;\n"
+		"	mat4x3 object_to_world = fetch_mat4x3(base);\n"
+		"	mat3 normal_to_world = mat3(texelFetch(instances, base+3).xyz, texelFetch(instances, base+4).xyz, texelFetch(instances, base+5).xyz);\n"
+		"	vec3 suit_color = texelFetch(instances, base+6).rgb;\n"
+		"	int bones = base + 7;\n"
+		"	mat4x3 bone_x = fetch_mat4x3(bones + 3 * int(BoneIndices.x));\n"
+		"	mat4x3 bone_y = fetch_mat4x3(bones + 3 * int(BoneIndices.y));\n"
+		"	mat4x3 bone_z = fetch_mat4x3(bones + 3 * int(BoneIndices.z));\n"
+		"	mat4x3 bone_w = fetch_mat4x3(bones + 3 * int(BoneIndices.w));\n"
 		"	vec3 blended_Position = \n"
-		"		( BoneWeights.x * bones[ BoneIndices.x ]\n"
-		"		+ BoneWeights.y * bones[ BoneIndices.y ]\n"
-		"		+ BoneWeights.z * bones[ BoneIndices.z ]\n"
-		"		+ BoneWeights.w * bones[ BoneIndices.w ] ) * Position;\n"
+		"		( BoneWeights.x * bone_x\n"
+		"		+ BoneWeights.y * bone_y\n"
+		"		+ BoneWeights.z * bone_z\n"
+		"		+ BoneWeights.w * bone_w ) * Position;\n"
 		"	vec3 blended_Normal = \n"
-		"		( BoneWeights.x * mat3(bones[ BoneIndices.x ])\n"
-		"		+ BoneWeights.y * mat3(bones[ BoneIndices.y ])\n"
-		"		+ BoneWeights.z * mat3(bones[ BoneIndices.z ])\n"
-		"		+ BoneWeights.w * mat3(bones[ BoneIndices.w ]) ) * Normal;\n" //<-- note: not correct if bones do scaling
-		"	gl_Position = object_to_clip * vec4(blended_Position, 1.0);\n"
-		"	position = object_to_light * vec4(blended_Position, 1.0);\n"
-		"	normal = normal_to_light * blended_Normal;\n"
-		"	color = Color;\n"
+		"		( BoneWeights.x * mat3(bone_x)\n"
+		"		+ BoneWeights.y * mat3(bone_y)\n"
+		"		+ BoneWeights.z * mat3(bone_z)\n"
+		"		+ BoneWeights.w * mat3(bone_w) ) * Normal;\n" //<-- note: not correct if bones do scaling
+		"	vec3 world_Position = object_to_world * vec4(blended_Position, 1.0);\n"
+		"	gl_Position = world_to_clip * vec4(world_Position, 1.0);\n"
+		"	position = vec4(world_Position, 1.0);\n"
+		"	normal = normal_to_world * blended_Normal;\n"
+		"	bool is_suit = all(lessThan(abs(Color.rgb - ExportedSuitColor), vec3(0.5 / 255.0)));\n"
+		"	color = (is_suit ? vec4(suit_color, Color.a) : Color);\n"
 		"}\n"
 		,
-		"#version 330\n"
-		"uniform vec3 sun_direction;\n"
-		"uniform vec3 sun_color;\n"
-		"uniform vec3 sky_direction;\n"
-		"uniform vec3 sky_color;\n"
-		"in vec3 position;\n"
-		"in vec3 normal;\n"
-		"in vec4 color;\n"
-		"out vec4 fragColor;\n"
-		"void main() {\n"
-		"	vec3 total_light = vec3(0.0, 0.0, 0.0);\n"
-		"	vec3 n = normalize(normal);\n"
-		"	{ //sky (hemisphere) light:\n"
-		"		vec3 l = sky_direction;\n"
-		"		float nl = 0.5 + 0.5 * dot(n,l);\n"
-		"		total_light += nl * sky_color;\n"
-		"	}\n"
-		"	{ //sun (directional) light:\n"
-		"		vec3 l = sun_direction;\n"
-		"		float nl = max(0.0, dot(n,l));\n"
-		"		total_light += nl * sun_color;\n"
-		"	}\n"
-		// "	fragColor = vec4(color.rgb * total_light, color.a);\n"
-		"	fragColor = vec4(color.rgb * 0.5, color.a);\n"
-		"}\n"
+		vertex_color_fragment_shader
 	);
 
-	object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
-	object_to_light_mat4x3 = glGetUniformLocation(program, "object_to_light");
-	normal_to_light_mat3 = glGetUniformLocation(program, "normal_to_light");
-
-	bones_mat4x3_array = glGetUniformLocation(program, "bones");
+	world_to_clip_mat4 = glGetUniformLocation(program, "world_to_clip");
+	instance_stride_int = glGetUniformLocation(program, "instance_stride");
 
 	sun_direction_vec3 = glGetUniformLocation(program, "sun_direction");
 	sun_color_vec3 = glGetUniformLocation(program, "sun_color");
 	sky_direction_vec3 = glGetUniformLocation(program, "sky_direction");
 	sky_color_vec3 = glGetUniformLocation(program, "sky_color");
+	view_pos_vec3 = glGetUniformLocation(program, "view_pos");
+
+	world_to_static_shadow_mat4 = glGetUniformLocation(program, "world_to_static_shadow");
+	world_to_dynamic_shadow_mat4 = glGetUniformLocation(program, "world_to_dynamic_shadow");
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "static_shadow_tex"), VertexColorProgram::StaticShadowUnit);
+	glUniform1i(glGetUniformLocation(program, "dynamic_shadow_tex"), VertexColorProgram::DynamicShadowUnit);
+	glUniform1i(glGetUniformLocation(program, "instances"), InstancesUnit);
+	glUseProgram(0);
 }
 
 Load< BoneVertexColorProgram > bone_vertex_color_program(LoadTagInit, [](){
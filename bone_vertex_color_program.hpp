@@ -1,21 +1,28 @@
 #include "GL.hpp"
 #include "Load.hpp"
 
-#define BONE_LIMIT 40
-
+//skinned, instanced version of vertex_color_program (same lighting, same shadow texture units):
+// each instance's transform, suit color, and bones are read from a texture buffer -- see SkinnedBatch.hpp
 struct BoneVertexColorProgram {
 	//opengl program object:
 	GLuint program = 0;
 
+	//texture unit for the per-instance texture buffer:
+	enum : GLuint { InstancesUnit = 6 };
+
 	//uniform locations:
-	GLuint object_to_clip_mat4 = -1U;
-	GLuint object_to_light_mat4x3 = -1U;
-	GLuint normal_to_light_mat3 = -1U;
-	GLuint bones_mat4x3_array = -1U;
+	GLuint world_to_clip_mat4 = -1U;
+	GLuint instance_stride_int = -1U;
 	GLuint sun_direction_vec3 = -1U;
 	GLuint sun_color_vec3 = -1U;
 	GLuint sky_direction_vec3 = -1U;
 	GLuint sky_color_vec3 = -1U;
+	GLuint view_pos_vec3 = -1U;
+	GLuint world_to_static_shadow_mat4 = -1U;
+	GLuint world_to_dynamic_shadow_mat4 = -1U;
+
+	//vertices colored ExportedSuitColor (the diver's suit, as exported) are drawn in each instance's suit color
+	// instead, so one skinned mesh can be used for both teams
 
 	BoneVertexColorProgram();
 };
@@ -0,0 +1,547 @@
+//bot_client connects many headless "divers" to a server, for load testing:
+//  ./bot_client <host> <port> [--bots N] [--behavior wander|chase|shoot|mix] [--rate HZ] [--players N] [--spectators N] [--seconds S] [--report S] [--seed N]
+// each bot speaks the same protocol as the real client: the lobby messages of LobbyMode ('n', 'k'; decoding 'u', 't', 'b')
+// and the game messages of GameMode (sending 'p', decoding 's'). Bots ready up once the lobby holds --players players
+// (default: the number of bots), then play until --seconds have passed (default: forever).
+// Every --report seconds (default 5) it prints, over all bots:
+//  - bandwidth: bytes sent and received per second (total and per bot)
+//  - latency: time from sending an action to getting back a state that contains it (i.e., action -> server tick -> state),
+//    found by matching the bot's own echoed position against positions it sent. Positions the server never echoes
+//    exactly -- overwritten by a newer action before a tick, or moved by a collision -- give no sample and are counted
+//    as "unmatched" instead, so in crowded tests (many collisions) the samples skew toward uncrowded moments.
+//  - tick jitter: spread of the time between consecutive state packets
+// With --spectators, it also opens that many spectator connections (see Spectator.hpp) -- to the server, or to a relay --
+// and reports their bandwidth and snapshot rate.
+// (each bot is a socket; raise the open file limit -- e.g., 'ulimit -n 4096' -- for more than a few hundred bots.)
+
+#include "Connection.hpp"
+#include "GameState.hpp"
+#include "Spectator.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <cmath>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+enum Behavior {
+	Wander, //swim around near spawn
+	Chase, //go for the other team's treasure and bring it home
+	Shoot, //wander, harpooning nearby divers of the other team
+};
+
+//measurements, accumulated over a report window:
+struct Stats {
+	uint64_t bytes_sent = 0;
+	uint64_t bytes_received = 0;
+	uint32_t actions = 0; //'p' packets sent
+	uint32_t states = 0; //'s' packets received
+	uint64_t entries = 0; //players in those packets
+	std::vector< float > latencies; //seconds from action to state containing it
+	uint32_t unmatched = 0; //sent positions that were never echoed (so have no latency sample)
+	std::vector< float > intervals; //seconds between consecutive state packets
+
+	void add(Stats const &other) {
+		bytes_sent += other.bytes_sent;
+		bytes_received += other.bytes_received;
+		actions += other.actions;
+		states += other.states;
+		entries += other.entries;
+		latencies.insert(latencies.end(), other.latencies.begin(), other.latencies.end());
+		unmatched += other.unmatched;
+		intervals.insert(intervals.end(), other.intervals.begin(), other.intervals.end());
+	}
+};
+
+struct Bot {
+	Bot(std::string const &host, std::string const &port, uint32_t index, Behavior behavior, uint32_t seed);
+
+	Client client;
+	uint32_t index;
+	Behavior behavior;
+	std::mt19937 rng;
+
+	//lobby (as in LobbyMode):
+	int team = 0;
+	int player_id = -1;
+	int player_count = 0;
+	std::vector< int > player_teams;
+	bool sent_ready = false;
+	bool playing = false; //(got 'b')
+
+	//game (as in GameMode; other players are only known through 's' packets):
+	bool first_msg_received = false;
+	bool is_shot = false;
+	std::vector< Player > players;
+	std::vector< Harpoon > harpoons;
+	Treasure treasures[GameState::num_teams];
+
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 velocity = glm::vec3(0.0f);
+	glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3 spawn = glm::vec3(0.0f);
+	glm::vec3 wander_dir = glm::vec3(0.0f);
+	float wander_timer = 0.0f;
+	float fire_timer = 0.0f;
+	float grab_timer = 0.0f;
+
+	//actions not yet seen in a state ('position' is what the server echoes back):
+	struct Pending {
+		glm::vec3 position;
+		Clock::time_point sent;
+	};
+	std::vector< Pending > pending;
+	Clock::time_point last_state;
+	size_t recv_seen = 0; //recv_buffer bytes already counted
+
+	Stats stats;
+
+	void send_lobby_info();
+	void send_ready();
+	void poll();
+	bool handle_message(Connection *c); //false if message is incomplete
+	void decode_state(char const *data);
+	void act(float elapsed);
+};
+
+Bot::Bot(std::string const &host, std::string const &port, uint32_t index_, Behavior behavior_, uint32_t seed)
+	: client(host, port), index(index_), behavior(behavior_), rng(seed + index_) {
+	#ifndef _WIN32
+	if (client.connection.socket >= FD_SETSIZE) {
+		throw std::runtime_error("Too many sockets for select() (bot " + std::to_string(index) + ").");
+	}
+	#endif
+	team = int(index % GameState::num_teams);
+	send_lobby_info();
+}
+
+void Bot::send_lobby_info() {
+	Connection *c = &client.connection;
+	if (*c) {
+		std::string nickname = "bot" + std::to_string(index);
+		nickname.resize(Player::NICKNAME_LENGTH, ' ');
+		size_t before = c->send_buffer.size();
+		c->send('n'); //team and name
+		c->send(team);
+		c->send_raw(nickname.c_str(), Player::NICKNAME_LENGTH);
+		stats.bytes_sent += c->send_buffer.size() - before;
+	}
+}
+
+void Bot::send_ready() {
+	Connection *c = &client.connection;
+	if (*c) {
+		bool ready = true;
+		size_t before = c->send_buffer.size();
+		c->send('k'); //ready update
+		c->send(ready);
+		stats.bytes_sent += c->send_buffer.size() - before;
+	}
+	sent_ready = true;
+}
+
+void Bot::poll() {
+	client.poll([&](Connection *c, Connection::Event event) {
+		if (event == Connection::OnClose) {
+			std::cerr << "WARNING: bot " << index << " lost connection to server." << std::endl;
+		} else if (event == Connection::OnRecv) {
+			stats.bytes_received += c->recv_buffer.size() - recv_seen;
+			while (!c->recv_buffer.empty() && handle_message(c)) { }
+			recv_seen = c->recv_buffer.size();
+		}
+	}, 0.0);
+}
+
+bool Bot::handle_message(Connection *c) {
+	std::vector< char > &buffer = c->recv_buffer;
+	if (buffer[0] == 'u') {
+		//lobby update- number of players and this player's ID
+		if (buffer.size() < 1 + 2 * sizeof(int)) return false;
+		memcpy(&player_count, buffer.data() + 1 + 0 * sizeof(int), sizeof(int));
+		memcpy(&player_id, buffer.data() + 1 + 1 * sizeof(int), sizeof(int));
+		buffer.erase(buffer.begin(), buffer.begin() + 1 + 2 * sizeof(int));
+	} else if (buffer[0] == 't') {
+		//team info (bots keep the team they picked, but need to know who is on which team)
+		size_t len = 1 + player_count * (Player::NICKNAME_LENGTH * sizeof(char) + sizeof(int));
+		if (buffer.size() < len) return false;
+		player_teams.resize(player_count);
+		for (int i = 0; i < player_count; i++) {
+			memcpy(&player_teams[i], buffer.data() + 1 + i * (Player::NICKNAME_LENGTH * sizeof(char) + sizeof(int)), sizeof(int));
+		}
+		buffer.erase(buffer.begin(), buffer.begin() + len);
+	} else if (buffer[0] == 'b') {
+		//begin game
+		buffer.erase(buffer.begin(), buffer.begin() + 1);
+		if (!(player_id >= 0 && player_id < player_count)) throw std::runtime_error("bot " + std::to_string(index) + " began a game without a valid player id.");
+		playing = true;
+		player_teams.resize(player_count, -1);
+		players.resize(player_count);
+		harpoons.resize(player_count);
+	} else if (buffer[0] == 's') {
+		if (!playing) throw std::runtime_error("bot " + std::to_string(index) + " got a state before the game began (did the server's game start without it?).");
+		//state update (layout as in send_state() in server.cpp / GameMode::poll_server):
+		if (buffer.size() < 1 + sizeof(uint32_t)) return false;
+		uint32_t size = 0;
+		memcpy(&size, buffer.data() + 1, sizeof(uint32_t));
+		size_t packet_len = 1 + sizeof(uint32_t) + size;
+		if (buffer.size() < packet_len) return false;
+
+		Clock::time_point now = Clock::now();
+		if (first_msg_received) {
+			stats.intervals.emplace_back(std::chrono::duration< float >(now - last_state).count());
+		}
+		last_state = now;
+		stats.states += 1;
+
+		decode_state(buffer.data());
+		buffer.erase(buffer.begin(), buffer.begin() + packet_len);
+
+		if (!first_msg_received) {
+			//start from wherever the server spawned us:
+			position = spawn = players[player_id].position;
+			rotation = players[player_id].rotation;
+			first_msg_received = true;
+		}
+
+		//latency: the state echoes the last position the server got from us:
+		glm::vec3 echoed = players[player_id].position;
+		for (size_t i = pending.size(); i > 0; --i) {
+			if (pending[i-1].position == echoed) {
+				stats.latencies.emplace_back(std::chrono::duration< float >(now - pending[i-1].sent).count());
+				stats.unmatched += uint32_t(i - 1);
+				pending.erase(pending.begin(), pending.begin() + i);
+				break;
+			}
+		}
+	} else {
+		throw std::runtime_error("bot " + std::to_string(index) + " got unknown message type '" + std::string(1, buffer[0]) + "'.");
+	}
+	return true;
+}
+
+void Bot::decode_state(char const *data) {
+	data += 1 + sizeof(uint32_t);
+	memcpy(&is_shot, data, sizeof(bool));
+	data += 1 * sizeof(bool) + 2 * sizeof(uint32_t); //(skip current points)
+	uint32_t count = 0;
+	memcpy(&count, data, sizeof(uint32_t));
+	data += sizeof(uint32_t);
+	stats.entries += count;
+	for (uint32_t e = 0; e < count; e++) {
+		uint32_t i = 0;
+		memcpy(&i, data, sizeof(uint32_t));
+		data += sizeof(uint32_t);
+		if (i >= players.size()) throw std::runtime_error("bot " + std::to_string(index) + " got a state for unknown player " + std::to_string(i) + ".");
+		memcpy(&players[i].position, data + 0 * sizeof(float), sizeof(glm::vec3));
+		memcpy(&players[i].velocity, data + 3 * sizeof(float), sizeof(glm::vec3));
+		memcpy(&players[i].rotation, data + 6 * sizeof(float), sizeof(glm::quat));
+		memcpy(&harpoons[i].state, data + 10 * sizeof(float), sizeof(int));
+		memcpy(&harpoons[i].position, data + 10 * sizeof(float) + sizeof(int), sizeof(glm::vec3));
+		memcpy(&harpoons[i].velocity, data + 13 * sizeof(float) + sizeof(int), sizeof(glm::vec3));
+		memcpy(&harpoons[i].rotation, data + 16 * sizeof(float) + sizeof(int), sizeof(glm::quat));
+		data += 20 * sizeof(float) + sizeof(int);
+	}
+	for (uint32_t j = 0; j < GameState::num_teams; j++) {
+		memcpy(&treasures[j].position, data, sizeof(glm::vec3));
+		memcpy(&treasures[j].held_by, data + sizeof(glm::vec3), sizeof(int));
+		treasures[j].team = int(j);
+		data += 3 * sizeof(float) + sizeof(int);
+	}
+}
+
+//rotation that points the diver's facing direction (local +y; see GameState::update) along 'dir':
+static glm::quat facing(glm::vec3 const &dir) {
+	float len = glm::length(dir);
+	if (len < 1e-4f) return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	return glm::rotation(glm::vec3(0.0f, 1.0f, 0.0f), dir / len);
+}
+
+void Bot::act(float elapsed) {
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+
+	bool fire = false;
+	bool grab = false;
+	wander_timer -= elapsed;
+	fire_timer -= elapsed;
+	grab_timer -= elapsed;
+
+	//wander: swim in a random direction, turning every few seconds, and head back if too far from spawn:
+	if (wander_timer <= 0.0f) {
+		wander_dir = glm::vec3(unit(rng), unit(rng), 0.2f * unit(rng));
+		wander_timer = 2.0f + unit(rng);
+	}
+	glm::vec3 goal_dir = wander_dir;
+	if (glm::length(position - spawn) > 15.0f) goal_dir = spawn - position;
+
+	if (behavior == Chase) {
+		uint32_t other = uint32_t(team + 1) % GameState::num_teams;
+		Treasure const &treasure = treasures[other];
+		if (treasure.held_by == player_id) {
+			goal_dir = spawn - position; //bring it home
+		} else if (treasure.held_by >= 0 && treasure.held_by < player_count) {
+			goal_dir = players[treasure.held_by].position - position;
+		} else {
+			goal_dir = treasure.position - position;
+			if (glm::length(goal_dir) < 1.5f && grab_timer <= 0.0f) {
+				grab = true;
+				grab_timer = 0.5f;
+			}
+		}
+	}
+
+	glm::vec3 face_dir = goal_dir;
+	if (behavior == Shoot && fire_timer <= 0.0f && harpoons[player_id].state == 0) {
+		//aim at the nearest diver within harpoon range:
+		float best = 15.0f;
+		for (int i = 0; i < player_count; i++) {
+			if (player_teams[i] == team) continue;
+			float dist = glm::length(players[i].position - position);
+			if (dist < best) {
+				best = dist;
+				face_dir = players[i].position - position;
+				fire = true;
+			}
+		}
+		if (fire) fire_timer = 1.0f;
+	}
+
+	//movement (as in GameMode::update):
+	if (!is_shot) {
+		float len = glm::length(goal_dir);
+		float speed = GameState::default_player_speed;
+		glm::vec3 goal_vel = (len > 1e-4f ? (speed / len) * goal_dir : glm::vec3(0.0f));
+		velocity = glm::mix(velocity, goal_vel, std::min(1.0f, 2.5f * elapsed));
+		position += velocity * elapsed;
+	}
+	rotation = facing(face_dir);
+
+	Connection *c = &client.connection;
+	if (*c) {
+		size_t before = c->send_buffer.size();
+		c->send('p'); //player update
+		c->send(position);
+		c->send(velocity);
+		c->send(rotation);
+		c->send(fire);
+		c->send(grab);
+		stats.bytes_sent += c->send_buffer.size() - before;
+		stats.actions += 1;
+
+		if (pending.empty() || pending.back().position != position) {
+			pending.emplace_back(Pending{position, Clock::now()});
+			if (pending.size() > 256) { //(server isn't echoing; don't grow forever)
+				pending.erase(pending.begin());
+				stats.unmatched += 1;
+			}
+		}
+	}
+}
+
+//spectators just count what they're sent:
+struct Watcher {
+	Watcher(std::string const &host, std::string const &port) : client(host, port) {
+		#ifndef _WIN32
+		if (client.connection.socket >= FD_SETSIZE) throw std::runtime_error("Too many sockets for select() (spectator).");
+		#endif
+		client.connection.send('w'); //watch
+	}
+	Client client;
+	Clock::time_point last_snapshot;
+	bool got_snapshot = false;
+	Stats stats; //(uses bytes_received, states for snapshots, intervals)
+
+	void poll() {
+		client.poll([&](Connection *c, Connection::Event event) {
+			if (event == Connection::OnClose) {
+				std::cerr << "WARNING: spectator lost connection." << std::endl;
+			} else if (event == Connection::OnRecv) {
+				size_t size;
+				while ((size = Spectator::message_size(c->recv_buffer)) != 0) {
+					if (c->recv_buffer[0] == 'v') {
+						Clock::time_point now = Clock::now();
+						if (got_snapshot) stats.intervals.emplace_back(std::chrono::duration< float >(now - last_snapshot).count());
+						last_snapshot = now;
+						got_snapshot = true;
+						stats.states += 1;
+					}
+					stats.bytes_received += size;
+					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + size);
+				}
+			}
+		}, 0.0);
+	}
+};
+
+//value at fraction 'f' of sorted 'values':
+static float percentile(std::vector< float > const &values, float f) {
+	if (values.empty()) return 0.0f;
+	size_t i = std::min(values.size() - 1, size_t(f * values.size()));
+	return values[i];
+}
+
+static void report(std::string const &label, Stats &stats, float seconds, uint32_t bots, uint32_t playing) {
+	std::sort(stats.latencies.begin(), stats.latencies.end());
+	std::sort(stats.intervals.begin(), stats.intervals.end());
+	double mean = 0.0, variance = 0.0;
+	for (float i : stats.intervals) mean += i;
+	if (!stats.intervals.empty()) mean /= stats.intervals.size();
+	for (float i : stats.intervals) variance += (i - mean) * (i - mean);
+	if (!stats.intervals.empty()) variance /= stats.intervals.size();
+
+	float per = 1.0f / std::max(seconds, 1e-3f);
+	float bot_per = per / float(std::max(bots, 1U));
+	std::cout << label << ": " << playing << "/" << bots << " bots playing\n"
+		<< "  bandwidth: " << (stats.bytes_sent * per / 1024.0f) << " KiB/s up, " << (stats.bytes_received * per / 1024.0f) << " KiB/s down"
+		<< " (per bot: " << (stats.bytes_sent * bot_per / 1024.0f) << " up, " << (stats.bytes_received * bot_per / 1024.0f) << " down)\n"
+		<< "  packets: " << (stats.actions * per) << " actions/s, " << (stats.states * per) << " states/s, "
+		<< (stats.states ? double(stats.entries) / stats.states : 0.0) << " players per state\n"
+		<< "  latency (ms): p50 " << 1000.0f * percentile(stats.latencies, 0.5f)
+		<< ", p95 " << 1000.0f * percentile(stats.latencies, 0.95f)
+		<< ", p99 " << 1000.0f * percentile(stats.latencies, 0.99f)
+		<< ", max " << 1000.0f * percentile(stats.latencies, 1.0f) << " (" << stats.latencies.size() << " samples, "
+		<< stats.unmatched << " unmatched)\n"
+		<< "  tick interval (ms): mean " << 1000.0 * mean << ", jitter (stddev) " << 1000.0 * std::sqrt(variance)
+		<< ", p99 " << 1000.0f * percentile(stats.intervals, 0.99f) << std::endl;
+}
+
+static void report_spectators(Stats &stats, float seconds, uint32_t spectators) {
+	std::sort(stats.intervals.begin(), stats.intervals.end());
+	float per = 1.0f / std::max(seconds, 1e-3f);
+	std::cout << "  spectators: " << spectators << ", " << (stats.bytes_received * per / 1024.0f) << " KiB/s down"
+		<< " (per spectator: " << (stats.bytes_received * per / 1024.0f / float(std::max(spectators, 1U))) << "), "
+		<< (stats.states * per) << " snapshots/s, interval p50 " << 1000.0f * percentile(stats.intervals, 0.5f)
+		<< " ms, p99 " << 1000.0f * percentile(stats.intervals, 0.99f) << " ms" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	std::vector< std::string > args;
+	uint32_t bot_count = 16;
+	std::string behavior_name = "mix";
+	float rate = 60.0f;
+	uint32_t wait_players = 0;
+	uint32_t spectator_count = 0;
+	float seconds = 0.0f;
+	float report_seconds = 5.0f;
+	uint32_t seed = 0;
+	bool usage = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--bots" && i + 1 < argc) bot_count = uint32_t(std::stoul(argv[++i]));
+		else if (arg == "--behavior" && i + 1 < argc) behavior_name = argv[++i];
+		else if (arg == "--rate" && i + 1 < argc) rate = std::stof(argv[++i]);
+		else if (arg == "--players" && i + 1 < argc) wait_players = uint32_t(std::stoul(argv[++i]));
+		else if (arg == "--spectators" && i + 1 < argc) spectator_count = uint32_t(std::stoul(argv[++i]));
+		else if (arg == "--seconds" && i + 1 < argc) seconds = std::stof(argv[++i]);
+		else if (arg == "--report" && i + 1 < argc) report_seconds = std::stof(argv[++i]);
+		else if (arg == "--seed" && i + 1 < argc) seed = uint32_t(std::stoul(argv[++i]));
+		else if (arg.size() > 0 && arg[0] != '-') args.emplace_back(arg);
+		else usage = true;
+	}
+	if (behavior_name != "wander" && behavior_name != "chase" && behavior_name != "shoot" && behavior_name != "mix") usage = true;
+	if (usage || args.size() != 2 || bot_count + spectator_count == 0 || !(rate > 0.0f) || !(report_seconds > 0.0f)) {
+		std::cerr << "Usage:\n\t./bot_client <host> <port> [--bots N] [--behavior wander|chase|shoot|mix] [--rate HZ] [--players N] [--spectators N] [--seconds S] [--report S] [--seed N]" << std::endl;
+		return 1;
+	}
+	if (wait_players == 0) wait_players = bot_count;
+
+	try {
+		std::vector< std::unique_ptr< Bot > > bots;
+		bots.reserve(bot_count);
+		for (uint32_t i = 0; i < bot_count; ++i) {
+			Behavior behavior = Wander;
+			if (behavior_name == "chase") behavior = Chase;
+			else if (behavior_name == "shoot") behavior = Shoot;
+			else if (behavior_name == "mix") behavior = Behavior(i % 3);
+			bots.emplace_back(new Bot(args[0], args[1], i, behavior, seed));
+			bots.back()->poll(); //(so the server's lobby updates don't pile up while connecting)
+		}
+		std::cout << "Connected " << bots.size() << " bots; waiting for " << wait_players << " players to ready up." << std::endl;
+
+		std::vector< std::unique_ptr< Watcher > > watchers;
+		watchers.reserve(spectator_count);
+		for (uint32_t i = 0; i < spectator_count; ++i) {
+			watchers.emplace_back(new Watcher(args[0], args[1]));
+		}
+
+		Clock::time_point start = Clock::now();
+		Clock::time_point report_start = start;
+		Clock::time_point next_action = start;
+		Clock::time_point last_action = start;
+		std::chrono::duration< float > action_period(1.0f / rate);
+		Stats total;
+		Stats total_spectators;
+
+		while (true) {
+			for (auto &bot : bots) {
+				bot->poll();
+			}
+			for (auto &watcher : watchers) {
+				watcher->poll();
+			}
+
+			//ready up once everyone has joined (so the game doesn't start early):
+			for (auto &bot : bots) {
+				if (!bot->sent_ready && bot->player_count >= int(wait_players)) bot->send_ready();
+			}
+
+			Clock::time_point now = Clock::now();
+			if (now >= next_action) {
+				float elapsed = std::chrono::duration< float >(now - last_action).count();
+				last_action = now;
+				next_action += std::chrono::duration_cast< Clock::duration >(action_period);
+				if (next_action < now) next_action = now; //(don't try to catch up after a stall)
+				for (auto &bot : bots) {
+					if (bot->playing && bot->first_msg_received) bot->act(elapsed);
+				}
+			}
+
+			float report_elapsed = std::chrono::duration< float >(now - report_start).count();
+			float total_elapsed = std::chrono::duration< float >(now - start).count();
+			bool done = (seconds > 0.0f && total_elapsed >= seconds);
+			if (report_elapsed >= report_seconds || done) {
+				Stats window;
+				uint32_t playing = 0;
+				for (auto &bot : bots) {
+					window.add(bot->stats);
+					bot->stats = Stats();
+					if (bot->first_msg_received) playing += 1;
+				}
+				total.add(window);
+				report("[" + std::to_string(int(total_elapsed)) + "s]", window, report_elapsed, bot_count, playing);
+				if (!watchers.empty()) {
+					Stats spectator_window;
+					for (auto &watcher : watchers) {
+						spectator_window.add(watcher->stats);
+						watcher->stats = Stats();
+					}
+					total_spectators.add(spectator_window);
+					report_spectators(spectator_window, report_elapsed, spectator_count);
+				}
+				report_start = now;
+				if (done) {
+					report("total", total, total_elapsed, bot_count, playing);
+					if (!watchers.empty()) report_spectators(total_spectators, total_elapsed, spectator_count);
+					break;
+				}
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,122 @@
+//compress_banim rewrites a .banim file with its animation frames stored compressed (see BoneTracks.hpp):
+//  ./compress_banim [--position P] [--rotation R] [--scale S] <in.banim> <out.banim>
+// P, R, and S are how far compressed poses may stray from the originals (object units, radians, and
+// scale factor; default 0.0005 each). All other chunks are copied unchanged.
+// (BoneAnimation also compresses uncompressed files as it loads them; running this ahead of time
+//  skips that work and makes the files on disk smaller.)
+
+#include "BoneTracks.hpp"
+#include "ChunkFile.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstring>
+
+int main(int argc, char **argv) {
+	BoneTracks::Tolerance tolerance;
+	std::vector< std::string > files;
+	bool usage = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--position" && i + 1 < argc) tolerance.position = std::stof(argv[++i]);
+		else if (arg == "--rotation" && i + 1 < argc) tolerance.rotation = std::stof(argv[++i]);
+		else if (arg == "--scale" && i + 1 < argc) tolerance.scale = std::stof(argv[++i]);
+		else if (arg.size() > 0 && arg[0] != '-') files.emplace_back(arg);
+		else usage = true;
+	}
+	if (usage || files.size() != 2) {
+		std::cerr << "Usage:\n\t./compress_banim [--position P] [--rotation R] [--scale S] <in.banim> <out.banim>" << std::endl;
+		return 1;
+	}
+
+	try {
+		//read every chunk (animations come after the frames, but are needed to compress them):
+		struct Chunk {
+			std::string magic;
+			std::vector< char > data;
+		};
+		std::vector< Chunk > chunks;
+		{
+			ChunkFile file(files[0]);
+			while (!file.at_end()) {
+				std::string magic = file.next_magic();
+				ChunkFile::Span< char > data = file.read< char >(magic);
+				chunks.emplace_back(Chunk{magic, std::vector< char >(data.begin(), data.end())});
+			}
+		}
+		auto find = [&chunks](std::string const &magic) -> Chunk const * {
+			for (auto const &chunk : chunks) {
+				if (chunk.magic == magic) return &chunk;
+			}
+			return nullptr;
+		};
+
+		Chunk const *bon0 = find("bon0");
+		Chunk const *frm0 = find("frm0");
+		Chunk const *act0 = find("act0");
+		if (!bon0 || !act0) throw std::runtime_error("'" + files[0] + "' doesn't look like a .banim file.");
+		if (!frm0) throw std::runtime_error("'" + files[0] + "' has no uncompressed frames (is it already compressed?).");
+
+		constexpr size_t BoneInfoSize = 4*2 + 4 + 4*12; //(as in BoneAnimation.cpp)
+		uint32_t bone_count = uint32_t(bon0->data.size() / BoneInfoSize);
+		std::vector< BoneTracks::PoseBone > frames(frm0->data.size() / sizeof(BoneTracks::PoseBone));
+		if (bone_count == 0 || frames.size() * sizeof(BoneTracks::PoseBone) != frm0->data.size() || frames.size() % bone_count != 0) {
+			throw std::runtime_error("frame bones is not divisible by bones");
+		}
+		std::memcpy(frames.data(), frm0->data.data(), frm0->data.size());
+		uint32_t frame_count = uint32_t(frames.size() / bone_count);
+
+		//keep the ends of each animation, so they don't blend together:
+		std::vector< uint32_t > keep;
+		struct AnimationInfo {
+			uint32_t name_begin, name_end;
+			uint32_t begin, end;
+		};
+		for (size_t at = 0; at + sizeof(AnimationInfo) <= act0->data.size(); at += sizeof(AnimationInfo)) {
+			AnimationInfo info;
+			std::memcpy(&info, act0->data.data() + at, sizeof(info));
+			if (info.begin < info.end) {
+				keep.emplace_back(info.begin);
+				keep.emplace_back(info.end - 1);
+			}
+		}
+
+		BoneTracks tracks(frames.data(), bone_count, frame_count, keep, tolerance);
+
+		//measure how far the compressed poses are from the originals:
+		glm::vec3 max_error = glm::vec3(0.0f);
+		std::vector< BoneTracks::PoseBone > decoded(bone_count);
+		for (uint32_t f = 0; f < frame_count; ++f) {
+			tracks.sample(float(f), decoded.data());
+			for (uint32_t b = 0; b < bone_count; ++b) {
+				BoneTracks::PoseBone const &a = frames[f * bone_count + b];
+				BoneTracks::PoseBone const &d = decoded[b];
+				glm::vec3 dp = glm::abs(a.position - d.position);
+				glm::vec3 ds = glm::abs(a.scale - d.scale);
+				max_error.x = std::max(max_error.x, std::max(dp.x, std::max(dp.y, dp.z)));
+				max_error.y = std::max(max_error.y, rotation_error(a.rotation, d.rotation));
+				max_error.z = std::max(max_error.z, std::max(ds.x, std::max(ds.y, ds.z)));
+			}
+		}
+
+		std::ofstream out(files[1], std::ios::binary);
+		if (!out) throw std::runtime_error("Failed to open '" + files[1] + "' for writing.");
+		for (auto const &chunk : chunks) {
+			if (&chunk == frm0) tracks.write(out);
+			else write_chunk(out, chunk.magic, chunk.data);
+		}
+
+		std::cout << "Wrote '" << files[1] << "': " << bone_count << " bones x " << frame_count << " frames, "
+			<< tracks.key_frames.size() << " keys in " << tracks.tracks.size() << " tracks; "
+			<< frm0->data.size() << " -> " << tracks.bytes() << " bytes of animation.\n"
+			<< "  largest error: " << max_error.x << " position, " << max_error.y << " rotation (radians), " << max_error.z << " scale." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -5,6 +5,7 @@
 #include "MeshBuffer.hpp"
 #include "data_path.hpp"
 #include "compile_program.hpp"
+#include "Profiler.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
@@ -77,6 +78,7 @@ void draw_text(std::string const &text, glm::vec2 const &anchor, float height, g
 }
 
 void draw_text(std::string const &text, glm::mat4 const &transform, glm::vec4 color) {
+	PROFILE_SCOPE("text");
 	glUseProgram(*text_program);
 	glBindVertexArray(*text_meshes_for_text_program);
 
@@ -4,6 +4,6 @@ LEVEL=$1
 
 blender="/Applications/Blender/blender.app/Contents/MacOS/blender"
 
-$blender --background --python meshes/export-meshes.py -- meshes/$LEVEL.blend:1 dist/$LEVEL.pnc
+$blender --background --python meshes/export-meshes.py -- meshes/$LEVEL.blend:1 dist/$LEVEL.pnc 0.5:0.2 0.2:0.08
 $blender --background --python meshes/export-scene.py -- meshes/$LEVEL.blend:1 dist/$LEVEL.scene
 $blender --background --python meshes/export-walkmeshes.py -- meshes/$LEVEL.blend:1 dist/$LEVEL.collision
@@ -1,4 +1,5 @@
 #include "load_save_png.hpp"
+#include "AssetArchive.hpp"
 
 #include <png.h>
 
@@ -21,6 +22,13 @@ void save_png(std::string filename, unsigned int width, unsigned int height, uin
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin) {
 	assert(size);
 
+	//read from the data archive, if the file is there:
+	AssetArchive::Contents archived;
+	if (find_data_file(filename, &archived)) {
+		load_png(archived.data, archived.size, filename, size, data, origin);
+		return;
+	}
+
 	std::ifstream file(filename.c_str(), std::ios::binary);
 	if (!file) {
 		throw std::runtime_error("Failed to open PNG image file '" + filename + "'.");
@@ -30,6 +38,18 @@ void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 >
 	}
 }
 
+void load_png(uint8_t const *bytes, size_t length, std::string const &name, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin) {
+	assert(size);
+
+	struct MemoryBuf : std::streambuf {
+		MemoryBuf(char *begin, char *end) { setg(begin, begin, end); }
+	} buf(reinterpret_cast< char * >(const_cast< uint8_t * >(bytes)), reinterpret_cast< char * >(const_cast< uint8_t * >(bytes + length)));
+	std::istream from(&buf);
+	if (!load_png(from, &size->x, &size->y, data, origin)) {
+		throw std::runtime_error("Failed to read PNG image from '" + name + "'.");
+	}
+}
+
 void save_png(std::string filename, unsigned int width, unsigned int height, glm::u8vec4 const *data, OriginLocation origin) {
 	std::ofstream file(filename.c_str(), std::ios::binary);
 	save_png(file, width, height, data, origin);
@@ -0,0 +1,131 @@
+#include "lz4_block.hpp"
+
+#include <stdexcept>
+#include <cstring>
+
+//see https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+// each sequence is: token (literal length : 4 | match length - 4 : 4), [more literal length], literals,
+//  16-bit little-endian match offset, [more match length]; the final sequence is literals only.
+
+namespace {
+	const size_t MinMatch = 4;
+	const size_t LastLiterals = 5; //last five bytes are always literals
+	const size_t MatchSearchLimit = 12; //last match must start at least this far from the end
+	const size_t MaxOffset = 65535;
+	const uint32_t HashBits = 16;
+
+	uint32_t read32(uint8_t const *at) {
+		uint32_t ret;
+		std::memcpy(&ret, at, 4);
+		return ret;
+	}
+
+	uint32_t hash(uint32_t sequence) {
+		return (sequence * 2654435761U) >> (32 - HashBits);
+	}
+
+	//lengths >= 15 continue in extra bytes of 255s:
+	void write_length(std::vector< uint8_t > &out, size_t length) {
+		while (length >= 255) {
+			out.emplace_back(uint8_t(255));
+			length -= 255;
+		}
+		out.emplace_back(uint8_t(length));
+	}
+
+	void write_sequence(std::vector< uint8_t > &out, uint8_t const *literals, size_t literal_length, size_t offset, size_t match_length) {
+		size_t match_code = (match_length ? match_length - MinMatch : 0);
+		out.emplace_back(uint8_t(((literal_length < 15 ? literal_length : 15) << 4) | (match_code < 15 ? match_code : 15)));
+		if (literal_length >= 15) write_length(out, literal_length - 15);
+		out.insert(out.end(), literals, literals + literal_length);
+		if (match_length == 0) return; //(final sequence)
+		out.emplace_back(uint8_t(offset & 0xff));
+		out.emplace_back(uint8_t(offset >> 8));
+		if (match_code >= 15) write_length(out, match_code - 15);
+	}
+}
+
+std::vector< uint8_t > lz4_compress(uint8_t const *data, size_t size) {
+	std::vector< uint8_t > out;
+	out.reserve(size + size / 255 + 16);
+
+	size_t anchor = 0; //start of pending literals
+	if (size > MatchSearchLimit) {
+		//position + 1 of the last place each hashed 4-byte sequence was seen (0 means never):
+		std::vector< uint32_t > table(size_t(1) << HashBits, 0);
+		size_t at = 0;
+		while (at + MatchSearchLimit <= size) {
+			uint32_t sequence = read32(data + at);
+			uint32_t h = hash(sequence);
+			size_t candidate = table[h];
+			table[h] = uint32_t(at + 1);
+			if (candidate == 0 || at - (candidate - 1) > MaxOffset || read32(data + candidate - 1) != sequence) {
+				at += 1;
+				continue;
+			}
+			size_t match = candidate - 1;
+			size_t length = MinMatch;
+			while (at + length < size - LastLiterals && data[match + length] == data[at + length]) {
+				length += 1;
+			}
+			write_sequence(out, data + anchor, at - anchor, at - match, length);
+			at += length;
+			anchor = at;
+		}
+	}
+	write_sequence(out, data + anchor, size - anchor, 0, 0);
+
+	return out;
+}
+
+void lz4_decompress(uint8_t const *src, size_t src_size, uint8_t *dst, size_t dst_size) {
+	size_t in = 0;
+	size_t out = 0;
+
+	auto read_length = [&](size_t length) -> size_t {
+		if (length != 15) return length;
+		uint8_t b;
+		do {
+			if (in >= src_size) throw std::runtime_error("LZ4 block truncated in length.");
+			b = src[in++];
+			length += b;
+		} while (b == 255);
+		return length;
+	};
+
+	while (true) {
+		if (in >= src_size) throw std::runtime_error("LZ4 block truncated before token.");
+		uint8_t token = src[in++];
+
+		size_t literal_length = read_length(token >> 4);
+		if (literal_length > src_size - in || literal_length > dst_size - out) {
+			throw std::runtime_error("LZ4 block literals overrun.");
+		}
+		std::memcpy(dst + out, src + in, literal_length);
+		in += literal_length;
+		out += literal_length;
+
+		if (in == src_size) break; //final sequence has no match
+
+		if (src_size - in < 2) throw std::runtime_error("LZ4 block truncated in offset.");
+		size_t offset = size_t(src[in]) | (size_t(src[in + 1]) << 8);
+		in += 2;
+		if (offset == 0 || offset > out) throw std::runtime_error("LZ4 block has bad match offset.");
+
+		size_t match_length = read_length(token & 0xf) + MinMatch;
+		if (match_length > dst_size - out) throw std::runtime_error("LZ4 block match overrun.");
+
+		uint8_t const *from = dst + out - offset;
+		if (offset >= match_length) {
+			std::memcpy(dst + out, from, match_length);
+		} else {
+			//overlapping match repeats the last 'offset' bytes:
+			for (size_t i = 0; i < match_length; ++i) {
+				dst[out + i] = from[i];
+			}
+		}
+		out += match_length;
+	}
+
+	if (out != dst_size) throw std::runtime_error("LZ4 block decompressed to the wrong size.");
+}
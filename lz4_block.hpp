@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Minimal LZ4 *block* format compressor/decompressor (no frame format, no dictionaries).
+ * Output is compatible with LZ4_decompress_safe() from the reference library.
+ */
+
+//compress 'size' bytes (a simple greedy matcher; fast, not the best ratio):
+std::vector< uint8_t > lz4_compress(uint8_t const *data, size_t size);
+
+//decompress a block into exactly 'dst_size' bytes:
+// note: will throw if the block is malformed or doesn't decompress to exactly 'dst_size' bytes
+void lz4_decompress(uint8_t const *src, size_t src_size, uint8_t *dst, size_t dst_size);
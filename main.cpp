@@ -4,6 +4,12 @@
 //Load.hpp is included because of the call_load_functions() call:
 #include "Load.hpp"
 
+//AssetArchive.hpp is included because of the data_archive() call:
+#include "AssetArchive.hpp"
+
+//TextureCache.hpp is included because of the init_texture_cache() call:
+#include "TextureCache.hpp"
+
 //The 'GameMode' mode plays the game:
 //#include "GameMode.hpp"
 #include "LobbyMode.hpp"
@@ -15,6 +21,9 @@
 //The 'Sound' header has functions for managing sound:
 #include "Sound.hpp"
 
+//The 'Profiler' header has per-frame CPU/GPU section timers:
+#include "Profiler.hpp"
+
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
@@ -117,6 +126,12 @@ int main(int argc, char **argv) {
 
 	//------------ load assets --------------
 
+	//map the packed data archive (if there is one) up front, rather than when the first loader asks for it:
+	data_archive();
+
+	//check which compressed texture formats the texture cache can use:
+	init_texture_cache();
+
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
@@ -188,7 +203,9 @@ int main(int argc, char **argv) {
 			glEnable(GL_BLEND);
 			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+			Profiler::begin_frame();
 			Mode::current->draw(drawable_size);
+			Profiler::end_frame();
 		}
 
 		//Finally, wait until the recently-drawn frame is shown before doing it all again:
@@ -12,8 +12,8 @@ for i in range(0,len(sys.argv)):
 	if sys.argv[i] == '--':
 		args = sys.argv[i+1:]
 
-if len(args) != 2:
-	print("\n\nUsage:\nblender --background --python export-meshes.py -- <infile.blend>[:layer] <outfile.p[n][c][t][l]>\nExports the meshes referenced by all objects in layer (default 1) to a binary blob, indexed by the names of the objects that reference them. If 'l' is specified in the file extension, only mesh edges will be exported.\n")
+if len(args) < 2:
+	print("\n\nUsage:\nblender --background --python export-meshes.py -- <infile.blend>[:layer] <outfile.p[n][c][t][l]> [ratio:screen_size ...]\nExports the meshes referenced by all objects in layer (default 1) to a binary blob, indexed by the names of the objects that reference them. If 'l' is specified in the file extension, only mesh edges will be exported.\nEach 'ratio:screen_size' adds a level of detail decimated to 'ratio' of the original triangles, to be used once the mesh covers less than 'screen_size' of the screen height (e.g. '0.5:0.2 0.2:0.08').\n")
 	exit(1)
 
 infile = args[0]
@@ -24,6 +24,17 @@ if m:
 	layer = int(m.group(2))
 outfile = args[1]
 
+#levels of detail, coarsest last:
+lod_levels = []
+for arg in args[2:]:
+	m = re.match(r'^([0-9.]+):([0-9.]+)$', arg)
+	if not m:
+		print("ERROR: expecting level of detail as 'ratio:screen_size', got '" + arg + "'")
+		exit(1)
+	lod_levels.append((float(m.group(1)), float(m.group(2))))
+for i in range(1, len(lod_levels)):
+	assert lod_levels[i][0] < lod_levels[i-1][0] and lod_levels[i][1] < lod_levels[i-1][1], "levels of detail should get coarser"
+
 assert layer >= 1 and layer <= 20
 
 print("Will export meshes referenced from layer " + str(layer) + " of '" + infile + "' to '" + outfile + "'.")
@@ -89,17 +100,15 @@ strings = b''
 #index gives offsets into the data (and names) for each mesh:
 index = b''
 
+#lods gives offsets into the data (and names) for reduced-detail versions of meshes:
+lods = b''
+
 vertex_count = 0
-for obj in bpy.data.objects:
-	if obj.data in to_write:
-		to_write.remove(obj.data)
-	else:
-		continue
 
-	mesh = obj.data
-	name = mesh.name
+#convert object to triangles (or edges) and append its vertices to data; returns number of primitives written:
+def write_object(obj, name):
+	global data, vertex_count
 
-	print("Writing '" + name + "'...")
 	if bpy.context.mode == 'EDIT':
 		bpy.ops.object.mode_set(mode='OBJECT') #get out of edit mode (just in case)
 
@@ -112,6 +121,7 @@ for obj in bpy.data.objects:
 
 	#apply all modifiers (?):
 	bpy.ops.object.convert(target='MESH')
+	mesh = obj.data
 
 	if not filetype.as_lines:
 		#subdivide object's mesh into triangles:
@@ -123,29 +133,19 @@ for obj in bpy.data.objects:
 		#compute normals (respecting face smoothing):
 		mesh.calc_normals_split()
 
-	#record mesh name, start position and vertex count in the index:
-	name_begin = len(strings)
-	strings += bytes(name, "utf8")
-	name_end = len(strings)
-	index += struct.pack('I', name_begin)
-	index += struct.pack('I', name_end)
-
-	index += struct.pack('I', vertex_count) #vertex_begin
-	#...count will be written below
-
 	colors = None
 	if filetype.color:
-		if len(obj.data.vertex_colors) == 0:
+		if len(mesh.vertex_colors) == 0:
 			print("WARNING: trying to export color data, but object '" + name + "' does not have color data; will output 0xffffffff")
 		else:
-			colors = obj.data.vertex_colors.active.data
+			colors = mesh.vertex_colors.active.data
 
 	uvs = None
 	if filetype.texcoord:
-		if len(obj.data.uv_layers) == 0:
+		if len(mesh.uv_layers) == 0:
 			print("WARNING: trying to export texcoord data, but object '" + name + "' does not uv data; will output (0.0, 0.0)")
 		else:
-			uvs = obj.data.uv_layers.active.data
+			uvs = mesh.uv_layers.active.data
 
 	if not filetype.as_lines:
 		#write the mesh triangles:
@@ -173,6 +173,7 @@ for obj in bpy.data.objects:
 					else:
 						data += struct.pack('ff', 0, 0)
 		vertex_count += len(mesh.polygons) * 3
+		return len(mesh.polygons)
 	else:
 		#write the mesh edges:
 		for edge in mesh.edges:
@@ -186,9 +187,58 @@ for obj in bpy.data.objects:
 				assert(not filetype.color)
 				assert(not filetype.texcoord)
 		vertex_count += len(mesh.edges) * 2
+		return len(mesh.edges)
+
+for obj in bpy.data.objects:
+	if obj.data in to_write:
+		to_write.remove(obj.data)
+	else:
+		continue
+
+	name = obj.data.name
+
+	print("Writing '" + name + "'...")
+
+	#make decimated copies up front (before the original's modifiers are applied):
+	lod_objs = []
+	if not filetype.as_lines:
+		for (ratio, screen_size) in lod_levels:
+			lod_obj = obj.copy()
+			lod_obj.data = obj.data.copy()
+			bpy.context.scene.objects.link(lod_obj)
+			decimate = lod_obj.modifiers.new(name='LOD', type='DECIMATE')
+			decimate.ratio = ratio
+			lod_objs.append((lod_obj, screen_size))
 
+	#record mesh name, start position and vertex count in the index:
+	name_begin = len(strings)
+	strings += bytes(name, "utf8")
+	name_end = len(strings)
+	index += struct.pack('I', name_begin)
+	index += struct.pack('I', name_end)
+
+	index += struct.pack('I', vertex_count) #vertex_begin
+	prims = write_object(obj, name)
 	index += struct.pack('I', vertex_count) #vertex_end
 
+	#record levels of detail (skipping any that didn't meaningfully reduce the mesh):
+	for (lod_obj, screen_size) in lod_objs:
+		vertex_begin = vertex_count
+		lod_prims = write_object(lod_obj, name)
+		if lod_prims > 0.9 * prims:
+			print("  (skipping level of detail for screen size " + str(screen_size) + ": only reduced " + str(prims) + " to " + str(lod_prims) + " triangles)")
+			data = data[0:vertex_begin * filetype.vertex_bytes]
+			vertex_count = vertex_begin
+			continue
+		print("  level of detail for screen size " + str(screen_size) + ": " + str(lod_prims) + " triangles")
+		lods += struct.pack('I', name_begin)
+		lods += struct.pack('I', name_end)
+		lods += struct.pack('I', vertex_begin)
+		lods += struct.pack('I', vertex_count)
+		lods += struct.pack('f', screen_size)
+		prims = lod_prims
+
+
 
 #check that we wrote as much data as anticipated:
 assert(vertex_count * filetype.vertex_bytes == len(data))
@@ -207,7 +257,12 @@ blob.write(strings)
 blob.write(struct.pack('4s',b'idx0')) #type
 blob.write(struct.pack('I', len(index))) #length
 blob.write(index)
+#(optional) fourth chunk: the levels of detail
+if len(lods) > 0:
+	blob.write(struct.pack('4s',b'lod0')) #type
+	blob.write(struct.pack('I', len(lods))) #length
+	blob.write(lods)
 wrote = blob.tell()
 blob.close()
 
-print("Wrote " + str(wrote) + " bytes [== " + str(len(data)+8) + " bytes of data + " + str(len(strings)+8) + " bytes of strings + " + str(len(index)+8) + " bytes of index] to '" + outfile + "'")
+print("Wrote " + str(wrote) + " bytes [== " + str(len(data)+8) + " bytes of data + " + str(len(strings)+8) + " bytes of strings + " + str(len(index)+8) + " bytes of index + " + str(len(lods)+8 if len(lods) > 0 else 0) + " bytes of lods] to '" + outfile + "'")
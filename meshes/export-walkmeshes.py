@@ -53,6 +53,9 @@ strings = b''
 #index gives offsets into the data (and names) for each mesh:
 index = b''
 
+#adjacency gives, for each triangle edge, 3*(triangle across it)+(its matching edge), relative to the mesh's first triangle, or 0xffffffff for solid edges:
+adjacency = b''
+
 position_count = 0
 normal_count = 0
 triangle_count = 0
@@ -108,6 +111,7 @@ for obj in bpy.data.objects:
 		return struct.pack('I', vertex_begin + vertex_inds[index])
 
 	#write the mesh triangles:
+	mesh_triangles = [] #(vertex indices, for adjacency)
 	for poly in mesh.polygons:
 		assert(len(poly.loop_indices) == 3)
 
@@ -122,6 +126,20 @@ for obj in bpy.data.objects:
 			assert(mesh.loops[poly.loop_indices[i]].vertex_index == poly.vertices[i])
 			triangles += write_vertex(poly.vertices[i], mesh.loops[poly.loop_indices[i]].normal)
 		triangle_count += 1
+		mesh_triangles.append(tuple(vertex_inds[v] for v in poly.vertices))
+
+	#match each (directed) edge with its reverse:
+	# (in case of inconsistently-oriented faces, a repeated edge is only matched to its first triangle)
+	edge_at = dict()
+	for t in range(0,len(mesh_triangles)):
+		for i in range(0,3):
+			edge = (mesh_triangles[t][i], mesh_triangles[t][(i+1)%3])
+			if edge not in edge_at:
+				edge_at[edge] = 3*t+i
+	for t in range(0,len(mesh_triangles)):
+		for i in range(0,3):
+			reverse = (mesh_triangles[t][(i+1)%3], mesh_triangles[t][i])
+			adjacency += struct.pack('I', edge_at.get(reverse, 0xffffffff))
 	
 	#write (and possibly average) the normals:
 	for ns in vertex_normals:
@@ -171,6 +189,7 @@ write_chunk(b'n...', normals)
 write_chunk(b'tri0', triangles)
 write_chunk(b'str0', strings)
 write_chunk(b'idxA', index)
+write_chunk(b'adj0', adjacency)
 wrote = blob.tell()
 blob.close()
 
@@ -179,4 +198,5 @@ print("Wrote " + str(wrote) + " bytes [== " +
 	str(len(normals)+8) + " bytes of normals + " +
 	str(len(triangles)+8) + " bytes of triangles + " +
 	str(len(strings)+8) + " bytes of strings + " +
-	str(len(index)+8) + " bytes of index] to '" + outfile + "'")
+	str(len(index)+8) + " bytes of index + " +
+	str(len(adjacency)+8) + " bytes of adjacency] to '" + outfile + "'")
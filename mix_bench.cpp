@@ -0,0 +1,197 @@
+//mix_bench times the Sound mixer on synthetic scenes, without an audio device:
+//  ./mix_bench [--voices N] [--seconds S] [--scene static|moving|shots] [--wav prefix]
+// for each scene it prints the time spent per MixSamples block, and the headroom (how many times
+// faster than real time the mixer runs); with --wav, each scene's output is also written to
+// <prefix><scene>.wav, along with a hash of the output, so mixer changes can be checked for bit-exactness.
+
+#include "Sound.hpp"
+#include "AssetArchive.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cmath>
+
+static constexpr float Pi = 3.14159265f;
+
+//synthetic samples (deterministic, so runs can be compared):
+static std::vector< float > make_tone(float seconds, float hz) {
+	std::vector< float > data(size_t(seconds * Sound::AudioRate));
+	for (size_t i = 0; i < data.size(); ++i) {
+		float t = float(i) / float(Sound::AudioRate);
+		data[i] = 0.5f * std::sin(2.0f * Pi * hz * t) + 0.25f * std::sin(2.0f * Pi * 3.0f * hz * t);
+	}
+	return data;
+}
+
+static std::vector< float > make_burst(float seconds) {
+	std::vector< float > data(size_t(seconds * Sound::AudioRate));
+	uint32_t state = 0x12345678;
+	for (size_t i = 0; i < data.size(); ++i) {
+		state = state * 1664525 + 1013904223; //(LCG noise)
+		float noise = float(int32_t(state)) / 2147483648.0f;
+		float envelope = 1.0f - float(i) / float(data.size());
+		data[i] = noise * envelope * envelope;
+	}
+	return data;
+}
+
+//write float32 stereo wav:
+static void write_wav(std::string const &filename, std::vector< float > const &lr) {
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+	auto u16 = [&out](uint16_t v) { out.write(reinterpret_cast< char const * >(&v), 2); };
+	auto u32 = [&out](uint32_t v) { out.write(reinterpret_cast< char const * >(&v), 4); };
+	uint32_t data_size = uint32_t(lr.size() * sizeof(float));
+	out.write("RIFF", 4); u32(36 + data_size); out.write("WAVE", 4);
+	out.write("fmt ", 4); u32(16);
+	u16(3); //IEEE float
+	u16(2); //channels
+	u32(Sound::AudioRate);
+	u32(Sound::AudioRate * 2 * sizeof(float));
+	u16(2 * sizeof(float));
+	u16(32);
+	out.write("data", 4); u32(data_size);
+	out.write(reinterpret_cast< char const * >(lr.data()), data_size);
+	if (!out) throw std::runtime_error("Failed to write '" + filename + "'.");
+}
+
+int main(int argc, char **argv) {
+	uint32_t voices = 64;
+	float seconds = 10.0f;
+	std::string only_scene;
+	std::string wav_prefix;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--voices" && i + 1 < argc) voices = uint32_t(std::stoul(argv[++i]));
+		else if (arg == "--seconds" && i + 1 < argc) seconds = std::stof(argv[++i]);
+		else if (arg == "--scene" && i + 1 < argc) only_scene = argv[++i];
+		else if (arg == "--wav" && i + 1 < argc) wav_prefix = argv[++i];
+		else {
+			std::cerr << "Usage:\n\t./mix_bench [--voices N] [--seconds S] [--scene static|moving|shots] [--wav prefix]" << std::endl;
+			return 1;
+		}
+	}
+
+	Sound::init_offline();
+
+	Sound::Sample tone_low(make_tone(1.5f, 110.0f));
+	Sound::Sample tone_high(make_tone(0.75f, 440.0f));
+	Sound::Sample burst(make_burst(0.3f));
+	burst.max_voices = std::max(1U, voices / 2);
+
+	constexpr float BlockSeconds = float(Sound::MixSamples) / float(Sound::AudioRate);
+	uint32_t blocks = std::max(1U, uint32_t(seconds / BlockSeconds));
+
+	//each scene starts some voices and then changes them before each block:
+	struct Scene {
+		std::string name;
+		std::function< void(uint32_t block, std::vector< std::shared_ptr< Sound::PlayingSample > > &playing) > update;
+	};
+	std::vector< Scene > scenes;
+
+	//looping voices spread around a ring, nothing moves:
+	scenes.emplace_back(Scene{"static", [&](uint32_t block, std::vector< std::shared_ptr< Sound::PlayingSample > > &playing) {
+		if (block != 0) return;
+		for (uint32_t v = 0; v < voices; ++v) {
+			float ang = 2.0f * Pi * v / float(voices);
+			glm::vec3 at = (2.0f + 0.1f * v) * glm::vec3(std::cos(ang), std::sin(ang), 0.0f);
+			playing.emplace_back((v % 2 ? tone_high : tone_low).play(at, 0.5f, Sound::Loop));
+		}
+	}});
+
+	//looping voices orbiting the listener with ramped positions and volumes, while the listener turns:
+	scenes.emplace_back(Scene{"moving", [&](uint32_t block, std::vector< std::shared_ptr< Sound::PlayingSample > > &playing) {
+		if (block == 0) {
+			for (uint32_t v = 0; v < voices; ++v) {
+				playing.emplace_back((v % 2 ? tone_high : tone_low).play(glm::vec3(1.0f, 0.0f, 0.0f), 0.5f, Sound::Loop));
+			}
+		}
+		float t = block * BlockSeconds;
+		for (uint32_t v = 0; v < playing.size(); ++v) {
+			float ang = 0.5f * t * (1.0f + 0.05f * v) + v;
+			float radius = 1.0f + 20.0f * (0.5f + 0.5f * std::sin(0.3f * t + v));
+			playing[v]->set_position(radius * glm::vec3(std::cos(ang), std::sin(ang), 0.0f), BlockSeconds);
+			playing[v]->set_volume(0.5f + 0.5f * std::sin(t + 0.7f * v), 2.0f * BlockSeconds);
+		}
+		Sound::listener.set_right(glm::vec3(std::cos(0.2f * t), std::sin(0.2f * t), 0.0f), BlockSeconds);
+	}});
+
+	//short one-shots, retriggered in waves (exercises starting, finishing, and per-sample limits):
+	scenes.emplace_back(Scene{"shots", [&](uint32_t block, std::vector< std::shared_ptr< Sound::PlayingSample > > &playing) {
+		uint32_t per_block = std::max(1U, voices / 8);
+		for (uint32_t s = 0; s < per_block; ++s) {
+			uint32_t n = block * per_block + s;
+			float ang = 2.399963f * n; //(golden angle, so shots spread out)
+			glm::vec3 at = (1.0f + float(n % 13)) * glm::vec3(std::cos(ang), std::sin(ang), 0.0f);
+			playing.emplace_back((n % 3 ? burst : tone_high).play(at, 0.3f, Sound::Once));
+		}
+		if (playing.size() > 4 * voices) playing.erase(playing.begin(), playing.begin() + per_block);
+	}});
+
+	bool ran = false;
+	for (auto &scene : scenes) {
+		if (!only_scene.empty() && scene.name != only_scene) continue;
+		ran = true;
+
+		//start from the same mixer state every time:
+		Sound::listener.set_position(glm::vec3(0.0f), 0.0f);
+		Sound::listener.set_right(glm::vec3(1.0f, 0.0f, 0.0f), 0.0f);
+		Sound::set_volume(1.0f, 0.0f);
+
+		std::vector< std::shared_ptr< Sound::PlayingSample > > playing;
+		std::vector< float > output(size_t(blocks) * Sound::MixSamples * 2);
+		std::vector< double > times(blocks);
+		for (uint32_t b = 0; b < blocks; ++b) {
+			scene.update(b, playing);
+			auto before = std::chrono::high_resolution_clock::now();
+			Sound::render(output.data() + size_t(b) * Sound::MixSamples * 2);
+			auto after = std::chrono::high_resolution_clock::now();
+			times[b] = std::chrono::duration< double >(after - before).count();
+		}
+
+		//let everything finish, so the next scene starts from silence:
+		Sound::stop_all_samples();
+		playing.clear();
+		std::vector< float > discard(Sound::MixSamples * 2);
+		for (uint32_t b = 0; b < 4; ++b) Sound::render(discard.data());
+
+		std::vector< double > sorted = times;
+		std::sort(sorted.begin(), sorted.end());
+		double mean = 0.0;
+		for (auto t : times) mean += t;
+		mean /= times.size();
+		double median = sorted[sorted.size() / 2];
+		double worst = sorted.back();
+
+		std::cout << scene.name << ": " << voices << " voices, " << blocks << " blocks; per block: "
+			<< mean * 1e6 << "us mean, " << median * 1e6 << "us median, " << worst * 1e6 << "us worst; "
+			<< BlockSeconds / mean << "x real time (" << BlockSeconds / worst << "x worst case)" << std::endl;
+
+		if (!wav_prefix.empty()) {
+			std::string filename = wav_prefix + scene.name + ".wav";
+			try {
+				write_wav(filename, output);
+			} catch (std::exception &e) {
+				std::cerr << "ERROR: " << e.what() << std::endl;
+				return 1;
+			}
+			char hash[17];
+			snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)asset_hash(output.data(), output.size() * sizeof(float)));
+			std::cout << "  wrote '" << filename << "' (output hash " << hash << ")" << std::endl;
+		}
+	}
+
+	if (!ran) {
+		std::cerr << "ERROR: no scene named '" << only_scene << "'." << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+//pack_assets packs the data files in a directory into a single archive that AssetArchive reads:
+//  ./pack_assets [--lz4] <data dir> <output.pack>
+// (the client and server look for dist/assets.pack, and fall back to the loose files if it isn't there)
+
+#include "AssetArchive.hpp"
+#include "lz4_block.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+//only files that the game loads are packed (not executables, source art, etc):
+static bool is_data_file(std::string const &name) {
+	static std::vector< std::string > const extensions = {
+		".pnc", ".p", ".scene", ".collision", ".walk", ".banim", ".tanim", ".manim", ".png", ".tex", ".wav", ".txt"
+	};
+	if (name == "README.txt") return false;
+	for (auto const &ext : extensions) {
+		if (name.size() > ext.size() && name.compare(name.size() - ext.size(), ext.size(), ext) == 0) return true;
+	}
+	return false;
+}
+
+//list data files under 'dir' (as paths relative to 'dir', with '/' separators):
+static void list_files(std::string const &dir, std::string const &prefix, std::vector< std::string > *names) {
+#ifdef _WIN32
+	WIN32_FIND_DATAA info;
+	HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &info);
+	if (find == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to list directory '" + dir + "'.");
+	}
+	do {
+		std::string name = info.cFileName;
+		if (name.empty() || name[0] == '.') continue;
+		if (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			list_files(dir + "\\" + name, prefix + name + "/", names);
+		} else if (is_data_file(name)) {
+			names->emplace_back(prefix + name);
+		}
+	} while (FindNextFileA(find, &info));
+	FindClose(find);
+#else
+	DIR *d = opendir(dir.c_str());
+	if (!d) {
+		throw std::runtime_error("Failed to list directory '" + dir + "'.");
+	}
+	while (struct dirent *ent = readdir(d)) {
+		std::string name = ent->d_name;
+		if (name.empty() || name[0] == '.') continue;
+		struct stat info;
+		if (stat((dir + "/" + name).c_str(), &info) != 0) continue;
+		if (S_ISDIR(info.st_mode)) {
+			list_files(dir + "/" + name, prefix + name + "/", names);
+		} else if (S_ISREG(info.st_mode) && is_data_file(name)) {
+			names->emplace_back(prefix + name);
+		}
+	}
+	closedir(d);
+#endif
+}
+
+int main(int argc, char **argv) {
+	bool use_lz4 = false;
+	std::vector< std::string > args;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--lz4") use_lz4 = true;
+		else args.emplace_back(arg);
+	}
+	if (args.size() != 2) {
+		std::cerr << "Usage:\n\t./pack_assets [--lz4] <data dir> <output.pack>" << std::endl;
+		return 1;
+	}
+	std::string dir = args[0];
+	std::string out_filename = args[1];
+
+	try {
+		std::vector< std::string > files;
+		list_files(dir, "", &files);
+		std::sort(files.begin(), files.end()); //(index is searched by name)
+
+		AssetArchive::Header header;
+		header.entry_count = uint32_t(files.size());
+
+		std::vector< AssetArchive::Entry > entries(files.size());
+		std::string names;
+		for (size_t i = 0; i < files.size(); ++i) {
+			entries[i].name_begin = uint32_t(names.size());
+			names += files[i];
+			entries[i].name_end = uint32_t(names.size());
+		}
+		header.names_size = uint32_t(names.size());
+
+		auto align = [](uint64_t offset) {
+			return (offset + AssetArchive::Alignment - 1) / AssetArchive::Alignment * AssetArchive::Alignment;
+		};
+
+		//read (and maybe compress) each file:
+		std::vector< std::vector< uint8_t > > stored(files.size());
+		uint64_t offset = align(sizeof(header) + entries.size() * sizeof(AssetArchive::Entry) + names.size());
+		uint64_t total_size = 0;
+		for (size_t i = 0; i < files.size(); ++i) {
+			std::ifstream in(dir + "/" + files[i], std::ios::binary);
+			if (!in) throw std::runtime_error("Failed to open '" + dir + "/" + files[i] + "'.");
+			std::vector< uint8_t > raw((std::istreambuf_iterator< char >(in)), std::istreambuf_iterator< char >());
+
+			AssetArchive::Entry &entry = entries[i];
+			entry.size = raw.size();
+			entry.hash = asset_hash(raw.data(), raw.size());
+			if (use_lz4) {
+				std::vector< uint8_t > compressed = lz4_compress(raw.data(), raw.size());
+				//(only worth decompressing if it saves a decent amount; e.g. png files barely shrink)
+				if (compressed.size() < raw.size() - raw.size() / 8) {
+					entry.flags |= AssetArchive::FlagLZ4;
+					raw = std::move(compressed);
+				}
+			}
+			entry.offset = offset;
+			entry.stored_size = raw.size();
+			offset = align(offset + raw.size());
+			total_size += entry.size;
+			stored[i] = std::move(raw);
+		}
+
+		//write header, index, names, contents:
+		std::ofstream out(out_filename, std::ios::binary);
+		if (!out) throw std::runtime_error("Failed to open '" + out_filename + "' for writing.");
+		out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+		out.write(reinterpret_cast< char const * >(entries.data()), entries.size() * sizeof(AssetArchive::Entry));
+		out.write(names.data(), names.size());
+		for (size_t i = 0; i < files.size(); ++i) {
+			uint64_t at = uint64_t(out.tellp());
+			static char const zeros[AssetArchive::Alignment] = {0};
+			out.write(zeros, std::streamsize(entries[i].offset - at));
+			out.write(reinterpret_cast< char const * >(stored[i].data()), stored[i].size());
+		}
+		out.close();
+		if (!out) throw std::runtime_error("Failed to write '" + out_filename + "'.");
+
+		//read everything back, to make sure it decompresses + hashes correctly:
+		AssetArchive check(out_filename);
+		for (auto const &name : files) {
+			AssetArchive::Contents contents;
+			if (!check.find(name, &contents)) throw std::runtime_error("Packed file '" + name + "' is missing from archive.");
+		}
+
+		std::cout << "Packed " << files.size() << " files (" << total_size / 1024 << " KiB) into '" << out_filename << "' (" << offset / 1024 << " KiB)." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
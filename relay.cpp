@@ -0,0 +1,99 @@
+//relay watches a server as one spectator and re-broadcasts its stream to many spectators:
+//  ./relay <server host> <server port> <listen port>
+// spectators connect to the relay exactly as they would to the server (sending 'w'; see Spectator.hpp), so
+// the server only ever sends one copy of the spectator stream however many people are watching (and relays
+// can be chained). Messages are forwarded whole and unchanged; the latest roster is kept for late joiners.
+
+#include "Connection.hpp"
+#include "Spectator.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc != 4) {
+		std::cerr << "Usage:\n\t./relay <server host> <server port> <listen port>" << std::endl;
+		return 1;
+	}
+
+	try {
+		Client upstream(argv[1], argv[2]);
+		upstream.connection.send('w'); //watch
+
+		Server server(argv[3]);
+
+		std::set< Connection * > undecided;
+		std::set< Connection * > spectators;
+		std::vector< char > roster; //latest 'r' message (empty until the game begins)
+
+		uint64_t bytes_in = 0;
+		uint64_t bytes_out = 0;
+		auto report_start = std::chrono::high_resolution_clock::now();
+
+		bool connected = true;
+		while (connected) {
+			//forward whole messages from the server:
+			upstream.poll([&](Connection *c, Connection::Event evt) {
+				if (evt == Connection::OnClose) {
+					std::cerr << "Lost connection to server." << std::endl;
+					connected = false;
+				} else if (evt == Connection::OnRecv) {
+					size_t size;
+					while ((size = Spectator::message_size(c->recv_buffer)) != 0) {
+						std::vector< char > message(c->recv_buffer.begin(), c->recv_buffer.begin() + size);
+						c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + size);
+						if (message[0] == 'r') roster = message;
+						bytes_in += size;
+						for (auto s = spectators.begin(); s != spectators.end(); /*later*/) {
+							if (Spectator::send(*s, message)) {
+								bytes_out += size;
+								++s;
+							} else {
+								s = spectators.erase(s);
+							}
+						}
+					}
+				}
+			}, 0.0);
+
+			//accept spectators:
+			server.poll([&](Connection *c, Connection::Event evt) {
+				if (evt == Connection::OnOpen) {
+					undecided.insert(c);
+				} else if (evt == Connection::OnClose) {
+					undecided.erase(c);
+					spectators.erase(c);
+				} else if (evt == Connection::OnRecv) {
+					if (undecided.erase(c)) {
+						if (c->recv_buffer[0] == 'w') {
+							spectators.insert(c);
+							if (!roster.empty() && !Spectator::send(c, roster)) spectators.erase(c);
+						} else {
+							std::cerr << "WARNING: connection on " << c->socket << " isn't a spectator (a relay can't host players); closing it." << std::endl;
+							c->close();
+						}
+					}
+					c->recv_buffer.clear(); //(spectators have nothing more to say)
+				}
+			}, 0.01);
+
+			auto now = std::chrono::high_resolution_clock::now();
+			float elapsed = std::chrono::duration< float >(now - report_start).count();
+			if (elapsed >= 10.0f) {
+				std::cout << spectators.size() << " spectators; " << (bytes_in / elapsed / 1024.0f) << " KiB/s in, "
+					<< (bytes_out / elapsed / 1024.0f) << " KiB/s out." << std::endl;
+				bytes_in = bytes_out = 0;
+				report_start = now;
+			}
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 1;
+}
@@ -0,0 +1,116 @@
+//replay feeds a server recording (./server <port> --record <file>) back through GameState, with no networking:
+//  ./replay [--repeat N] [--no-verify] <recording>
+// every update is run as fast as possible, and (unless --no-verify) the state after it is checked against the
+// hash the server recorded, so a captured match is both a regression test (did the simulation change?) and a
+// benchmark (per-update time, and how many times faster than real time the simulation runs).
+// With --repeat, the whole match is replayed N times (in fresh GameStates) and the timings are combined.
+// (reads the same level data as the server, so run it from the same directory.)
+
+#include "GameState.hpp"
+#include "Recording.hpp"
+#include "Load.hpp"
+#include "AssetArchive.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t repeat = 1;
+	bool verify = true;
+	std::vector< std::string > files;
+	bool usage = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--repeat" && i + 1 < argc) repeat = uint32_t(std::stoul(argv[++i]));
+		else if (arg == "--no-verify") verify = false;
+		else if (arg.size() > 0 && arg[0] != '-') files.emplace_back(arg);
+		else usage = true;
+	}
+	if (usage || files.size() != 1 || repeat == 0) {
+		std::cerr << "Usage:\n\t./replay [--repeat N] [--no-verify] <recording>" << std::endl;
+		return 1;
+	}
+
+	try {
+		Recording recording(files[0]);
+		std::cout << "'" << files[0] << "': " << recording.events.size() << " events, " << recording.updates << " updates." << std::endl;
+
+		data_archive(); //(map the packed data archive, if there is one)
+		call_load_functions();
+
+		typedef std::chrono::high_resolution_clock Clock;
+		std::vector< float > update_times; //seconds per update, over all repeats
+		update_times.reserve(size_t(recording.updates) * repeat);
+		float simulated = 0.0f; //seconds of game time, per repeat
+		float setup_time = 0.0f;
+		uint32_t mismatches = 0;
+
+		for (uint32_t r = 0; r < repeat; ++r) {
+			auto before_setup = Clock::now();
+			GameState state;
+			setup_time += std::chrono::duration< float >(Clock::now() - before_setup).count();
+
+			if (verify && hash_state(state) != recording.initial_hash) {
+				throw std::runtime_error("initial state differs from the recorded one (was the level data changed?)");
+			}
+
+			simulated = 0.0f;
+			uint32_t update = 0;
+			for (auto const &event : recording.events) {
+				if (event.type == Recording::Event::AddPlayer) {
+					state.add_player(event.id, event.team, std::string(event.data, event.data + Player::NICKNAME_LENGTH));
+				} else if (event.type == Recording::Event::PlayerMessage) {
+					if (!state.apply_player_message(event.id, event.data)) {
+						throw std::runtime_error("recorded message for player " + std::to_string(event.id) + ", who isn't in the game");
+					}
+				} else if (event.type == Recording::Event::Update) {
+					auto before = Clock::now();
+					state.update(event.elapsed);
+					update_times.emplace_back(std::chrono::duration< float >(Clock::now() - before).count());
+					simulated += event.elapsed;
+
+					if (verify && hash_state(state) != event.hash) {
+						if (mismatches == 0) {
+							std::cerr << "MISMATCH: state after update " << update << " (" << simulated << "s into the match) differs from the recording." << std::endl;
+						}
+						mismatches += 1;
+					}
+					update += 1;
+				}
+			}
+		}
+
+		std::vector< float > sorted = update_times;
+		std::sort(sorted.begin(), sorted.end());
+		auto percentile = [&sorted](float f) {
+			if (sorted.empty()) return 0.0f;
+			return sorted[std::min(sorted.size() - 1, size_t(f * sorted.size()))];
+		};
+		double total = 0.0;
+		for (float t : update_times) total += t;
+		double mean = (update_times.empty() ? 0.0 : total / update_times.size());
+
+		std::cout << "Replayed " << repeat << "x " << simulated << "s of game time (" << recording.updates << " updates each):\n"
+			<< "  setup: " << 1000.0f * setup_time / repeat << " ms per GameState\n"
+			<< "  update (us): mean " << 1e6 * mean << ", p50 " << 1e6f * percentile(0.5f) << ", p95 " << 1e6f * percentile(0.95f)
+			<< ", p99 " << 1e6f * percentile(0.99f) << ", max " << 1e6f * percentile(1.0f) << "\n"
+			<< "  " << (total > 0.0 ? simulated * repeat / total : 0.0) << "x faster than real time" << std::endl;
+
+		if (verify) {
+			if (mismatches) {
+				std::cout << "FAILED: " << mismatches << " of " << update_times.size() << " updates didn't match the recording." << std::endl;
+				return 1;
+			}
+			std::cout << "OK: every update matched the recording." << std::endl;
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
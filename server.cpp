@@ -1,10 +1,15 @@
 #include "Connection.hpp"
 #include "GameState.hpp"
 #include "Load.hpp"
+#include "AssetArchive.hpp"
+#include "Recording.hpp"
+#include "Spectator.hpp"
+#include "Interest.hpp"
 
 #include <iostream>
 #include <set>
 #include <chrono>
+#include <memory>
 
 #define GLM_ENABLE_EXPERIMENTAL
 
@@ -39,11 +44,15 @@ void send_begin(Connection *c, int player_id) {
 }
 
 //when in game:
-void send_state(Connection *c, GameState *state, int player_id) {
+void send_state(Connection *c, GameState *state, int player_id, std::vector< uint32_t > const &relevant) {
   if (c) {
     c->send('s'); //state update
-                  // is_shot + player_count * (pos + vel + quat + is_fires + harpoon_pos + harpoon_vel) + treasure_pos + is_held_by 
-                  // (player_count + 1) * bool + (3 * treasure_count + player_count * 13) * float + treasure_count * int
+                  // size (of the rest) + is_shot + current points + count + count * (id + pos + vel + quat + harpoon state + harpoon pos + harpoon vel + harpoon quat) + treasure_count * (pos + is_held_by)
+                  // only players relevant to this client are sent (see Interest.hpp); the client keeps the last state it got for the others
+    uint32_t size = uint32_t(sizeof(bool) + sizeof(state->current_points) + sizeof(uint32_t)
+      + relevant.size() * (sizeof(uint32_t) + 20 * sizeof(float) + sizeof(int))
+      + GameState::num_teams * (3 * sizeof(float) + sizeof(int)));
+    c->send(size);
 
     bool is_shot = state->players[player_id].is_shot; //whether the player is stunned by a harpoon
     c->send(is_shot);
@@ -52,7 +61,10 @@ void send_state(Connection *c, GameState *state, int player_id) {
     c->send(state->current_points);
 
     //players
-    for (int i = 0; i < state->player_count; i++) {
+    c->send(uint32_t(relevant.size()));
+    for (uint32_t i : relevant) {
+      c->send(i);
+
       glm::vec3 pos = state->players[i].position;
       glm::vec3 vel = state->players[i].velocity;
       glm::quat rot = state->players[i].rotation;
@@ -88,7 +100,7 @@ void update_lobby(std::unordered_map< Connection *, int > *player_ledger, int pl
 	}
 }
 
-bool check_start(GameState *state, std::unordered_map< Connection *, int > *player_ledger, std::unordered_map< int, PlayerInfo * > *players_info, int player_count) {
+bool check_start(GameState *state, std::unordered_map< Connection *, int > *player_ledger, std::unordered_map< int, PlayerInfo * > *players_info, int player_count, RecordingWriter *recording) {
 	if (players_info->size() == player_count) {
 		//make sure everyone is ready
 		for (auto iter = players_info->begin(); iter != players_info->end(); iter++) {
@@ -107,6 +119,7 @@ bool check_start(GameState *state, std::unordered_map< Connection *, int > *play
 			int team = player_info->team;
 			std::string nickname = player_info->nickname;
 			state->add_player(player_id, team, nickname);
+			if (recording) recording->add_player(player_id, team, nickname);
 		}
 		return true;
 	}
@@ -115,30 +128,83 @@ bool check_start(GameState *state, std::unordered_map< Connection *, int > *play
 	}
 }
 
-void update_server(GameState *state, std::unordered_map< Connection *, int > *player_ledger, float time) {
+void update_server(GameState *state, std::unordered_map< Connection *, int > *player_ledger, float time, RecordingWriter *recording, InterestManager *interest, SpectatorFeed *feed, std::set< Connection * > *spectators) {
   state->update(time);
-  //send state to all clients
+  if (recording) recording->update(time, *state);
+  //send state to all clients (just the players relevant to each, unless interest management is off):
+  std::vector< uint32_t > relevant;
+  if (interest) interest->update(*state);
   for (auto iter = player_ledger->begin(); iter != player_ledger->end(); iter++) {
-    send_state(iter->first, state, iter->second);
+    if (interest) {
+      interest->relevant(*state, iter->second, &relevant);
+    } else {
+      relevant.clear();
+      for (int i = 0; i < state->player_count; i++) relevant.emplace_back(i);
+    }
+    send_state(iter->first, state, iter->second, relevant);
+  }
+  //send (delayed) snapshots to spectators -- encoded once, however many are watching:
+  std::vector< char > snapshots;
+  feed->update(*state, time, &snapshots);
+  if (!snapshots.empty()) {
+    for (auto iter = spectators->begin(); iter != spectators->end(); /*later*/) {
+      if (Spectator::send(*iter, snapshots)) ++iter;
+      else iter = spectators->erase(iter);
+    }
   }
 }
 
 int main(int argc, char **argv) {
-	if (argc != 2) {
-		std::cerr << "Usage:\n\t./server <port>" << std::endl;
+	//optionally record everything fed to the simulation, for replay (see replay.cpp):
+	std::string record_filename;
+	//spectators get snapshots this many seconds old, this many times a second (see Spectator.hpp):
+	float spectator_delay = 2.0f;
+	float spectator_rate = 10.0f;
+	//which players each client is sent, each tick (see Interest.hpp):
+	bool use_interest = true;
+	InterestManager::Settings interest_settings;
+	bool usage = (argc < 2);
+	for (int i = 2; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--record" && i + 1 < argc) record_filename = argv[++i];
+		else if (arg == "--spectator-delay" && i + 1 < argc) spectator_delay = std::stof(argv[++i]);
+		else if (arg == "--spectator-rate" && i + 1 < argc) spectator_rate = std::stof(argv[++i]);
+		else if (arg == "--no-interest") use_interest = false;
+		else if (arg == "--interest-near" && i + 1 < argc) interest_settings.near = std::stof(argv[++i]);
+		else if (arg == "--interest-far" && i + 1 < argc) interest_settings.far = std::stof(argv[++i]);
+		else if (arg == "--occlusion") interest_settings.occlusion = true;
+		else usage = true;
+	}
+	if (usage || !(spectator_delay >= 0.0f) || !(spectator_rate > 0.0f) || !(interest_settings.near > 0.0f && interest_settings.near < 1e6f) || !(interest_settings.far > 0.0f && interest_settings.far < 1e6f)) {
+		std::cerr << "Usage:\n\t./server <port> [--record <file>] [--spectator-delay S] [--spectator-rate HZ] [--no-interest] [--interest-near R] [--interest-far R] [--occlusion]" << std::endl;
 		return 1;
 	}
 	
 	Server server(argv[1]);
 
+  data_archive(); //(map the packed data archive, if there is one)
   call_load_functions();
 
   GameState state;
 
+  std::unique_ptr< RecordingWriter > recording;
+  if (!record_filename.empty()) {
+	  recording.reset(new RecordingWriter(record_filename, state));
+	  std::cout << "Recording to '" << record_filename << "'." << std::endl;
+  }
+
   std::unordered_map< Connection *, int > player_ledger;
   std::unordered_map< int, PlayerInfo * > players_info;
   int player_count = 0;
 
+  //connections are players or spectators, depending on their first message:
+  std::set< Connection * > undecided;
+  std::set< Connection * > spectators;
+  SpectatorFeed spectator_feed(spectator_delay, spectator_rate);
+
+  std::unique_ptr< InterestManager > interest;
+  if (use_interest) interest.reset(new InterestManager(interest_settings));
+
   bool playing = false;
 
   auto then = std::chrono::high_resolution_clock::now();
@@ -148,19 +214,38 @@ int main(int argc, char **argv) {
 	  server.poll([&](Connection *c, Connection::Event evt) {
 		  if (evt == Connection::OnOpen) {
 			  std::cout << "Connection open" << std::endl;
-			  int player_id = player_count;
-			  player_ledger.insert(std::make_pair(c, player_id));
-			  players_info[player_id] = new PlayerInfo();
-			  player_count++;
-			  update_lobby(&player_ledger, player_count, &players_info);
+			  undecided.insert(c);
 		  }
 		  else if (evt == Connection::OnClose) {
 			  std::cout << "Connection close" << std::endl;
 			  //lost connection with player :(
+			  // (the connection is freed after this, so stop sending to it; the player stays in the game)
+			  player_ledger.erase(c);
+			  undecided.erase(c);
+			  spectators.erase(c);
 		  }
 		  else {
 			  //        std::cout << "Connection receive" << std::endl;
 			  assert(evt == Connection::OnRecv);
+			  if (undecided.erase(c)) {
+				  if (c->recv_buffer[0] == 'w') {
+					  std::cout << "Spectator joined" << std::endl;
+					  c->recv_buffer.erase(c->recv_buffer.begin());
+					  spectators.insert(c);
+					  if (playing && !Spectator::send(c, Spectator::roster(state))) spectators.erase(c);
+				  }
+				  else {
+					  int player_id = player_count;
+					  player_ledger.insert(std::make_pair(c, player_id));
+					  players_info[player_id] = new PlayerInfo();
+					  player_count++;
+					  update_lobby(&player_ledger, player_count, &players_info);
+				  }
+			  }
+			  if (spectators.count(c)) {
+				  c->recv_buffer.clear(); //(spectators have nothing more to say)
+				  return;
+			  }
 			  uint32_t player_id = player_ledger.find(c)->second; // get player ID corresponding to connection
 
               while (!(c->recv_buffer.empty())) {
@@ -174,7 +259,15 @@ int main(int argc, char **argv) {
 						  memcpy(&ready, c->recv_buffer.data() + 1, sizeof(bool));
 						  players_info[player_id]->ready = ready;
 						  c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 1 + sizeof(bool));
-						  playing = check_start(&state, &player_ledger, &players_info, player_count);
+						  bool was_playing = playing;
+						  playing = check_start(&state, &player_ledger, &players_info, player_count, recording.get());
+						  if (playing && !was_playing) {
+							  std::vector< char > roster = Spectator::roster(state);
+							  for (auto s = spectators.begin(); s != spectators.end(); /*later*/) {
+								  if (Spectator::send(*s, roster)) ++s;
+								  else s = spectators.erase(s);
+							  }
+						  }
 					  }
                   }
                   else if (c->recv_buffer[0] == 'n') {
@@ -190,27 +283,14 @@ int main(int argc, char **argv) {
                       }
                   }
                   else if (c->recv_buffer[0] == 'p') {
-                      if (c->recv_buffer.size() < 1 + 10 * sizeof(float) + 2 * sizeof(bool)) {
+                      if (c->recv_buffer.size() < 1 + GameState::player_message_size) {
                           return; //wait for more data
                       }
                       else {
-						  Player* player_data = &state.players.find(player_id)->second;
-                          memcpy(&player_data->position, c->recv_buffer.data() + 1, sizeof(glm::vec3));
-                          memcpy(&player_data->velocity, c->recv_buffer.data() + 1 + 1 * sizeof(glm::vec3), sizeof(glm::vec3));
-                          memcpy(&player_data->rotation, c->recv_buffer.data() + 1 + 2 * sizeof(glm::vec3), sizeof(glm::quat));
-
-                          bool shot = false;
-                          bool grabbed = false;
-                          memcpy(&shot, c->recv_buffer.data() + 1 + 10 * sizeof(float) + 0 * sizeof(bool), sizeof(bool));
-                          memcpy(&grabbed, c->recv_buffer.data() + 1 + 10 * sizeof(float) + 1 * sizeof(bool), sizeof(bool));
-                          if (shot) {
-                              player_data->shot_harpoon = true;
+                          if (state.apply_player_message(player_id, c->recv_buffer.data() + 1) && recording) {
+                              recording->player_message(player_id, c->recv_buffer.data() + 1);
                           }
-                          if (grabbed) {
-                              player_data->grab = true;
-                          }
-
-                          c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 1 + 10 * sizeof(float) + 2 * sizeof(bool));
+                          c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 1 + GameState::player_message_size);
                       }
                   }
               }
@@ -223,7 +303,7 @@ int main(int argc, char **argv) {
 		  float diff = std::chrono::duration_cast<std::chrono::duration<float>>(now - then).count();
 		  if (diff > 0.03f) {
 			  then = now;
-			  update_server(&state, &player_ledger, diff);
+			  update_server(&state, &player_ledger, diff, recording.get(), interest.get(), &spectator_feed, &spectators);
 		  }
 	  }
   }
@@ -2,32 +2,17 @@
 
 #include "compile_program.hpp"
 
-VertexColorProgram::VertexColorProgram() {
-	program = compile_program(R"(
-#version 330
-uniform mat4 object_to_clip;
-uniform mat4 object_to_light;
-uniform mat3 normal_to_light;
-layout(location=0) in vec4 Position; //note: layout keyword used to make sure that the location-0 attribute is always bound to something
-in vec3 Normal;
-in vec4 Color;
-out vec4 position;
-out vec3 normal;
-out vec4 color;
-void main() {
-	gl_Position = object_to_clip * Position;
-	position = object_to_light * Position;
-	normal = normal_to_light * Normal;
-	color = Color;
-}
-)",
-		R"(
+char const *vertex_color_fragment_shader = R"(
 #version 330
 uniform vec3 sun_direction;
 uniform vec3 sun_color;
 uniform vec3 sky_direction;
 uniform vec3 sky_color;
 uniform vec3 view_pos;
+uniform mat4 world_to_static_shadow;
+uniform mat4 world_to_dynamic_shadow;
+uniform sampler2DShadow static_shadow_tex;
+uniform sampler2DShadow dynamic_shadow_tex;
 in vec4 position;
 in vec3 normal;
 in vec4 color;
@@ -49,9 +34,15 @@ void main() {
 		float nl = 0.5 + 0.5 * dot(n,l);
 		total_light += nl * sky_color;
 	}
-	{ //sun (directional) light:
+	{ //sun (directional) light, attenuated by the cached static + per-frame dynamic shadow maps:
 		vec3 l = sun_direction;
-		float nl = max(min_light, dot(n,l));
+		vec4 static_at = world_to_static_shadow * position;
+		vec4 dynamic_at = world_to_dynamic_shadow * position;
+		float shadow = min(
+			textureProj(static_shadow_tex, static_at),
+			textureProj(dynamic_shadow_tex, dynamic_at)
+		);
+		float nl = max(min_light, dot(n,l) * shadow);
 		total_light += nl * sun_color;
 	}
 	vec3 light_color = color.rgb * total_light;
@@ -68,7 +59,28 @@ void main() {
 
 	fragColor = vec4(final_color, color.a);
 }
-)"
+)";
+
+VertexColorProgram::VertexColorProgram() {
+	program = compile_program(R"(
+#version 330
+uniform mat4 object_to_clip;
+uniform mat4 object_to_light;
+uniform mat3 normal_to_light;
+layout(location=0) in vec4 Position; //note: layout keyword used to make sure that the location-0 attribute is always bound to something
+in vec3 Normal;
+in vec4 Color;
+out vec4 position;
+out vec3 normal;
+out vec4 color;
+void main() {
+	gl_Position = object_to_clip * Position;
+	position = object_to_light * Position;
+	normal = normal_to_light * Normal;
+	color = Color;
+}
+)",
+		vertex_color_fragment_shader
 	);
 
 	object_to_clip_mat4 = glGetUniformLocation(program, "object_to_clip");
@@ -80,6 +92,14 @@ void main() {
 	sky_direction_vec3 = glGetUniformLocation(program, "sky_direction");
 	sky_color_vec3 = glGetUniformLocation(program, "sky_color");
 	view_pos_vec3 = glGetUniformLocation(program, "view_pos");
+
+	world_to_static_shadow_mat4 = glGetUniformLocation(program, "world_to_static_shadow");
+	world_to_dynamic_shadow_mat4 = glGetUniformLocation(program, "world_to_dynamic_shadow");
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "static_shadow_tex"), StaticShadowUnit);
+	glUniform1i(glGetUniformLocation(program, "dynamic_shadow_tex"), DynamicShadowUnit);
+	glUseProgram(0);
 }
 
 Load< VertexColorProgram > vertex_color_program(LoadTagInit, [](){
@@ -15,7 +15,17 @@ struct VertexColorProgram {
 	GLuint sky_color_vec3 = -1U;
     GLuint view_pos_vec3 = -1U;
 
+	//sun shadow maps (depth textures with compare mode) are read from these texture units:
+	// (past Scene::Object::ProgramInfo::TextureCount so Scene::draw leaves them alone)
+	enum : GLuint { StaticShadowUnit = 4, DynamicShadowUnit = 5 };
+	GLuint world_to_static_shadow_mat4 = -1U;
+	GLuint world_to_dynamic_shadow_mat4 = -1U;
+
 	VertexColorProgram();
 };
 
 extern Load< VertexColorProgram > vertex_color_program;
+
+//lighting (sun + shadows, sky, fog, depth gradient) is shared with bone_vertex_color_program,
+// which expects the same 'position', 'normal', and 'color' inputs and uniforms:
+extern char const *vertex_color_fragment_shader;